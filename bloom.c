@@ -12,6 +12,10 @@
 #include "tree-walk.h"
 #include "config.h"
 #include "repository.h"
+#include "gettext.h"
+#include "odb.h"
+#include "thread-utils.h"
+#include "trace2.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
@@ -433,50 +437,89 @@ struct bloom_filter *get_bloom_filter(struct repository *r, struct commit *c)
 	return filter;
 }
 
-struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
-						 struct commit *c,
-						 int compute_if_not_present,
-						 const struct bloom_filter_settings *settings,
-						 enum bloom_filter_computed *computed)
-{
-	struct bloom_filter *filter;
-	int i;
-	struct diff_options diffopt;
+/*
+ * The changed paths of a commit are collected into a queue of our own
+ * rather than into diff_queued_diff so that several commits can be
+ * diffed at the same time.
+ */
+struct bloom_diff_data {
+	struct diff_queue_struct queue;
+	/* held while consulting the submodule config, if not NULL */
+	pthread_mutex_t *submodule_lock;
+};
 
-	if (computed)
-		*computed = BLOOM_NOT_COMPUTED;
+static void bloom_diff_check_max_changes(struct diff_options *opt,
+					 struct bloom_diff_data *data)
+{
+	/*
+	 * The tree diff only knows to stop early when diff_queued_diff
+	 * grows past max_changes; emulate that with "quick".
+	 */
+	if (data->queue.nr > opt->max_changes)
+		opt->flags.has_changes = 1;
+}
 
-	if (!bloom_filters.slab_size)
-		return NULL;
+static void bloom_diff_change(struct diff_options *opt,
+			      unsigned old_mode, unsigned new_mode,
+			      const struct object_id *old_oid,
+			      const struct object_id *new_oid,
+			      int old_oid_valid, int new_oid_valid,
+			      const char *fullpath,
+			      unsigned old_dirty_submodule,
+			      unsigned new_dirty_submodule)
+{
+	struct bloom_diff_data *data = opt->change_fn_data;
+	int lock = data->submodule_lock &&
+		S_ISGITLINK(old_mode) && S_ISGITLINK(new_mode);
+
+	if (lock)
+		pthread_mutex_lock(data->submodule_lock);
+	diff_queue_change(&data->queue, opt, old_mode, new_mode,
+			  old_oid, new_oid, old_oid_valid, new_oid_valid,
+			  fullpath, old_dirty_submodule, new_dirty_submodule);
+	if (lock)
+		pthread_mutex_unlock(data->submodule_lock);
+
+	bloom_diff_check_max_changes(opt, data);
+}
 
-	filter = bloom_filter_slab_at(&bloom_filters, c);
+static void bloom_diff_addremove(struct diff_options *opt,
+				 int addremove, unsigned mode,
+				 const struct object_id *oid,
+				 int oid_valid,
+				 const char *fullpath, unsigned dirty_submodule)
+{
+	struct bloom_diff_data *data = opt->change_fn_data;
+	int lock = data->submodule_lock && S_ISGITLINK(mode);
 
-	if (!filter->data) {
-		uint32_t graph_pos;
-		if (repo_find_commit_pos_in_graph(r, c, &graph_pos))
-			load_bloom_filter_from_graph(r->objects->commit_graph,
-						     filter, graph_pos);
-	}
+	if (lock)
+		pthread_mutex_lock(data->submodule_lock);
+	diff_queue_addremove(&data->queue, opt, addremove, mode, oid,
+			     oid_valid, fullpath, dirty_submodule);
+	if (lock)
+		pthread_mutex_unlock(data->submodule_lock);
 
-	if (filter->data && filter->len) {
-		struct bloom_filter *upgrade;
-		if (!settings || settings->hash_version == filter->version)
-			return filter;
+	bloom_diff_check_max_changes(opt, data);
+}
 
-		/* version mismatch, see if we can upgrade */
-		if (compute_if_not_present &&
-		    git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
-			upgrade = upgrade_filter(r, c, filter,
-						 settings->hash_version);
-			if (upgrade) {
-				if (computed)
-					*computed |= BLOOM_UPGRADED;
-				return upgrade;
-			}
-		}
-	}
-	if (!compute_if_not_present)
-		return NULL;
+/*
+ * Compute the changed-path Bloom filter of the (already parsed) commit
+ * "c" into "filter", adding BLOOM_COMPUTED and any truncation flags to
+ * "computed".
+ */
+static void compute_bloom_filter(struct repository *r, struct commit *c,
+				 const struct bloom_filter_settings *settings,
+				 struct bloom_filter *filter,
+				 enum bloom_filter_computed *computed,
+				 pthread_mutex_t *submodule_lock)
+{
+	struct bloom_diff_data data = {
+		.queue = DIFF_QUEUE_INIT,
+		.submodule_lock = submodule_lock,
+	};
+	struct diff_queue_struct *q = &data.queue;
+	struct diff_options diffopt;
+	int i;
 
 	repo_diff_setup(r, &diffopt);
 	diffopt.flags.recursive = 1;
@@ -484,22 +527,31 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	diffopt.max_changes = settings->max_changed_paths;
 	diff_setup_done(&diffopt);
 
-	/* ensure commit is parsed so we have parent information */
-	repo_parse_commit(r, c);
+	/*
+	 * Only the set of changed paths matters to us, and with renames
+	 * disabled diffcore_std() would not change that, so we can skip
+	 * it and queue the changes ourselves. "diff_from_contents" keeps
+	 * every change from setting "has_changes", which we instead set
+	 * once there are more than max_changes.
+	 */
+	diffopt.change = bloom_diff_change;
+	diffopt.add_remove = bloom_diff_addremove;
+	diffopt.change_fn_data = &data;
+	diffopt.flags.quick = 1;
+	diffopt.flags.diff_from_contents = 1;
 
 	if (c->parents)
 		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
 	else
 		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
 
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
+	if (q->nr <= settings->max_changed_paths) {
 		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
 		struct pathmap_hash_entry *e;
 		struct hashmap_iter iter;
 
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
+		for (i = 0; i < q->nr; i++) {
+			const char *path = q->queue[i]->two->path;
 
 			/*
 			 * Add each leading directory of the changed file, i.e. for
@@ -530,16 +582,14 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
 			init_truncated_large_filter(filter,
 						    settings->hash_version);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
+			*computed |= BLOOM_TRUNC_LARGE;
 			goto cleanup;
 		}
 
 		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
 		filter->version = settings->hash_version;
 		if (!filter->len) {
-			if (computed)
-				*computed |= BLOOM_TRUNC_EMPTY;
+			*computed |= BLOOM_TRUNC_EMPTY;
 			filter->len = 1;
 		}
 		CALLOC_ARRAY(filter->data, filter->len);
@@ -556,15 +606,268 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
 	} else {
 		init_truncated_large_filter(filter, settings->hash_version);
+		*computed |= BLOOM_TRUNC_LARGE;
+	}
 
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
+	*computed |= BLOOM_COMPUTED;
+
+	diff_queue_clear(q);
+}
+
+/*
+ * Filters computed ahead of time by start_bloom_filter_precompute(),
+ * waiting to be picked up by get_or_compute_bloom_filter().
+ */
+enum precomputed_bloom_filter_state {
+	PRECOMPUTE_NONE = 0,
+	PRECOMPUTE_QUEUED,
+	PRECOMPUTE_RUNNING,
+	PRECOMPUTE_DONE,
+};
+
+struct precomputed_bloom_filter {
+	struct bloom_filter filter;
+	enum bloom_filter_computed computed;
+	enum precomputed_bloom_filter_state state;
+};
+
+define_commit_slab(precomputed_bloom_filter_slab, struct precomputed_bloom_filter);
+
+static struct bloom_precompute {
+	struct repository *r;
+	const struct bloom_filter_settings *settings;
+	struct precomputed_bloom_filter_slab filters;
+
+	struct commit **commits;
+	size_t commits_nr, next;
+
+	pthread_t *threads;
+	int nr_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} *bloom_precompute;
+
+static void run_bloom_precompute(struct bloom_precompute *pc,
+				 struct commit *c,
+				 struct precomputed_bloom_filter *p)
+{
+	p->state = PRECOMPUTE_RUNNING;
+	pthread_mutex_unlock(&pc->mutex);
+
+	compute_bloom_filter(pc->r, c, pc->settings, &p->filter,
+			     &p->computed, &pc->mutex);
+
+	pthread_mutex_lock(&pc->mutex);
+	p->state = PRECOMPUTE_DONE;
+	pthread_cond_broadcast(&pc->cond);
+}
+
+static void *bloom_precompute_thread(void *_data)
+{
+	struct bloom_precompute *pc = _data;
+
+	trace2_thread_start("bloom-precompute");
+
+	pthread_mutex_lock(&pc->mutex);
+	while (pc->next < pc->commits_nr) {
+		struct commit *c = pc->commits[pc->next++];
+		struct precomputed_bloom_filter *p =
+			precomputed_bloom_filter_slab_peek(&pc->filters, c);
+
+		if (p->state == PRECOMPUTE_QUEUED)
+			run_bloom_precompute(pc, c, p);
+	}
+	pthread_mutex_unlock(&pc->mutex);
+
+	trace2_thread_exit();
+	return NULL;
+}
+
+void start_bloom_filter_precompute(struct repository *r,
+				   struct commit **commits, size_t nr,
+				   size_t max_new_filters,
+				   const struct bloom_filter_settings *settings,
+				   int nr_threads)
+{
+	struct bloom_precompute *pc;
+	size_t i;
+	int t;
+
+	if (bloom_precompute)
+		BUG("Bloom filters are already being precomputed");
+	if (!HAVE_THREADS || nr_threads <= 1 || !bloom_filters.slab_size)
+		return;
+
+	CALLOC_ARRAY(pc, 1);
+	pc->r = r;
+	pc->settings = settings;
+	init_precomputed_bloom_filter_slab(&pc->filters);
+
+	/*
+	 * Queue the first "max_new_filters" commits that do not have a
+	 * filter at all; those are exactly the ones that the caller will
+	 * compute, unless a failed upgrade of an existing filter uses up
+	 * part of its budget first.
+	 */
+	ALLOC_ARRAY(pc->commits, nr);
+	for (i = 0; i < nr && pc->commits_nr < max_new_filters; i++) {
+		struct commit *c = commits[i];
+		struct bloom_filter *filter = bloom_filter_slab_at(&bloom_filters, c);
+
+		if (!filter->data) {
+			uint32_t graph_pos;
+			if (repo_find_commit_pos_in_graph(r, c, &graph_pos))
+				load_bloom_filter_from_graph(r->objects->commit_graph,
+							     filter, graph_pos);
+		}
+		if (filter->data)
+			continue;
+
+		repo_parse_commit(r, c);
+		precomputed_bloom_filter_slab_at(&pc->filters, c)->state =
+			PRECOMPUTE_QUEUED;
+		pc->commits[pc->commits_nr++] = c;
 	}
 
-	if (computed)
-		*computed |= BLOOM_COMPUTED;
+	if (nr_threads > pc->commits_nr)
+		nr_threads = pc->commits_nr;
+	if (nr_threads <= 1) {
+		clear_precomputed_bloom_filter_slab(&pc->filters);
+		free(pc->commits);
+		free(pc);
+		return;
+	}
+
+	pthread_mutex_init(&pc->mutex, NULL);
+	pthread_cond_init(&pc->cond, NULL);
+	enable_obj_read_lock();
+
+	pc->nr_threads = nr_threads;
+	CALLOC_ARRAY(pc->threads, nr_threads);
+	for (t = 0; t < nr_threads; t++) {
+		int ret = pthread_create(&pc->threads[t], NULL,
+					 bloom_precompute_thread, pc);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+
+	bloom_precompute = pc;
+}
+
+static void free_precomputed_bloom_filter(struct precomputed_bloom_filter *p)
+{
+	free(p->filter.to_free);
+}
+
+void stop_bloom_filter_precompute(void)
+{
+	struct bloom_precompute *pc = bloom_precompute;
+	int t;
+
+	if (!pc)
+		return;
+
+	pthread_mutex_lock(&pc->mutex);
+	pc->next = pc->commits_nr;
+	pthread_mutex_unlock(&pc->mutex);
+
+	for (t = 0; t < pc->nr_threads; t++)
+		pthread_join(pc->threads[t], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&pc->cond);
+	pthread_mutex_destroy(&pc->mutex);
+
+	deep_clear_precomputed_bloom_filter_slab(&pc->filters,
+						 free_precomputed_bloom_filter);
+	free(pc->threads);
+	free(pc->commits);
+	FREE_AND_NULL(bloom_precompute);
+}
+
+/*
+ * Move the precomputed filter for "c" (if any) into "filter", computing
+ * it here if no thread has got to it yet.
+ */
+static int take_precomputed_bloom_filter(struct commit *c,
+					 struct bloom_filter *filter,
+					 enum bloom_filter_computed *computed)
+{
+	struct bloom_precompute *pc = bloom_precompute;
+	struct precomputed_bloom_filter *p;
+
+	if (!pc)
+		return 0;
+	p = precomputed_bloom_filter_slab_peek(&pc->filters, c);
+	if (!p || p->state == PRECOMPUTE_NONE)
+		return 0;
+
+	pthread_mutex_lock(&pc->mutex);
+	if (p->state == PRECOMPUTE_QUEUED)
+		run_bloom_precompute(pc, c, p);
+	while (p->state != PRECOMPUTE_DONE)
+		pthread_cond_wait(&pc->cond, &pc->mutex);
+
+	*filter = p->filter;
+	*computed |= p->computed;
+	memset(p, 0, sizeof(*p));
+	pthread_mutex_unlock(&pc->mutex);
+
+	return 1;
+}
+
+struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
+						 struct commit *c,
+						 int compute_if_not_present,
+						 const struct bloom_filter_settings *settings,
+						 enum bloom_filter_computed *computed)
+{
+	struct bloom_filter *filter;
+	enum bloom_filter_computed computed_scratch;
+
+	if (!computed)
+		computed = &computed_scratch;
+	*computed = BLOOM_NOT_COMPUTED;
+
+	if (!bloom_filters.slab_size)
+		return NULL;
+
+	filter = bloom_filter_slab_at(&bloom_filters, c);
+
+	if (!filter->data) {
+		uint32_t graph_pos;
+		if (repo_find_commit_pos_in_graph(r, c, &graph_pos))
+			load_bloom_filter_from_graph(r->objects->commit_graph,
+						     filter, graph_pos);
+	}
+
+	if (filter->data && filter->len) {
+		struct bloom_filter *upgrade;
+		if (!settings || settings->hash_version == filter->version)
+			return filter;
+
+		/* version mismatch, see if we can upgrade */
+		if (compute_if_not_present &&
+		    git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
+			upgrade = upgrade_filter(r, c, filter,
+						 settings->hash_version);
+			if (upgrade) {
+				*computed |= BLOOM_UPGRADED;
+				return upgrade;
+			}
+		}
+	}
+	if (!compute_if_not_present)
+		return NULL;
+
+	if (take_precomputed_bloom_filter(c, filter, computed))
+		return filter;
+
+	/* ensure commit is parsed so we have parent information */
+	repo_parse_commit(r, c);
 
-	diff_queue_clear(&diff_queued_diff);
+	compute_bloom_filter(r, c, settings, filter, computed,
+			     bloom_precompute ? &bloom_precompute->mutex : NULL);
 	return filter;
 }
 
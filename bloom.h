@@ -130,6 +130,26 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 const struct bloom_filter_settings *settings,
 						 enum bloom_filter_computed *computed);
 
+/*
+ * Start computing, on "nr_threads" background threads, the filters that
+ * get_or_compute_bloom_filter() is about to be asked to compute for the
+ * given commits: the first "max_new_filters" of them that do not have a
+ * filter yet. get_or_compute_bloom_filter() then picks up the result
+ * instead of running a tree diff itself, waiting for it if needed. The
+ * filters are the same as if they had been computed one by one.
+ *
+ * Object access must not happen outside of the object read lock while
+ * the threads are running; stop_bloom_filter_precompute() waits for them
+ * and drops any unused results. This is a no-op for fewer than two
+ * threads.
+ */
+void start_bloom_filter_precompute(struct repository *r,
+				   struct commit **commits, size_t nr,
+				   size_t max_new_filters,
+				   const struct bloom_filter_settings *settings,
+				   int nr_threads);
+void stop_bloom_filter_precompute(void);
+
 /*
  * Find the Bloom filter associated with the given commit "c".
  *
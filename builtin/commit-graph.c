@@ -11,6 +11,7 @@
 #include "replace-object.h"
 #include "strbuf.h"
 #include "tag.h"
+#include "thread-utils.h"
 #include "trace2.h"
 
 #define BUILTIN_COMMIT_GRAPH_VERIFY_USAGE \
@@ -19,7 +20,8 @@
 #define BUILTIN_COMMIT_GRAPH_WRITE_USAGE \
 	N_("git commit-graph write [--object-dir <dir>] [--append]\n" \
 	   "                       [--split[=<strategy>]] [--reachable | --stdin-packs | --stdin-commits]\n" \
-	   "                       [--changed-paths] [--[no-]max-new-filters <n>] [--[no-]progress]\n" \
+	   "                       [--changed-paths] [--[no-]max-new-filters <n>] [--threads=<n>]\n" \
+	   "                       [--[no-]progress]\n" \
 	   "                       <split-options>")
 
 static const char * const builtin_commit_graph_verify_usage[] = {
@@ -250,6 +252,8 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 		OPT_CALLBACK_F(0, "max-new-filters", &write_opts.max_new_filters,
 			NULL, N_("maximum number of changed-path Bloom filters to compute"),
 			0, write_option_max_new_filters),
+		OPT_INTEGER(0, "threads", &write_opts.threads,
+			N_("use <n> threads to compute changed-path Bloom filters")),
 		OPT_BOOL(0, "progress", &opts.progress,
 			 N_("force progress reporting")),
 		OPT_END(),
@@ -262,6 +266,7 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 	write_opts.max_commits = 0;
 	write_opts.expire_time = 0;
 	write_opts.max_new_filters = -1;
+	write_opts.threads = 0;
 
 	trace2_cmd_mode("write");
 
@@ -273,6 +278,14 @@ static int graph_write(int argc, const char **argv, const char *prefix,
 	if (argc)
 		usage_with_options(builtin_commit_graph_write_usage, options);
 
+	if (write_opts.threads < 0)
+		die(_("invalid number of threads specified (%d)"),
+		    write_opts.threads);
+	if (!HAVE_THREADS && write_opts.threads > 1) {
+		warning(_("no threads support, ignoring --threads"));
+		write_opts.threads = 1;
+	}
+
 	if (opts.reachable + opts.stdin_packs + opts.stdin_commits > 1)
 		die(_("use at most one of --reachable, --stdin-commits, or --stdin-packs"));
 	if (!opts.obj_dir)
@@ -1542,6 +1542,8 @@ struct repository *repo UNUSED)
 			    STATUS_FORMAT_LONG),
 		OPT_BOOL('z', "null", &s.null_termination,
 			 N_("terminate entries with NUL")),
+		OPT_BOOL(0, "stream", &s.stream,
+			 N_("print changed entries as soon as they are found")),
 		{
 			.type = OPTION_STRING,
 			.short_name = 'u',
@@ -1598,6 +1600,9 @@ struct repository *repo UNUSED)
 	    s.show_untracked_files == SHOW_NO_UNTRACKED_FILES)
 		die(_("Unsupported combination of ignored and untracked-files arguments"));
 
+	if (s.stream && status_format != STATUS_FORMAT_PORCELAIN_V2)
+		die(_("the option '%s' requires '%s'"), "--stream", "--porcelain=v2");
+
 	parse_pathspec(&s.pathspec, 0,
 		       PATHSPEC_PREFER_FULL,
 		       prefix, argv);
@@ -1631,14 +1636,14 @@ struct repository *repo UNUSED)
 			s.rename_score = parse_rename_score(&rename_score_arg);
 	}
 
+	if (s.relative_paths)
+		s.prefix = prefix;
+
 	wt_status_collect(&s);
 
 	if (0 <= fd)
 		repo_update_index_if_able(the_repository, &index_lock);
 
-	if (s.relative_paths)
-		s.prefix = prefix;
-
 	wt_status_print(&s);
 	wt_status_collect_free_buffers(&s);
 
@@ -27,6 +27,7 @@
 #include "worktree.h"
 #include "pack-revindex.h"
 #include "pack-bitmap.h"
+#include "thread-utils.h"
 
 #define REACHABLE 0x0001
 #define SEEN      0x0002
@@ -51,6 +52,7 @@ static int show_progress = -1;
 static int show_dangling = 1;
 static int name_objects;
 static int check_references = 1;
+static int nr_threads = 1;
 #define ERROR_OBJECT 01
 #define ERROR_REACHABLE 02
 #define ERROR_PACK 04
@@ -60,6 +62,26 @@ static int check_references = 1;
 #define ERROR_PACK_REV_INDEX 0100
 #define ERROR_BITMAP 0200
 
+static int fsck_config(const char *var, const char *value,
+		       const struct config_context *ctx, void *cb)
+{
+	if (!strcmp(var, "fsck.threads")) {
+		nr_threads = git_config_int(var, value, ctx->kvi);
+		if (nr_threads < 0)
+			die(_("invalid number of threads specified (%d)"),
+			    nr_threads);
+		if (!HAVE_THREADS && nr_threads != 1) {
+			warning(_("no threads support, ignoring %s"), var);
+			nr_threads = 1;
+		}
+		if (!nr_threads)
+			nr_threads = online_cpus();
+		return 0;
+	}
+
+	return git_fsck_config(var, value, ctx, cb);
+}
+
 static const char *describe_object(const struct object_id *oid)
 {
 	return fsck_describe_object(&fsck_walk_options, oid);
@@ -987,7 +1009,7 @@ int cmd_fsck(int argc,
 	if (name_objects)
 		fsck_enable_object_names(&fsck_walk_options);
 
-	git_config(git_fsck_config, &fsck_obj_options);
+	git_config(fsck_config, &fsck_obj_options);
 	prepare_repo_settings(the_repository);
 
 	if (check_references)
@@ -1023,7 +1045,7 @@ int cmd_fsck(int argc,
 				/* verify gives error messages itself */
 				if (verify_pack(the_repository,
 						p, fsck_obj_buffer,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
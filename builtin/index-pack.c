@@ -31,6 +31,7 @@
 #include "run-command.h"
 #include "setup.h"
 #include "strvec.h"
+#include "khash.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--[no-]rev-index] [--verify] [--strict[=<msg-id>=<severity>...]] [--fsck-objects[=<msg-id>=<severity>...]] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
@@ -185,6 +186,53 @@ static pthread_mutex_t deepest_delta_mutex;
 
 static pthread_key_t key;
 
+/*
+ * With pack.indexStreamDeltas, worker threads resolve deltas whose bases
+ * have already been received while parse_pack_objects() is still reading
+ * the rest of the pack.
+ *
+ * parse_pack_objects() hands every object it has parsed over to the
+ * workers in stream_flush(), once flush() has written it out to the pack
+ * file so that the workers can read it back. A delta whose base has been
+ * resolved is pushed to stream_queue; otherwise it waits on its base,
+ * either in the base's list of waiters (OFS_DELTA) or in stream_waiting
+ * (REF_DELTA). Resolving an object releases everything waiting on it.
+ *
+ * Deltas that are still unresolved when the whole pack has been received
+ * (i.e., those with a base outside of a thin pack) are left for
+ * fix_unresolved_deltas().
+ *
+ * Everything below is guarded by work_mutex, except for stream_parsed_nr,
+ * stream_flushed_nr, stream_ofs_nr and stream_ref_nr which are only used
+ * by the main thread.
+ */
+struct stream_object {
+	/* Cached content of the object, or NULL if not cached. */
+	void *data;
+	unsigned long size;
+	/* Object number of the delta base, or -1 if not known yet. */
+	int base;
+	/* Chain of deltas waiting on this object to be resolved. */
+	int first_waiter;
+	int next_waiter;
+	unsigned resolved:1;
+};
+
+static int stream_deltas;
+static int stream_active;
+static struct stream_object *stream_objects;
+static kh_oid_pos_t *stream_known;
+static kh_oid_pos_t *stream_waiting;
+static int *stream_queue;
+static int stream_queue_nr, stream_queue_alloc;
+static int *stream_cache;
+static int stream_cache_first, stream_cache_nr;
+static size_t stream_cache_used;
+static int stream_busy, stream_done;
+static pthread_cond_t stream_cond;
+static int stream_parsed_nr, stream_flushed_nr;
+static int stream_ofs_nr, stream_ref_nr;
+
 static inline void lock_mutex(pthread_mutex_t *mutex)
 {
 	if (threads_active)
@@ -296,6 +344,8 @@ static unsigned check_objects(void)
 }
 
 
+static void stream_flush(void);
+
 /* Discard current buffer used content. */
 static void flush(void)
 {
@@ -306,6 +356,8 @@ static void flush(void)
 		memmove(input_buffer, input_buffer + input_offset, input_len);
 		input_offset = 0;
 	}
+	if (stream_active && stream_flushed_nr < stream_parsed_nr)
+		stream_flush();
 }
 
 /*
@@ -1045,16 +1097,20 @@ static struct base_data *make_base(struct object_entry *obj,
 	return base;
 }
 
-static struct base_data *resolve_delta(struct object_entry *delta_obj,
-				       struct base_data *base)
+/*
+ * Apply delta_obj to the content of base_obj, then hash and check the
+ * result. delta_obj->real_type must already be set.
+ */
+static void *apply_delta(struct object_entry *delta_obj,
+			 struct object_entry *base_obj,
+			 const void *base_data, unsigned long base_size,
+			 unsigned long *result_size)
 {
 	void *delta_data, *result_data;
-	struct base_data *result;
-	unsigned long result_size;
 
 	if (show_stat) {
 		int i = delta_obj - objects;
-		int j = base->obj - objects;
+		int j = base_obj - objects;
 		obj_stat[i].delta_depth = obj_stat[j].delta_depth + 1;
 		deepest_delta_lock();
 		if (deepest_delta < obj_stat[i].delta_depth)
@@ -1063,25 +1119,36 @@ static struct base_data *resolve_delta(struct object_entry *delta_obj,
 		obj_stat[i].base_object_no = j;
 	}
 	delta_data = get_data_from_pack(delta_obj);
-	assert(base->data);
-	result_data = patch_delta(base->data, base->size,
-				  delta_data, delta_obj->size, &result_size);
+	assert(base_data);
+	result_data = patch_delta(base_data, base_size,
+				  delta_data, delta_obj->size, result_size);
 	free(delta_data);
 	if (!result_data)
 		bad_object(delta_obj->idx.offset, _("failed to apply delta"));
-	hash_object_file(the_hash_algo, result_data, result_size,
+	hash_object_file(the_hash_algo, result_data, *result_size,
 			 delta_obj->real_type, &delta_obj->idx.oid);
-	sha1_object(result_data, NULL, result_size, delta_obj->real_type,
+	sha1_object(result_data, NULL, *result_size, delta_obj->real_type,
 		    &delta_obj->idx.oid);
 
-	result = make_base(delta_obj, base);
-	result->data = result_data;
-	result->size = result_size;
-
 	counter_lock();
 	nr_resolved_deltas++;
 	counter_unlock();
 
+	return result_data;
+}
+
+static struct base_data *resolve_delta(struct object_entry *delta_obj,
+				       struct base_data *base)
+{
+	struct base_data *result;
+	unsigned long result_size;
+	void *result_data;
+
+	result_data = apply_delta(delta_obj, base->obj, base->data, base->size,
+				  &result_size);
+	result = make_base(delta_obj, base);
+	result->data = result_data;
+	result->size = result_size;
 	return result;
 }
 
@@ -1244,13 +1311,271 @@ static void *threaded_second_pass(void *data)
 	return NULL;
 }
 
+/* Hand delta "nr" over to the workers, now that its base is resolved. */
+static void stream_push(int nr, int base)
+{
+	stream_objects[nr].base = base;
+	ALLOC_GROW(stream_queue, stream_queue_nr + 1, stream_queue_alloc);
+	stream_queue[stream_queue_nr++] = nr;
+}
+
+/*
+ * Account for the data just stored in stream_objects[nr], and evict the
+ * oldest cached objects if we went over the delta base cache limit.
+ */
+static void stream_cache_add(int nr)
+{
+	stream_cache[stream_cache_nr++] = nr;
+	stream_cache_used += stream_objects[nr].size;
+	while (stream_cache_used > base_cache_limit &&
+	       stream_cache_first < stream_cache_nr) {
+		struct stream_object *s =
+			&stream_objects[stream_cache[stream_cache_first++]];
+		if (s->data) {
+			FREE_AND_NULL(s->data);
+			stream_cache_used -= s->size;
+		}
+	}
+}
+
+/* Record that object "nr" is resolved, and release its waiters. */
+static void stream_resolved(int nr)
+{
+	struct stream_object *s = &stream_objects[nr];
+	const struct object_id *oid = &objects[nr].idx.oid;
+	khiter_t pos;
+	int hashed, i;
+
+	s->resolved = 1;
+	pos = kh_put_oid_pos(stream_known, *oid, &hashed);
+	if (hashed)
+		kh_value(stream_known, pos) = nr;
+
+	for (i = s->first_waiter; i >= 0; i = stream_objects[i].next_waiter)
+		stream_push(i, nr);
+	s->first_waiter = -1;
+
+	pos = kh_get_oid_pos(stream_waiting, *oid);
+	if (pos != kh_end(stream_waiting)) {
+		for (i = kh_value(stream_waiting, pos); i >= 0;
+		     i = stream_objects[i].next_waiter)
+			stream_push(i, nr);
+		kh_del_oid_pos(stream_waiting, pos);
+	}
+}
+
+/* Find the object starting at "offset" among the first "nr" objects. */
+static int stream_find_offset(off_t offset, int nr)
+{
+	int first = 0, last = nr;
+
+	while (first < last) {
+		int next = first + (last - first) / 2;
+
+		if (objects[next].idx.offset == offset)
+			return next;
+		if (offset < objects[next].idx.offset)
+			last = next;
+		else
+			first = next + 1;
+	}
+	return -1;
+}
+
+/*
+ * Called by flush(), once all objects parsed so far have been written out
+ * to the pack file and can be read back by the workers.
+ */
+static void stream_flush(void)
+{
+	int i;
+
+	work_lock();
+	for (i = stream_flushed_nr; i < stream_parsed_nr; i++) {
+		struct stream_object *s = &stream_objects[i];
+		int base;
+
+		if (objects[i].type == OBJ_OFS_DELTA) {
+			base = stream_find_offset(ofs_deltas[stream_ofs_nr++].offset, i);
+			if (base < 0)
+				continue; /* reported as unresolved later */
+			if (stream_objects[base].resolved) {
+				stream_push(i, base);
+			} else {
+				s->next_waiter = stream_objects[base].first_waiter;
+				stream_objects[base].first_waiter = i;
+			}
+		} else if (objects[i].type == OBJ_REF_DELTA) {
+			const struct object_id *oid = &ref_deltas[stream_ref_nr++].oid;
+			khiter_t pos = kh_get_oid_pos(stream_known, *oid);
+			int hashed;
+
+			if (pos != kh_end(stream_known)) {
+				stream_push(i, kh_value(stream_known, pos));
+				continue;
+			}
+			pos = kh_put_oid_pos(stream_waiting, *oid, &hashed);
+			s->next_waiter = hashed ? -1 : kh_value(stream_waiting, pos);
+			kh_value(stream_waiting, pos) = i;
+		} else {
+			if (s->data)
+				stream_cache_add(i);
+			stream_resolved(i);
+		}
+	}
+	stream_flushed_nr = stream_parsed_nr;
+	if (stream_queue_nr)
+		pthread_cond_broadcast(&stream_cond);
+	work_unlock();
+}
+
+/*
+ * Return a copy of the content of resolved object "nr", reconstructing it
+ * from the closest cached (or non-delta) object in its delta chain.
+ */
+static void *stream_get_data(int nr, unsigned long *size)
+{
+	int *chain = NULL;
+	int chain_nr = 0, chain_alloc = 0;
+	void *data = NULL;
+
+	work_lock();
+	for (;;) {
+		struct stream_object *s = &stream_objects[nr];
+
+		if (s->data) {
+			data = xmemdupz(s->data, s->size);
+			*size = s->size;
+			break;
+		}
+		if (!is_delta_type(objects[nr].type))
+			break;
+		ALLOC_GROW(chain, chain_nr + 1, chain_alloc);
+		chain[chain_nr++] = nr;
+		nr = s->base;
+	}
+	work_unlock();
+
+	if (!data) {
+		data = get_data_from_pack(&objects[nr]);
+		*size = objects[nr].size;
+	}
+	while (chain_nr > 0) {
+		struct object_entry *obj = &objects[chain[--chain_nr]];
+		void *raw = get_data_from_pack(obj);
+		void *result = patch_delta(data, *size, raw, obj->size, size);
+
+		free(raw);
+		free(data);
+		if (!result)
+			bad_object(obj->idx.offset, _("failed to apply delta"));
+		data = result;
+	}
+	free(chain);
+	return data;
+}
+
+static void *stream_worker(void *data)
+{
+	set_thread_data(data);
+	for (;;) {
+		struct object_entry *obj, *base_obj;
+		void *base_data, *result;
+		unsigned long base_size, result_size;
+		int nr;
+
+		work_lock();
+		while (!stream_queue_nr && !(stream_done && !stream_busy))
+			pthread_cond_wait(&stream_cond, &work_mutex);
+		if (!stream_queue_nr) {
+			pthread_cond_broadcast(&stream_cond);
+			work_unlock();
+			break;
+		}
+		nr = stream_queue[--stream_queue_nr];
+		stream_busy++;
+		work_unlock();
+
+		obj = &objects[nr];
+		base_obj = &objects[stream_objects[nr].base];
+		obj->real_type = is_delta_type(base_obj->type) ?
+			base_obj->real_type : base_obj->type;
+		base_data = stream_get_data(base_obj - objects, &base_size);
+		result = apply_delta(obj, base_obj, base_data, base_size,
+				     &result_size);
+		free(base_data);
+
+		work_lock();
+		stream_objects[nr].data = result;
+		stream_objects[nr].size = result_size;
+		stream_cache_add(nr);
+		stream_resolved(nr);
+		stream_busy--;
+		if (stream_queue_nr || (stream_done && !stream_busy))
+			pthread_cond_broadcast(&stream_cond);
+		work_unlock();
+	}
+	return NULL;
+}
+
+static void stream_start(void)
+{
+	int i;
+
+	CALLOC_ARRAY(stream_objects, nr_objects);
+	for (i = 0; i < nr_objects; i++) {
+		stream_objects[i].base = -1;
+		stream_objects[i].first_waiter = -1;
+		stream_objects[i].next_waiter = -1;
+	}
+	ALLOC_ARRAY(stream_cache, nr_objects);
+	stream_known = kh_init_oid_pos();
+	stream_waiting = kh_init_oid_pos();
+
+	init_thread();
+	pthread_cond_init(&stream_cond, NULL);
+	set_thread_data(&nothread_data);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&thread_data[i].thread, NULL,
+					 stream_worker, thread_data + i);
+		if (ret)
+			die(_("unable to create thread: %s"),
+			    strerror(ret));
+	}
+	stream_active = 1;
+}
+
+static void stream_finish(void)
+{
+	int i;
+
+	work_lock();
+	stream_done = 1;
+	pthread_cond_broadcast(&stream_cond);
+	work_unlock();
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(thread_data[i].thread, NULL);
+	pthread_cond_destroy(&stream_cond);
+	cleanup_thread();
+	stream_active = 0;
+
+	for (i = 0; i < nr_objects; i++)
+		free(stream_objects[i].data);
+	FREE_AND_NULL(stream_objects);
+	FREE_AND_NULL(stream_queue);
+	FREE_AND_NULL(stream_cache);
+	kh_destroy_oid_pos(stream_known);
+	kh_destroy_oid_pos(stream_waiting);
+}
+
 /*
  * First pass:
  * - find locations of all objects;
  * - calculate SHA1 of all non-delta objects;
  * - remember base (SHA1 or offset) for all deltas.
  */
-static void parse_pack_objects(unsigned char *hash)
+static void parse_pack_objects(unsigned char *hash,
+			       struct pack_idx_option *opts)
 {
 	int i, nr_delays = 0;
 	struct ofs_delta_entry *ofs_delta = ofs_deltas;
@@ -1264,6 +1589,10 @@ static void parse_pack_objects(unsigned char *hash)
 				progress_title ? progress_title :
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+	if (stream_deltas && HAVE_THREADS) {
+		base_cache_limit = opts->delta_base_cache_limit * nr_threads;
+		stream_start();
+	}
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &ofs_delta->offset,
@@ -1286,6 +1615,14 @@ static void parse_pack_objects(unsigned char *hash)
 		} else
 			sha1_object(data, NULL, obj->size, obj->type,
 				    &obj->idx.oid);
+		if (stream_active) {
+			if (!is_delta_type(obj->type)) {
+				stream_objects[i].data = data;
+				stream_objects[i].size = obj->size;
+				data = NULL;
+			}
+			stream_parsed_nr = i + 1;
+		}
 		free(data);
 		display_progress(progress, i+1);
 	}
@@ -1308,6 +1645,9 @@ static void parse_pack_objects(unsigned char *hash)
 			lseek(input_fd, 0, SEEK_CUR) - input_len != st.st_size)
 		die(_("pack has junk at the end"));
 
+	if (stream_active)
+		stream_finish();
+
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		if (obj->real_type != OBJ_BAD)
@@ -1345,6 +1685,16 @@ static void resolve_deltas(struct pack_idx_option *opts)
 					  _("Resolving deltas"),
 					  nr_ref_deltas + nr_ofs_deltas);
 
+	if (stream_deltas && HAVE_THREADS) {
+		/*
+		 * Everything that could be resolved from within the pack
+		 * already was while receiving it.
+		 */
+		nr_dispatched = nr_objects;
+		display_progress(progress, nr_resolved_deltas);
+		return;
+	}
+
 	nr_dispatched = 0;
 	base_cache_limit = opts->delta_base_cache_limit * nr_threads;
 	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
@@ -1391,6 +1741,9 @@ static void conclude_pack(int fix_thin_pack, const char *curr_pack, unsigned cha
 		memset(objects + nr_objects + 1, 0,
 		       nr_unresolved * sizeof(*objects));
 		f = hashfd(the_repository->hash_algo, output_fd, curr_pack);
+		prepare_repo_settings(the_repository);
+		if (the_repository->settings.pipelined_hashing)
+			hashfile_enable_pipeline(f);
 		fix_unresolved_deltas(f);
 		strbuf_addf(&msg, Q_("completed with %d local object",
 				     "completed with %d local objects",
@@ -1688,6 +2041,10 @@ static int git_index_pack_config(const char *k, const char *v,
 		}
 		return 0;
 	}
+	if (!strcmp(k, "pack.indexstreamdeltas")) {
+		stream_deltas = git_config_bool(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.writereverseindex")) {
 		if (git_config_bool(k, v))
 			opts->flags |= WRITE_REV;
@@ -2081,7 +2438,7 @@ int cmd_index_pack(int argc,
 	if (show_stat)
 		CALLOC_ARRAY(obj_stat, st_add(nr_objects, 1));
 	CALLOC_ARRAY(ofs_deltas, nr_objects);
-	parse_pack_objects(pack_hash);
+	parse_pack_objects(pack_hash, &opts);
 	if (report_end_of_input)
 		write_in_full(2, "\0", 1);
 	resolve_deltas(&opts);
@@ -11,6 +11,7 @@
 #include "commit.h"
 #include "tag.h"
 #include "delta.h"
+#include "hashmap.h"
 #include "pack.h"
 #include "pack-revindex.h"
 #include "csum-file.h"
@@ -40,6 +41,7 @@
 #include "shallow.h"
 #include "promisor-remote.h"
 #include "pack-mtimes.h"
+#include "pack-delta-hints.h"
 #include "parse-options.h"
 #include "blob.h"
 #include "tree.h"
@@ -195,7 +197,9 @@ static const char *const pack_usage[] = {
 	   "                 [--cruft] [--cruft-expiration=<time>]\n"
 	   "                 [--stdout [--filter=<filter-spec>] | <base-name>]\n"
 	   "                 [--shallow] [--keep-true-parents] [--[no-]sparse]\n"
-	   "                 [--name-hash-version=<n>] [--path-walk] < <object-list>"),
+	   "                 [--name-hash-version=<n>] [--path-walk] [--delta-hints]\n"
+	   "                 [--delta-sketches]\n"
+	   "                 < <object-list>"),
 	NULL
 };
 
@@ -230,6 +234,8 @@ static int pack_to_stdout;
 static int sparse;
 static int thin;
 static int path_walk = -1;
+static int delta_sketches;
+static int delta_hints;
 static int num_preferred_base;
 static struct progress *progress_state;
 
@@ -1311,6 +1317,32 @@ static const char no_split_warning[] = N_(
 "disabling bitmap writing, packs are split due to pack.packSizeLimit"
 );
 
+/*
+ * Record the delta base of each written object, and the base it had
+ * before that one, for find_deltas_from_hints() in a later repack.
+ */
+static void write_pack_delta_hints(const char *filename)
+{
+	struct delta_hint *hints;
+
+	CALLOC_ARRAY(hints, nr_written);
+	for (uint32_t i = 0; i < nr_written; i++) {
+		struct object_entry *e = (struct object_entry *)written_list[i];
+		struct object_entry *base = DELTA(e), *alt;
+
+		if (!base || e->ext_base)
+			continue;
+		hints[i].base[0] = &base->idx.oid;
+
+		alt = oe_delta_alt(&to_pack, e);
+		if (alt && alt != base)
+			hints[i].base[1] = &alt->idx.oid;
+	}
+
+	write_delta_hints_file(the_repository, filename, hints, nr_written);
+	free(hints);
+}
+
 static void write_pack_file(void)
 {
 	uint32_t i = 0, j;
@@ -1335,6 +1367,8 @@ static void write_pack_file(void)
 					      "<stdout>", progress_state);
 		else
 			f = create_tmp_packfile(the_repository, &pack_tmp_name);
+		if (the_repository->settings.pipelined_hashing)
+			hashfile_enable_pipeline(f);
 
 		offset = write_pack_header(f, nr_remaining);
 
@@ -1434,6 +1468,14 @@ static void write_pack_file(void)
 					    &pack_idx_opts, hash,
 					    &idx_tmp_name);
 
+			if (delta_hints) {
+				size_t tmpname_len = tmpname.len;
+
+				strbuf_addstr(&tmpname, "dhints");
+				write_pack_delta_hints(tmpname.buf);
+				strbuf_setlen(&tmpname, tmpname_len);
+			}
+
 			if (write_bitmap_index) {
 				size_t tmpname_len = tmpname.len;
 
@@ -2866,6 +2908,8 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 		free(delta_buf);
 	}
 
+	if (DELTA(trg_entry))
+		oe_set_delta_alt(&to_pack, trg_entry, DELTA(trg_entry));
 	SET_DELTA(trg_entry, src_entry);
 	SET_DELTA_SIZE(trg_entry, delta_size);
 	trg->depth = src->depth + 1;
@@ -3540,6 +3584,433 @@ static void ll_find_deltas_by_region(struct object_entry *list,
 	stop_progress(&progress_state);
 }
 
+/*
+ * Returns the length of the delta chain "base" currently sits at the
+ * end of, or -1 if that chain goes through "entry".
+ */
+static int delta_hint_base_depth(struct object_entry *base,
+				 struct object_entry *entry)
+{
+	int n = 0;
+
+	while (base != entry) {
+		if (!DELTA(base))
+			return n;
+		base = DELTA(base);
+		n++;
+	}
+	return -1;
+}
+
+/*
+ * Seed the delta search with the bases recorded in the .dhints files of
+ * the packs we are packing from. Each object is tried against its hinted
+ * bases first; when one of them still gives a delta, the object is left
+ * out of the window search, like for the path-walk regions.
+ *
+ * The hinted deltas are linked as children of their bases, so that
+ * check_delta_limit() keeps later deltas from making their chains too
+ * deep.
+ */
+static void find_deltas_from_hints(void)
+{
+	struct object_entry **bases;
+	struct packed_git *p;
+	unsigned nr_hinted = 0, processed = 0;
+
+	CALLOC_ARRAY(bases, st_mult(to_pack.nr_objects, DELTA_HINTS_MAX));
+
+	for (p = get_all_packs(the_repository); p; p = p->next) {
+		struct pack_delta_hints *hints = load_pack_delta_hints(p);
+
+		if (!hints)
+			continue;
+
+		for (uint32_t pos = 0; pos < p->num_objects; pos++) {
+			struct object_id oid, hint_oids[DELTA_HINTS_MAX];
+			struct object_entry *entry, **slot;
+			uint32_t nr, k = 0;
+
+			nr = nth_packed_delta_hints(hints, pos, hint_oids,
+						    DELTA_HINTS_MAX);
+			if (!nr || nth_packed_object_id(&oid, p, pos) < 0)
+				continue;
+
+			entry = packlist_find(&to_pack, &oid);
+			if (!entry || entry->preferred_base ||
+			    !should_attempt_deltas(entry))
+				continue;
+			slot = bases + st_mult(entry - to_pack.objects,
+					       DELTA_HINTS_MAX);
+			if (slot[0])
+				continue; /* already hinted by another pack */
+
+			for (uint32_t j = 0; j < nr; j++) {
+				struct object_entry *base;
+
+				base = packlist_find(&to_pack, &hint_oids[j]);
+				if (base && base != entry)
+					slot[k++] = base;
+			}
+			if (k)
+				nr_hinted++;
+		}
+
+		free_pack_delta_hints(hints);
+	}
+
+	if (!nr_hinted) {
+		free(bases);
+		return;
+	}
+
+	if (progress)
+		progress_state = start_progress(the_repository,
+						_("Compressing objects from hints"),
+						nr_hinted);
+	init_threaded_search();
+
+	for (uint32_t i = 0; i < to_pack.nr_objects; i++) {
+		struct object_entry **slot = bases + st_mult(i, DELTA_HINTS_MAX);
+		struct unpacked trg = { .entry = to_pack.objects + i };
+		unsigned long mem_usage = 0;
+		int max_depth = depth;
+
+		if (!slot[0])
+			continue;
+
+		if (DELTA_CHILD(trg.entry))
+			max_depth -= check_delta_limit(trg.entry, 0);
+
+		for (int j = 0; max_depth > 0 && j < DELTA_HINTS_MAX && slot[j]; j++) {
+			struct unpacked src = { .entry = slot[j] };
+			int src_depth = delta_hint_base_depth(src.entry,
+							      trg.entry);
+
+			if (src_depth < 0)
+				continue;
+			src.depth = src_depth;
+			try_delta(&trg, &src, max_depth, &mem_usage);
+			free_unpacked(&src);
+		}
+
+		if (DELTA(trg.entry)) {
+			struct object_entry *base = DELTA(trg.entry);
+
+			SET_DELTA_SIBLING(trg.entry, DELTA_CHILD(base));
+			SET_DELTA_CHILD(base, trg.entry);
+		}
+		free_unpacked(&trg);
+
+		display_progress(progress_state, ++processed);
+	}
+
+	cleanup_threaded_search();
+	stop_progress(&progress_state);
+	free(bases);
+}
+
+/*
+ * Delta candidate selection by content similarity (--delta-sketches).
+ *
+ * The window of find_deltas() only sees objects whose names hash close to
+ * each other, so it misses good bases for renamed or copied content.
+ * Before the window search, compute a MinHash sketch of each object with
+ * create_delta_sketch() and cut it into bands; objects with an equal band
+ * are likely to share much of their content. For each band in turn, the
+ * objects sharing that band are searched for deltas among themselves.
+ *
+ * Like for the path-walk regions, objects that get a delta this way are
+ * left out of the following bands and of the final window search.
+ */
+#define DELTA_SKETCH_BANDS 4
+#define DELTA_SKETCH_ROWS 4
+
+struct sketched_object {
+	struct object_entry *entry;
+	uint32_t band[DELTA_SKETCH_BANDS];
+	unsigned valid_bands;
+};
+
+struct sketch_params {
+	pthread_t thread;
+	struct sketched_object *objects;
+	struct object_entry **list;
+	struct packing_region *groups;
+	size_t nr;
+	unsigned *processed;
+};
+
+static void compute_sketch(struct sketched_object *obj)
+{
+	uint32_t sketch[DELTA_SKETCH_BANDS * DELTA_SKETCH_ROWS];
+	enum object_type type;
+	unsigned long size;
+	void *data;
+
+	packing_data_lock(&to_pack);
+	data = odb_read_object(the_repository->objects, &obj->entry->idx.oid,
+			       &type, &size);
+	packing_data_unlock(&to_pack);
+	if (!data)
+		return; /* try_delta() complains later if needed */
+
+	create_delta_sketch(data, size, sketch, ARRAY_SIZE(sketch));
+	free(data);
+
+	for (int b = 0; b < DELTA_SKETCH_BANDS; b++) {
+		const uint32_t *rows = sketch + b * DELTA_SKETCH_ROWS;
+		int r;
+
+		/* Too small to fill this band; it would match anything. */
+		for (r = 0; r < DELTA_SKETCH_ROWS; r++)
+			if (rows[r] == UINT32_MAX)
+				break;
+		if (r < DELTA_SKETCH_ROWS)
+			continue;
+
+		obj->band[b] = memhash(rows, sizeof(*rows) * DELTA_SKETCH_ROWS);
+		obj->valid_bands |= 1u << b;
+	}
+}
+
+static void *threaded_compute_sketches(void *arg)
+{
+	struct sketch_params *me = arg;
+
+	for (size_t i = 0; i < me->nr; i++) {
+		compute_sketch(&me->objects[i]);
+		progress_lock();
+		(*me->processed)++;
+		display_progress(progress_state, *me->processed);
+		progress_unlock();
+	}
+	return NULL;
+}
+
+static void compute_sketches(struct sketched_object *objects, size_t nr)
+{
+	struct sketch_params *p;
+	unsigned processed = 0;
+	size_t start = 0;
+	int i, ret;
+
+	if (progress)
+		progress_state = start_progress(the_repository,
+						_("Computing object sketches"),
+						nr);
+
+	CALLOC_ARRAY(p, delta_search_threads);
+	for (i = 0; i < delta_search_threads; i++) {
+		p[i].objects = objects + start;
+		p[i].nr = (nr - start) / (delta_search_threads - i);
+		p[i].processed = &processed;
+		start += p[i].nr;
+	}
+
+	if (delta_search_threads <= 1) {
+		threaded_compute_sketches(p);
+	} else {
+		for (i = 0; i < delta_search_threads; i++) {
+			ret = pthread_create(&p[i].thread, NULL,
+					     threaded_compute_sketches, &p[i]);
+			if (ret)
+				die(_("unable to create thread: %s"),
+				    strerror(ret));
+		}
+		for (i = 0; i < delta_search_threads; i++)
+			pthread_join(p[i].thread, NULL);
+	}
+	free(p);
+
+	stop_progress(&progress_state);
+}
+
+static void *threaded_find_deltas_in_groups(void *arg)
+{
+	struct sketch_params *me = arg;
+
+	for (size_t i = 0; i < me->nr; i++) {
+		struct object_entry **list = me->list + me->groups[i].start;
+		unsigned list_size = me->groups[i].nr;
+
+		QSORT(list, list_size, type_size_sort);
+		find_deltas(list, &list_size, window + 1, depth, me->processed);
+	}
+	return NULL;
+}
+
+/*
+ * Search each group of "list" for deltas. The groups are handed out to
+ * the threads in contiguous runs holding about the same number of objects.
+ */
+static void find_deltas_in_groups(struct object_entry **list,
+				  struct packing_region *groups, size_t nr,
+				  unsigned *processed)
+{
+	struct sketch_params *p;
+	size_t start = 0, remaining;
+	int i, ret;
+
+	if (!nr)
+		return;
+	remaining = groups[nr - 1].start + groups[nr - 1].nr;
+
+	CALLOC_ARRAY(p, delta_search_threads);
+	for (i = 0; i < delta_search_threads; i++) {
+		size_t goal = remaining / (delta_search_threads - i);
+		size_t end = start, size = 0;
+
+		while (end < nr &&
+		       (size < goal || i == delta_search_threads - 1))
+			size += groups[end++].nr;
+		remaining -= size;
+
+		p[i].list = list;
+		p[i].groups = groups + start;
+		p[i].nr = end - start;
+		p[i].processed = processed;
+		start = end;
+	}
+
+	if (delta_search_threads <= 1) {
+		threaded_find_deltas_in_groups(p);
+	} else {
+		for (i = 0; i < delta_search_threads; i++) {
+			ret = pthread_create(&p[i].thread, NULL,
+					     threaded_find_deltas_in_groups,
+					     &p[i]);
+			if (ret)
+				die(_("unable to create thread: %s"),
+				    strerror(ret));
+		}
+		for (i = 0; i < delta_search_threads; i++)
+			pthread_join(p[i].thread, NULL);
+	}
+	free(p);
+}
+
+static int sketched_object_cmp(const void *va, const void *vb, void *ctx)
+{
+	const struct sketched_object *a = va, *b = vb;
+	unsigned bit = 1u << *(int *)ctx;
+	int a_valid = !!(a->valid_bands & bit), b_valid = !!(b->valid_bands & bit);
+	uint32_t a_band = a->band[*(int *)ctx], b_band = b->band[*(int *)ctx];
+
+	if (a_valid != b_valid)
+		return a_valid - b_valid;
+	if (oe_type(a->entry) != oe_type(b->entry))
+		return oe_type(a->entry) < oe_type(b->entry) ? -1 : 1;
+	if (a_band != b_band)
+		return a_band < b_band ? -1 : 1;
+	return a->entry < b->entry ? -1 : (a->entry > b->entry);
+}
+
+static int same_band(const struct sketched_object *a,
+		     const struct sketched_object *b, int band)
+{
+	unsigned bit = 1u << band;
+
+	return (a->valid_bands & bit) && (b->valid_bands & bit) &&
+	       oe_type(a->entry) == oe_type(b->entry) &&
+	       a->band[band] == b->band[band];
+}
+
+static void find_deltas_by_sketch(void)
+{
+	struct sketched_object *objects;
+	struct object_entry **list;
+	struct packing_region *groups = NULL;
+	size_t nr = 0, groups_alloc = 0;
+	unsigned processed = 0;
+
+	ALLOC_ARRAY(objects, to_pack.nr_objects);
+	for (uint32_t i = 0; i < to_pack.nr_objects; i++) {
+		struct object_entry *entry = to_pack.objects + i;
+
+		if (!should_attempt_deltas(entry))
+			continue;
+		memset(&objects[nr], 0, sizeof(objects[nr]));
+		objects[nr++].entry = entry;
+	}
+	if (nr < 2) {
+		free(objects);
+		return;
+	}
+
+	trace2_region_enter("pack-objects", "delta-sketches", the_repository);
+	init_threaded_search();
+	compute_sketches(objects, nr);
+
+	if (progress)
+		progress_state = start_progress(the_repository,
+						_("Compressing objects by similarity"),
+						0);
+
+	ALLOC_ARRAY(list, nr);
+	for (int b = 0; b < DELTA_SKETCH_BANDS; b++) {
+		size_t list_nr = 0, groups_nr = 0, i, j;
+
+		QSORT_S(objects, nr, sketched_object_cmp, &b);
+
+		for (i = 0; i < nr; i = j) {
+			size_t start = list_nr;
+			int targets = 0;
+
+			for (j = i + 1; j < nr; j++)
+				if (!same_band(&objects[i], &objects[j], b))
+					break;
+			if (j - i < 2)
+				continue;
+
+			for (size_t k = i; k < j; k++) {
+				struct object_entry *entry = objects[k].entry;
+
+				/* Already got a delta from an earlier band. */
+				if (DELTA(entry))
+					continue;
+				list[list_nr++] = entry;
+				if (!entry->preferred_base)
+					targets++;
+			}
+			if (!targets || list_nr - start < 2) {
+				list_nr = start;
+				continue;
+			}
+
+			ALLOC_GROW(groups, groups_nr + 1, groups_alloc);
+			groups[groups_nr].start = start;
+			groups[groups_nr].nr = list_nr - start;
+			groups_nr++;
+		}
+
+		find_deltas_in_groups(list, groups, groups_nr, &processed);
+
+		/*
+		 * Link the new deltas as children of their bases, so that
+		 * check_delta_limit() sees the chains built so far in the
+		 * following bands and in the window search.
+		 */
+		for (i = 0; i < list_nr; i++) {
+			struct object_entry *base = DELTA(list[i]);
+
+			if (!base)
+				continue;
+			SET_DELTA_SIBLING(list[i], DELTA_CHILD(base));
+			SET_DELTA_CHILD(base, list[i]);
+		}
+	}
+
+	display_progress(progress_state, processed);
+	stop_progress(&progress_state);
+	cleanup_threaded_search();
+	trace2_region_leave("pack-objects", "delta-sketches", the_repository);
+
+	free(groups);
+	free(list);
+	free(objects);
+}
+
 static void prepare_pack(int window, int depth)
 {
 	struct object_entry **delta_list;
@@ -3564,10 +4035,18 @@ static void prepare_pack(int window, int depth)
 	if (!to_pack.nr_objects || !window || !depth)
 		return;
 
+	if (delta_hints && !pack_to_stdout) {
+		CALLOC_ARRAY(to_pack.delta_alt, to_pack.nr_alloc);
+		find_deltas_from_hints();
+	}
+
 	if (path_walk)
 		ll_find_deltas_by_region(to_pack.objects, to_pack.regions,
 					 0, to_pack.nr_regions);
 
+	if (delta_sketches)
+		find_deltas_by_sketch();
+
 	ALLOC_ARRAY(delta_list, to_pack.nr_objects);
 	nr_deltas = n = 0;
 
@@ -3636,6 +4115,14 @@ static int git_pack_config(const char *k, const char *v,
 			write_bitmap_options &= ~BITMAP_OPT_LOOKUP_TABLE;
 	}
 
+	if (!strcmp(k, "pack.deltahints")) {
+		delta_hints = git_config_bool(k, v);
+		return 0;
+	}
+	if (!strcmp(k, "pack.deltasketches")) {
+		delta_sketches = git_config_bool(k, v);
+		return 0;
+	}
 	if (!strcmp(k, "pack.usebitmaps")) {
 		use_bitmap_index_default = git_config_bool(k, v);
 		return 0;
@@ -4620,6 +5107,7 @@ static void get_object_list_path_walk(struct rev_info *revs)
 	 */
 	info.prune_all_uninteresting = sparse;
 	info.edge_aggressive = shallow;
+	info.threads = delta_search_threads;
 
 	trace2_region_enter("pack-objects", "path-walk", revs->repo);
 	result = walk_objects_by_path(&info);
@@ -4877,6 +5365,10 @@ int cmd_pack_objects(int argc,
 			     N_("limit pack window by memory in addition to object limit")),
 		OPT_INTEGER(0, "depth", &depth,
 			    N_("maximum length of delta chain allowed in the resulting pack")),
+		OPT_BOOL(0, "delta-hints", &delta_hints,
+			 N_("seed the delta search from, and write, .dhints files")),
+		OPT_BOOL(0, "delta-sketches", &delta_sketches,
+			 N_("also look for delta bases among objects with similar content")),
 		OPT_BOOL(0, "reuse-delta", &reuse_delta,
 			 N_("reuse existing deltas")),
 		OPT_BOOL(0, "reuse-object", &reuse_object,
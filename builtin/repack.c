@@ -362,6 +362,7 @@ static struct {
 	{".mtimes", 1},
 	{".bitmap", 1},
 	{".promisor", 1},
+	{".dhints", 1},
 	{".idx"},
 };
 
@@ -24,6 +24,8 @@
 #include "commit-slab.h"
 #include "shallow.h"
 #include "json-writer.h"
+#include "prio-queue.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "chunk-format.h"
@@ -52,8 +54,10 @@ void git_test_write_commit_graph_or_die(void)
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_REACH_LABELS 0x524c4142 /* "RLAB" */
 
 #define GRAPH_DATA_WIDTH (the_hash_algo->rawsz + 16)
+#define GRAPH_REACH_LABEL_WIDTH 8
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -139,6 +143,54 @@ static timestamp_t commit_graph_generation_from_graph(const struct commit *c)
 	return data->generation;
 }
 
+static const unsigned char *reach_label_at(struct commit_graph *g,
+					   uint32_t pos)
+{
+	if (pos == COMMIT_NOT_FROM_GRAPH)
+		return NULL;
+	while (g && pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (!g || !g->chunk_reach_labels)
+		return NULL;
+	return g->chunk_reach_labels +
+		st_mult(pos - g->num_commits_in_base, GRAPH_REACH_LABEL_WIDTH);
+}
+
+/*
+ * Each commit carries two labels, one from each of two different
+ * topological orders, so that a commit always has strictly larger
+ * labels than any of its ancestors. If either label of "to" is not
+ * smaller than that of "from", "to" cannot be an ancestor of "from".
+ * Labels of a layer in a split commit-graph chain are offset by the
+ * number of commits in its base, so that commits in a layer always
+ * compare larger than those in the layers below it.
+ */
+static int graph_cannot_reach(struct commit_graph *g,
+			      const struct commit *from,
+			      const struct commit *to)
+{
+	const unsigned char *from_label, *to_label;
+
+	if (from == to)
+		return 0;
+	from_label = reach_label_at(g, commit_graph_position(from));
+	if (!from_label)
+		return 0;
+	to_label = reach_label_at(g, commit_graph_position(to));
+	if (!to_label)
+		return 0;
+
+	return get_be32(to_label) >= get_be32(from_label) ||
+	       get_be32(to_label + 4) >= get_be32(from_label + 4);
+}
+
+int commit_graph_cannot_reach(struct repository *r,
+			      const struct commit *from,
+			      const struct commit *to)
+{
+	return graph_cannot_reach(r->objects->commit_graph, from, to);
+}
+
 static struct commit_graph_data *commit_graph_data_at(const struct commit *c)
 {
 	unsigned int i, nth_slab;
@@ -330,6 +382,18 @@ static int graph_read_generation_data(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_reach_labels(const unsigned char *chunk_start,
+				   size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / GRAPH_REACH_LABEL_WIDTH != g->num_commits) {
+		warning(_("commit-graph reachability label chunk is wrong size"));
+		return -1;
+	}
+	g->chunk_reach_labels = chunk_start;
+	return 0;
+}
+
 static int graph_read_bloom_index(const unsigned char *chunk_start,
 				  size_t chunk_size, void *data)
 {
@@ -444,6 +508,8 @@ struct commit_graph *parse_commit_graph(struct repo_settings *s,
 		   &graph->chunk_extra_edges_size);
 	pair_chunk(cf, GRAPH_CHUNKID_BASE, &graph->chunk_base_graphs,
 		   &graph->chunk_base_graphs_size);
+	read_chunk(cf, GRAPH_CHUNKID_REACH_LABELS, graph_read_reach_labels,
+		   graph);
 
 	if (s->commit_graph_generation_version >= 2) {
 		read_chunk(cf, GRAPH_CHUNKID_GENERATION_DATA,
@@ -1163,12 +1229,14 @@ struct write_commit_graph_context {
 		 changed_paths:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
-		 trust_generation_numbers:1;
+		 trust_generation_numbers:1,
+		 write_reach_labels:1;
 
 	struct topo_level_slab *topo_levels;
 	const struct commit_graph_opts *opts;
 	size_t total_bloom_filter_data_size;
 	const struct bloom_filter_settings *bloom_settings;
+	uint32_t *reach_labels;
 
 	int count_bloom_filter_computed;
 	int count_bloom_filter_not_computed;
@@ -1370,6 +1438,21 @@ static int write_graph_chunk_generation_data_overflow(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_reach_labels(struct hashfile *f,
+					  void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	int i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		hashwrite_be32(f, ctx->reach_labels[2 * i]);
+		hashwrite_be32(f, ctx->reach_labels[2 * i + 1]);
+	}
+
+	return 0;
+}
+
 static int write_graph_chunk_extra_edges(struct hashfile *f,
 					 void *data)
 {
@@ -1748,6 +1831,123 @@ static void compute_generation_numbers(struct write_commit_graph_context *ctx)
 	stop_progress(&ctx->progress);
 }
 
+static int compare_reach_labels_desc(const void *a, const void *b,
+				     void *data UNUSED)
+{
+	uint32_t la = *(const uint32_t *)a, lb = *(const uint32_t *)b;
+	return la < lb ? 1 : la > lb ? -1 : 0;
+}
+
+/*
+ * Walk the commits of the new layer in topological order (parents
+ * before children), numbering them as they are visited. With a NULL
+ * comparison function the queue is a stack and the walk goes deep
+ * first; otherwise it prefers the ready commit with the largest first
+ * label, which makes the second order disagree with the first one as
+ * much as possible.
+ */
+static void number_commits_topologically(struct write_commit_graph_context *ctx,
+					 const uint32_t *child_start,
+					 const uint32_t *children,
+					 const uint32_t *nr_parents,
+					 prio_queue_compare_fn compare,
+					 int label)
+{
+	struct prio_queue queue = { .compare = compare };
+	uint32_t *pending;
+	uint32_t *entry;
+	uint32_t i, next = ctx->new_num_commits_in_base;
+
+	ALLOC_ARRAY(pending, ctx->commits.nr);
+	COPY_ARRAY(pending, nr_parents, ctx->commits.nr);
+
+	for (i = 0; i < ctx->commits.nr; i++)
+		if (!pending[i])
+			prio_queue_put(&queue, &ctx->reach_labels[2 * i]);
+
+	while ((entry = prio_queue_get(&queue))) {
+		uint32_t pos = (entry - ctx->reach_labels) / 2;
+
+		display_progress(ctx->progress, ++ctx->progress_cnt);
+		ctx->reach_labels[2 * pos + label] = next++;
+
+		for (i = child_start[pos]; i < child_start[pos + 1]; i++)
+			if (!--pending[children[i]])
+				prio_queue_put(&queue,
+					       &ctx->reach_labels[2 * children[i]]);
+	}
+
+	clear_prio_queue(&queue);
+	free(pending);
+}
+
+/*
+ * Assign every commit in the new layer a pair of labels such that an
+ * ancestor always has both labels strictly smaller than its
+ * descendants (see graph_cannot_reach()). Only edges within the layer
+ * matter, as no path can leave a layer and come back to it.
+ */
+static void compute_reachability_labels(struct write_commit_graph_context *ctx)
+{
+	uint32_t *nr_parents, *child_start, *children, *cursor;
+	uint32_t *edges = NULL;
+	size_t nr_edges = 0, alloc_edges = 0;
+	uint32_t i;
+
+	if (ctx->report_progress)
+		ctx->progress = start_delayed_progress(
+					ctx->r,
+					_("Computing commit reachability labels"),
+					st_mult(2, ctx->commits.nr));
+
+	CALLOC_ARRAY(nr_parents, ctx->commits.nr);
+	CALLOC_ARRAY(child_start, st_add(ctx->commits.nr, 1));
+	CALLOC_ARRAY(ctx->reach_labels, st_mult(2, ctx->commits.nr));
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit_list *parent;
+
+		for (parent = ctx->commits.list[i]->parents; parent;
+		     parent = parent->next) {
+			int pos = oid_pos(&parent->item->object.oid,
+					  ctx->commits.list,
+					  ctx->commits.nr,
+					  commit_to_oid);
+			if (pos < 0)
+				continue;
+
+			ALLOC_GROW(edges, st_mult(2, nr_edges + 1), alloc_edges);
+			edges[2 * nr_edges] = pos;
+			edges[2 * nr_edges + 1] = i;
+			nr_edges++;
+
+			nr_parents[i]++;
+			child_start[pos + 1]++;
+		}
+	}
+
+	for (i = 0; i < ctx->commits.nr; i++)
+		child_start[i + 1] += child_start[i];
+
+	ALLOC_ARRAY(children, nr_edges);
+	ALLOC_ARRAY(cursor, ctx->commits.nr);
+	COPY_ARRAY(cursor, child_start, ctx->commits.nr);
+	for (i = 0; i < nr_edges; i++)
+		children[cursor[edges[2 * i]]++] = edges[2 * i + 1];
+
+	number_commits_topologically(ctx, child_start, children, nr_parents,
+				     NULL, 0);
+	number_commits_topologically(ctx, child_start, children, nr_parents,
+				     compare_reach_labels_desc, 1);
+
+	stop_progress(&ctx->progress);
+	free(nr_parents);
+	free(child_start);
+	free(children);
+	free(cursor);
+	free(edges);
+}
+
 static void set_generation_in_graph_data(struct commit *c, timestamp_t t,
 					 void *data UNUSED)
 {
@@ -1797,6 +1997,7 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	struct progress *progress = NULL;
 	struct commit **sorted_commits;
 	int max_new_filters;
+	int nr_threads;
 
 	init_bloom_filters();
 
@@ -1816,6 +2017,13 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	nr_threads = ctx->opts ? ctx->opts->threads : 0;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	start_bloom_filter_precompute(ctx->r, sorted_commits, ctx->commits.nr,
+				      max_new_filters, ctx->bloom_settings,
+				      nr_threads);
+
 	for (i = 0; i < ctx->commits.nr; i++) {
 		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
@@ -1840,6 +2048,8 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 		display_progress(progress, i + 1);
 	}
 
+	stop_bloom_filter_precompute();
+
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
 
@@ -2117,6 +2327,10 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 		add_chunk(cf, GRAPH_CHUNKID_GENERATION_DATA_OVERFLOW,
 			  st_mult(sizeof(timestamp_t), ctx->num_generation_data_overflows),
 			  write_graph_chunk_generation_data_overflow);
+	if (ctx->write_reach_labels)
+		add_chunk(cf, GRAPH_CHUNKID_REACH_LABELS,
+			  st_mult(GRAPH_REACH_LABEL_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_reach_labels);
 	if (ctx->num_extra_edges)
 		add_chunk(cf, GRAPH_CHUNKID_EXTRAEDGES,
 			  st_mult(4, ctx->num_extra_edges),
@@ -2542,6 +2756,7 @@ int write_commit_graph(struct odb_source *source,
 			r->settings.commit_graph_changed_paths_version);
 		return 0;
 	}
+	ctx.write_reach_labels = !!r->settings.commit_graph_reachability_labels;
 
 	bloom_settings.hash_version = r->settings.commit_graph_changed_paths_version;
 	bloom_settings.bits_per_entry = git_env_ulong("GIT_TEST_BLOOM_SETTINGS_BITS_PER_ENTRY",
@@ -2665,6 +2880,9 @@ int write_commit_graph(struct odb_source *source,
 	if (ctx.write_generation_data)
 		compute_generation_numbers(&ctx);
 
+	if (ctx.write_reach_labels)
+		compute_reachability_labels(&ctx);
+
 	if (ctx.changed_paths)
 		compute_bloom_filters(&ctx);
 
@@ -2682,6 +2900,7 @@ int write_commit_graph(struct odb_source *source,
 	free(ctx.graph_name);
 	free(ctx.base_graph_name);
 	free(ctx.commits.list);
+	free(ctx.reach_labels);
 	oid_array_clear(&ctx.oids);
 	clear_topo_level_slab(&topo_levels);
 
@@ -2829,6 +3048,11 @@ static int verify_one_commit_graph(struct repository *r,
 					     oid_to_hex(&graph_parents->item->object.oid),
 					     oid_to_hex(&odb_parents->item->object.oid));
 
+			if (graph_cannot_reach(g, graph_commit, graph_parents->item))
+				graph_report(_("commit-graph reachability labels for %s do not reach parent %s"),
+					     oid_to_hex(&cur_oid),
+					     oid_to_hex(&graph_parents->item->object.oid));
+
 			generation = commit_graph_generation_from_graph(graph_parents->item);
 			if (generation > max_generation)
 				max_generation = generation;
@@ -108,6 +108,7 @@ struct commit_graph {
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
 	size_t chunk_bloom_data_size;
+	const unsigned char *chunk_reach_labels;
 
 	struct topo_level_slab *topo_levels;
 	struct bloom_filter_settings *bloom_filter_settings;
@@ -165,6 +166,7 @@ struct commit_graph_opts {
 	timestamp_t expire_time;
 	enum commit_graph_split_flags split_flags;
 	int max_new_filters;
+	int threads; /* for computing Bloom filters; 0 means one per CPU */
 };
 
 /*
@@ -206,6 +208,16 @@ struct commit_graph_data {
 timestamp_t commit_graph_generation(const struct commit *);
 uint32_t commit_graph_position(const struct commit *);
 
+/*
+ * Return 1 if the reachability labels in the commit-graph prove that
+ * "to" is not reachable from "from", and 0 if "to" may be reachable
+ * (including when either commit has no label). Both commits should be
+ * parsed.
+ */
+int commit_graph_cannot_reach(struct repository *r,
+			      const struct commit *from,
+			      const struct commit *to);
+
 /*
  * After this method, all commits reachable from those in the given
  * list will have non-zero, non-infinite generation numbers.
@@ -5,10 +5,13 @@
 #include "commit-graph.h"
 #include "decorate.h"
 #include "hex.h"
+#include "pack-bitmap.h"
 #include "prio-queue.h"
 #include "ref-filter.h"
 #include "revision.h"
+#include "shallow.h"
 #include "tag.h"
+#include "trace2.h"
 #include "commit-reach.h"
 #include "ewah/ewok.h"
 
@@ -550,6 +553,12 @@ int repo_in_merge_bases_many(struct repository *r, struct commit *commit,
 	if (generation > max_generation)
 		return ret;
 
+	for (i = 0; i < nr_reference; i++)
+		if (!commit_graph_cannot_reach(r, reference[i], commit))
+			break;
+	if (nr_reference && i == nr_reference)
+		return ret;
+
 	if (paint_down_to_common(r, commit,
 				 nr_reference, reference,
 				 generation, ignore_missing_commits, &bases))
@@ -712,7 +721,11 @@ static enum contains_result contains_test(struct commit *candidate,
 	if (commit_graph_generation(candidate) < cutoff)
 		return CONTAINS_NO;
 
-	return CONTAINS_UNKNOWN;
+	for (; want; want = want->next)
+		if (!commit_graph_cannot_reach(the_repository, candidate, want->item))
+			return CONTAINS_UNKNOWN;
+
+	return CONTAINS_NO;
 }
 
 static void push_to_contains_stack(struct commit *candidate, struct contains_stack *contains_stack)
@@ -926,8 +939,25 @@ int can_all_from_reach(struct commit_list *from, struct commit_list *to,
 		to_iter = to_iter->next;
 	}
 
-	result = can_all_from_reach_with_flag(&from_objs, PARENT2, PARENT1,
-					      min_commit_date, min_generation);
+	/*
+	 * If the commit-graph can tell that one of the "from" commits
+	 * reaches none of the "to" commits, there is no need to walk.
+	 */
+	for (from_iter = from; from_iter; from_iter = from_iter->next) {
+		for (to_iter = to; to_iter; to_iter = to_iter->next)
+			if (!commit_graph_cannot_reach(the_repository,
+						       from_iter->item,
+						       to_iter->item))
+				break;
+		if (!to_iter)
+			break;
+	}
+
+	if (from_iter && to)
+		result = 0;
+	else
+		result = can_all_from_reach_with_flag(&from_objs, PARENT2, PARENT1,
+						      min_commit_date, min_generation);
 
 	while (from) {
 		clear_commit_marks(from->item, PARENT1);
@@ -1054,6 +1084,18 @@ void ahead_behind(struct repository *r,
 	if (!commits_nr || !counts_nr)
 		return;
 
+	/*
+	 * Reachability bitmaps turn each count into two AND-NOT
+	 * popcounts instead of a walk over the symmetric difference.
+	 * They do not know about shallow boundaries, though.
+	 */
+	if (!is_repository_shallow(r) &&
+	    !bitmap_ahead_behind(r, commits, commits_nr, counts, counts_nr)) {
+		trace2_data_string("ahead-behind", r, "strategy", "bitmap");
+		return;
+	}
+	trace2_data_string("ahead-behind", r, "strategy", "walk");
+
 	for (size_t i = 0; i < counts_nr; i++) {
 		counts[i].ahead = 0;
 		counts[i].behind = 0;
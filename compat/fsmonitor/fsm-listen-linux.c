@@ -0,0 +1,704 @@
+#include "git-compat-util.h"
+#include "abspath.h"
+#include "dir.h"
+#include "fsmonitor-ll.h"
+#include "fsm-listen.h"
+#include "fsmonitor--daemon.h"
+#include "gettext.h"
+#include "hashmap.h"
+#include "simple-ipc.h"
+#include "string-list.h"
+#include "trace.h"
+#include <sys/inotify.h>
+
+/*
+ * inotify(7) is not recursive, so we have to put a watch on every
+ * directory in the worktree and add (and remove) watches as
+ * directories come and go.  Each watch is identified by a "watch
+ * descriptor" and the events we read only carry that descriptor and
+ * the name of the entry within the watched directory, so we keep a
+ * map from descriptor to the absolute path of the directory.
+ *
+ * The kernel queue is bounded by `fs.inotify.max_queued_events`.  If
+ * it overflows we receive IN_Q_OVERFLOW and have to assume that we
+ * lost sync with the filesystem.  The number of watches per user is
+ * bounded by `fs.inotify.max_user_watches`.  If we run out, we
+ * remember the directories we could not watch and retry them
+ * periodically.  Until they are all watched we cannot vouch for the
+ * completeness of our event stream, so every client request gets a
+ * trivial response.
+ */
+
+/*
+ * Events we care about on directories in the worktree.  IN_CLOSE_WRITE
+ * catches writes through mmap() that do not generate IN_MODIFY.
+ */
+#define FSM_WORKTREE_MASK (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | \
+			   IN_DELETE | IN_DELETE_SELF | IN_MODIFY | \
+			   IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | \
+			   IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR)
+
+/* Events we care about on the cookie directory. */
+#define FSM_COOKIE_MASK (IN_CREATE | IN_DELETE | IN_ONLYDIR)
+
+/* Events we care about on an external <gitdir>. */
+#define FSM_GITDIR_MASK (IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/*
+ * How long to wait (in milliseconds) before retrying to add watches
+ * that failed because we hit `fs.inotify.max_user_watches`.
+ */
+#define FSM_RETRY_UNWATCHED_MS 1000
+
+struct watch_entry {
+	struct hashmap_entry ent;
+	int wd;
+	unsigned int generation;
+	char *dir;
+};
+
+struct fsm_listen_data
+{
+	int fd_inotify;
+	int fd_stop[2];
+
+	int wd_worktree;
+	int wd_gitdir;
+
+	struct hashmap watches;
+	unsigned int generation;
+
+	/* directories we could not watch because of ENOSPC */
+	struct string_list unwatched;
+
+	enum shutdown_style {
+		SHUTDOWN_EVENT = 0,
+		FORCE_SHUTDOWN,
+		FORCE_ERROR_STOP,
+	} shutdown_style;
+};
+
+static int watch_entry_cmp(const void *cmp_data UNUSED,
+			   const struct hashmap_entry *he1,
+			   const struct hashmap_entry *he2,
+			   const void *keydata UNUSED)
+{
+	const struct watch_entry *a =
+		container_of(he1, const struct watch_entry, ent);
+	const struct watch_entry *b =
+		container_of(he2, const struct watch_entry, ent);
+
+	return a->wd != b->wd;
+}
+
+static struct watch_entry *find_watch(struct fsm_listen_data *data, int wd)
+{
+	struct watch_entry key;
+
+	hashmap_entry_init(&key.ent, memhash(&wd, sizeof(wd)));
+	key.wd = wd;
+
+	return hashmap_get_entry(&data->watches, &key, ent, NULL);
+}
+
+static void free_watch(struct fsm_listen_data *data, struct watch_entry *w)
+{
+	hashmap_remove(&data->watches, &w->ent, NULL);
+	free(w->dir);
+	free(w);
+}
+
+/*
+ * Watch the directory `path` and remember its watch descriptor.  If
+ * the directory is already watched (for example, after a rescan or
+ * because it was renamed), the kernel gives us the existing
+ * descriptor and we just update the path we associate with it.
+ *
+ * Returns the watch descriptor or -1 on error.
+ */
+static int add_watch(struct fsm_listen_data *data, const char *path,
+		     uint32_t mask)
+{
+	struct watch_entry *w;
+	int wd;
+
+	wd = inotify_add_watch(data->fd_inotify, path, mask);
+	if (wd < 0) {
+		if (errno == ENOSPC) {
+			if (!data->unwatched.nr)
+				warning(_("inotify watch limit reached; see "
+					  "'fs.inotify.max_user_watches'"));
+			string_list_append(&data->unwatched, path);
+		} else {
+			trace_printf_key(&trace_fsmonitor,
+					 "inotify_add_watch('%s') failed: %s",
+					 path, strerror(errno));
+		}
+		return -1;
+	}
+
+	w = find_watch(data, wd);
+	if (!w) {
+		CALLOC_ARRAY(w, 1);
+		hashmap_entry_init(&w->ent, memhash(&wd, sizeof(wd)));
+		w->wd = wd;
+		hashmap_add(&data->watches, &w->ent);
+	} else if (strcmp(w->dir, path)) {
+		free(w->dir);
+		w->dir = NULL;
+	}
+	if (!w->dir)
+		w->dir = xstrdup(path);
+	w->generation = data->generation;
+
+	return wd;
+}
+
+/*
+ * Stop watching `path` and everything below it.  This is used when
+ * a directory is renamed, since the kernel keeps the watches on the
+ * moved inodes and their events would otherwise be reported against
+ * the old pathnames.
+ */
+static void remove_watches_below(struct fsm_listen_data *data,
+				 const char *path)
+{
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+	struct watch_entry **doomed = NULL;
+	size_t doomed_nr = 0, doomed_alloc = 0;
+	const char *rest;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		if (!skip_prefix(w->dir, path, &rest) ||
+		    (*rest && *rest != '/'))
+			continue;
+		ALLOC_GROW(doomed, doomed_nr + 1, doomed_alloc);
+		doomed[doomed_nr++] = w;
+	}
+
+	for (size_t k = 0; k < doomed_nr; k++) {
+		inotify_rm_watch(data->fd_inotify, doomed[k]->wd);
+		free_watch(data, doomed[k]);
+	}
+	free(doomed);
+}
+
+/*
+ * Add the path of a worktree item to the batch, relative to the root
+ * of the worktree.  Directories are spelled with a trailing slash so
+ * that clients invalidate everything below them.
+ */
+static void add_path_to_batch(struct fsmonitor_daemon_state *state,
+			      struct fsmonitor_batch **batch,
+			      const char *path, int is_dir)
+{
+	const char *rel = path + state->path_worktree_watch.len + 1;
+
+	if (!*batch)
+		*batch = fsmonitor_batch__new();
+
+	if (is_dir) {
+		struct strbuf tmp = STRBUF_INIT;
+
+		strbuf_addf(&tmp, "%s/", rel);
+		fsmonitor_batch__add_path(*batch, tmp.buf);
+		strbuf_release(&tmp);
+	} else {
+		fsmonitor_batch__add_path(*batch, rel);
+	}
+}
+
+/*
+ * Watch the directory in `path` and all of the directories below it,
+ * skipping ".git".  If `batch` is non-NULL, also report everything we
+ * find.  That is needed for directories that were created or moved
+ * in after we started watching: items could have been created in
+ * them before we got our watch on them.
+ */
+static void add_watches_recursive(struct fsmonitor_daemon_state *state,
+				  struct strbuf *path,
+				  struct fsmonitor_batch **batch)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	DIR *dir;
+	struct dirent *de;
+	size_t len;
+
+	if (add_watch(data, path->buf, FSM_WORKTREE_MASK) < 0)
+		return;
+
+	dir = opendir(path->buf);
+	if (!dir)
+		return;
+
+	strbuf_addch(path, '/');
+	len = path->len;
+
+	while ((de = readdir_skip_dot_and_dotdot(dir))) {
+		unsigned char dtype;
+
+		strbuf_setlen(path, len);
+		dtype = get_dtype(de, path, 0);
+		strbuf_addstr(path, de->d_name);
+
+		if (fsmonitor_classify_path_absolute(state, path->buf) !=
+		    IS_WORKDIR_PATH)
+			continue;
+
+		if (batch)
+			add_path_to_batch(state, batch, path->buf,
+					  dtype == DT_DIR);
+		if (dtype == DT_DIR)
+			add_watches_recursive(state, path, batch);
+	}
+
+	strbuf_setlen(path, len - 1);
+	closedir(dir);
+}
+
+/*
+ * Watch the worktree (recursively), the cookie directory and, if it
+ * is not inside the worktree, the <gitdir>.  This is used both for
+ * the initial setup and to resynchronize after the kernel queue
+ * overflowed, in which case we may have missed directories being
+ * created, renamed or deleted.  Watches that we did not touch in this
+ * pass are stale and are removed.
+ */
+static int add_all_watches(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct strbuf path = STRBUF_INIT;
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+	struct watch_entry **stale = NULL;
+	size_t stale_nr = 0, stale_alloc = 0;
+	int ret = 0;
+
+	data->generation++;
+	string_list_clear(&data->unwatched, 0);
+
+	strbuf_addbuf(&path, &state->path_worktree_watch);
+	data->wd_worktree = add_watch(data, path.buf, FSM_WORKTREE_MASK);
+	if (data->wd_worktree < 0) {
+		ret = error_errno(_("could not watch '%s'"), path.buf);
+		goto done;
+	}
+	add_watches_recursive(state, &path, NULL);
+
+	if (state->nr_paths_watching > 1) {
+		data->wd_gitdir = add_watch(data, state->path_gitdir_watch.buf,
+					    FSM_GITDIR_MASK);
+		if (data->wd_gitdir < 0) {
+			ret = error_errno(_("could not watch '%s'"),
+					  state->path_gitdir_watch.buf);
+			goto done;
+		}
+	}
+
+	strbuf_reset(&path);
+	strbuf_addbuf(&path, &state->path_cookie_prefix);
+	strbuf_strip_suffix(&path, "/");
+	if (add_watch(data, path.buf, FSM_COOKIE_MASK) < 0) {
+		ret = error_errno(_("could not watch '%s'"), path.buf);
+		goto done;
+	}
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent) {
+		if (w->generation == data->generation)
+			continue;
+		ALLOC_GROW(stale, stale_nr + 1, stale_alloc);
+		stale[stale_nr++] = w;
+	}
+	for (size_t k = 0; k < stale_nr; k++) {
+		inotify_rm_watch(data->fd_inotify, stale[k]->wd);
+		free_watch(data, stale[k]);
+	}
+
+	trace_printf_key(&trace_fsmonitor, "inotify: watching %u directories",
+			 hashmap_get_size(&data->watches));
+
+done:
+	free(stale);
+	strbuf_release(&path);
+	return ret;
+}
+
+/*
+ * Retry the directories that we could not watch because we ran out
+ * of watches.  Returns 1 if we are now watching everything.
+ */
+static int retry_unwatched(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	struct string_list todo = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+
+	SWAP(todo, data->unwatched);
+
+	for (size_t k = 0; k < todo.nr; k++) {
+		/* give up early if we are still out of watches */
+		if (data->unwatched.nr) {
+			string_list_append(&data->unwatched,
+					   todo.items[k].string);
+			continue;
+		}
+		if (!is_directory(todo.items[k].string))
+			continue;
+		strbuf_reset(&path);
+		strbuf_addstr(&path, todo.items[k].string);
+		add_watches_recursive(state, &path, NULL);
+	}
+
+	string_list_clear(&todo, 0);
+	strbuf_release(&path);
+
+	if (data->unwatched.nr)
+		return 0;
+
+	trace_printf_key(&trace_fsmonitor,
+			 "inotify: recovered from watch limit");
+	return 1;
+}
+
+static void log_mask_set(const char *path, uint32_t mask)
+{
+	struct strbuf msg = STRBUF_INIT;
+
+	if (mask & IN_ACCESS)
+		strbuf_addstr(&msg, "IN_ACCESS|");
+	if (mask & IN_MODIFY)
+		strbuf_addstr(&msg, "IN_MODIFY|");
+	if (mask & IN_ATTRIB)
+		strbuf_addstr(&msg, "IN_ATTRIB|");
+	if (mask & IN_CLOSE_WRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_WRITE|");
+	if (mask & IN_CLOSE_NOWRITE)
+		strbuf_addstr(&msg, "IN_CLOSE_NOWRITE|");
+	if (mask & IN_OPEN)
+		strbuf_addstr(&msg, "IN_OPEN|");
+	if (mask & IN_MOVED_FROM)
+		strbuf_addstr(&msg, "IN_MOVED_FROM|");
+	if (mask & IN_MOVED_TO)
+		strbuf_addstr(&msg, "IN_MOVED_TO|");
+	if (mask & IN_CREATE)
+		strbuf_addstr(&msg, "IN_CREATE|");
+	if (mask & IN_DELETE)
+		strbuf_addstr(&msg, "IN_DELETE|");
+	if (mask & IN_DELETE_SELF)
+		strbuf_addstr(&msg, "IN_DELETE_SELF|");
+	if (mask & IN_MOVE_SELF)
+		strbuf_addstr(&msg, "IN_MOVE_SELF|");
+	if (mask & IN_UNMOUNT)
+		strbuf_addstr(&msg, "IN_UNMOUNT|");
+	if (mask & IN_Q_OVERFLOW)
+		strbuf_addstr(&msg, "IN_Q_OVERFLOW|");
+	if (mask & IN_IGNORED)
+		strbuf_addstr(&msg, "IN_IGNORED|");
+	if (mask & IN_ISDIR)
+		strbuf_addstr(&msg, "IN_ISDIR|");
+
+	trace_printf_key(&trace_fsmonitor, "inotify: '%s', mask=0x%x %s",
+			 path, mask, msg.buf);
+
+	strbuf_release(&msg);
+}
+
+/*
+ * Read and process everything that is currently in the inotify
+ * queue.  Returns -1 if we should shut down, 0 otherwise.
+ */
+static int process_events(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+	union {
+		struct inotify_event ev;
+		char buf[64 * 1024];
+	} u;
+	struct fsmonitor_batch *batch = NULL;
+	struct string_list cookie_list = STRING_LIST_INIT_DUP;
+	struct strbuf path = STRBUF_INIT;
+	int ret = 0;
+
+	for (;;) {
+		ssize_t len = read(data->fd_inotify, u.buf, sizeof(u.buf));
+		char *p;
+
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			error_errno(_("could not read inotify events"));
+			data->shutdown_style = FORCE_ERROR_STOP;
+			ret = -1;
+			goto done;
+		}
+		if (!len)
+			break;
+
+		for (p = u.buf; p < u.buf + len;
+		     p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+			const struct inotify_event *ev = (const void *)p;
+			struct watch_entry *w;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				/*
+				 * We lost events.  Flush the cached data
+				 * and the batch that we were building
+				 * (since it is relative to the token that
+				 * we just flushed) and re-register our
+				 * watches since we may have missed
+				 * directories coming and going.
+				 */
+				trace_printf_key(&trace_fsmonitor,
+						 "inotify: queue overflow");
+				fsmonitor_force_resync(state);
+				fsmonitor_batch__free_list(batch);
+				batch = NULL;
+				string_list_clear(&cookie_list, 0);
+				if (add_all_watches(state)) {
+					data->shutdown_style = FORCE_ERROR_STOP;
+					ret = -1;
+					goto done;
+				}
+				continue;
+			}
+
+			w = find_watch(data, ev->wd);
+			if (!w)
+				continue; /* event for a watch we removed */
+
+			if (ev->mask & IN_IGNORED) {
+				free_watch(data, w);
+				continue;
+			}
+
+			if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				if (ev->wd == data->wd_worktree) {
+					trace_printf_key(&trace_fsmonitor,
+							 "event: worktree root removed");
+					goto force_shutdown;
+				}
+				if (ev->wd == data->wd_gitdir) {
+					trace_printf_key(&trace_fsmonitor,
+							 "event: gitdir removed");
+					goto force_shutdown;
+				}
+				continue;
+			}
+
+			/* changes to the watched directory itself */
+			if (!ev->len)
+				continue;
+
+			strbuf_reset(&path);
+			strbuf_addf(&path, "%s/%s", w->dir, ev->name);
+
+			switch (fsmonitor_classify_path_absolute(state, path.buf)) {
+
+			case IS_INSIDE_DOT_GIT_WITH_COOKIE_PREFIX:
+			case IS_INSIDE_GITDIR_WITH_COOKIE_PREFIX:
+				/* special case cookie files within .git or gitdir */
+				string_list_append(&cookie_list, ev->name);
+				break;
+
+			case IS_INSIDE_DOT_GIT:
+			case IS_INSIDE_GITDIR:
+				/* ignore all other paths inside of .git or gitdir */
+				break;
+
+			case IS_DOT_GIT:
+			case IS_GITDIR:
+				/*
+				 * If .git directory is deleted or renamed away,
+				 * we have to quit.
+				 */
+				if ((ev->mask & IN_ISDIR) &&
+				    (ev->mask & (IN_DELETE | IN_MOVED_FROM))) {
+					trace_printf_key(&trace_fsmonitor,
+							 "event: gitdir removed");
+					goto force_shutdown;
+				}
+				break;
+
+			case IS_WORKDIR_PATH:
+				if (trace_pass_fl(&trace_fsmonitor))
+					log_mask_set(path.buf, ev->mask);
+
+				if (!(ev->mask & IN_ISDIR)) {
+					add_path_to_batch(state, &batch,
+							  path.buf, 0);
+					break;
+				}
+
+				add_path_to_batch(state, &batch, path.buf, 1);
+				if (ev->mask & IN_MOVED_FROM)
+					remove_watches_below(data, path.buf);
+				if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+					add_watches_recursive(state, &path,
+							      &batch);
+				break;
+
+			case IS_OUTSIDE_CONE:
+			default:
+				trace_printf_key(&trace_fsmonitor,
+						 "ignoring '%s'", path.buf);
+				break;
+			}
+		}
+	}
+
+	/*
+	 * If some directories are not being watched, we cannot tell
+	 * clients that they have seen everything since their token.
+	 * Flush the cached data whenever a client is waiting on a
+	 * cookie, so that it gets a trivial response and does a full
+	 * scan.
+	 */
+	if (data->unwatched.nr && cookie_list.nr) {
+		trace_printf_key(&trace_fsmonitor,
+				 "inotify: %"PRIuMAX" directories unwatched",
+				 (uintmax_t)data->unwatched.nr);
+		fsmonitor_force_resync(state);
+		fsmonitor_batch__free_list(batch);
+		batch = NULL;
+	}
+
+	fsmonitor_publish(state, batch, &cookie_list);
+	batch = NULL;
+	goto done;
+
+force_shutdown:
+	data->shutdown_style = FORCE_SHUTDOWN;
+	ret = -1;
+
+done:
+	fsmonitor_batch__free_list(batch);
+	string_list_clear(&cookie_list, 0);
+	strbuf_release(&path);
+	return ret;
+}
+
+int fsm_listen__ctor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+
+	CALLOC_ARRAY(data, 1);
+	state->listen_data = data;
+
+	data->fd_stop[0] = data->fd_stop[1] = -1;
+	data->wd_worktree = data->wd_gitdir = -1;
+	hashmap_init(&data->watches, watch_entry_cmp, NULL, 0);
+	string_list_init_dup(&data->unwatched);
+
+	data->fd_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (data->fd_inotify < 0) {
+		error_errno(_("could not initialize inotify"));
+		goto failed;
+	}
+
+	if (pipe(data->fd_stop) < 0) {
+		error_errno(_("could not create pipe"));
+		goto failed;
+	}
+
+	if (add_all_watches(state))
+		goto failed;
+
+	return 0;
+
+failed:
+	fsm_listen__dtor(state);
+	return -1;
+}
+
+void fsm_listen__dtor(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data;
+	struct hashmap_iter iter;
+	struct watch_entry *w;
+
+	if (!state || !state->listen_data)
+		return;
+
+	data = state->listen_data;
+
+	hashmap_for_each_entry(&data->watches, &iter, w, ent)
+		free(w->dir);
+	hashmap_clear_and_free(&data->watches, struct watch_entry, ent);
+	string_list_clear(&data->unwatched, 0);
+
+	if (data->fd_inotify >= 0)
+		close(data->fd_inotify);
+	if (data->fd_stop[0] >= 0)
+		close(data->fd_stop[0]);
+	if (data->fd_stop[1] >= 0)
+		close(data->fd_stop[1]);
+
+	FREE_AND_NULL(state->listen_data);
+}
+
+void fsm_listen__stop_async(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+
+	data->shutdown_style = SHUTDOWN_EVENT;
+	if (write(data->fd_stop[1], "q", 1) < 0)
+		error_errno(_("could not stop the inotify listener"));
+}
+
+void fsm_listen__loop(struct fsmonitor_daemon_state *state)
+{
+	struct fsm_listen_data *data = state->listen_data;
+
+	/*
+	 * Our fs event listener is now running, so it's safe to start
+	 * serving client requests.
+	 */
+	ipc_server_start_async(state->ipc_server_data);
+
+	for (;;) {
+		struct pollfd pfd[2];
+		int timeout = data->unwatched.nr ? FSM_RETRY_UNWATCHED_MS : -1;
+
+		pfd[0].fd = data->fd_stop[0];
+		pfd[0].events = POLLIN;
+		pfd[1].fd = data->fd_inotify;
+		pfd[1].events = POLLIN;
+
+		if (poll(pfd, ARRAY_SIZE(pfd), timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			error_errno(_("could not poll inotify descriptor"));
+			data->shutdown_style = FORCE_ERROR_STOP;
+			break;
+		}
+
+		if (pfd[0].revents)
+			break;
+
+		if (data->unwatched.nr && retry_unwatched(state))
+			fsmonitor_force_resync(state);
+
+		if ((pfd[1].revents & POLLIN) && process_events(state))
+			break;
+		if (pfd[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			error(_("inotify descriptor is no longer usable"));
+			data->shutdown_style = FORCE_ERROR_STOP;
+			break;
+		}
+	}
+
+	switch (data->shutdown_style) {
+	case FORCE_ERROR_STOP:
+		state->listen_error_code = -1;
+		/* fall thru */
+	case FORCE_SHUTDOWN:
+		ipc_server_stop_async(state->ipc_server_data);
+		/* fall thru */
+	case SHUTDOWN_EVENT:
+	default:
+		break;
+	}
+}
@@ -0,0 +1,107 @@
+#include "git-compat-util.h"
+#include "fsmonitor-ll.h"
+#include "fsmonitor-path-utils.h"
+#include "gettext.h"
+#include "trace.h"
+#include <sys/vfs.h>
+
+/*
+ * Linux reports the filesystem type only as a magic number in
+ * `f_type`.  Map the ones we care about to a name and note whether
+ * the data lives on another machine, in which case inotify(7) will
+ * not see changes made by other clients.
+ *
+ * See statfs(2) and <linux/magic.h>.
+ */
+static const struct {
+	unsigned long magic;
+	const char *name;
+	int is_remote;
+} fs_types[] = {
+	{ 0xEF53,     "ext4",  0 },
+	{ 0x58465342, "xfs",   0 },
+	{ 0x9123683E, "btrfs", 0 },
+	{ 0x01021994, "tmpfs", 0 },
+	{ 0x794C7630, "overlay", 0 },
+	{ 0x2FC12FC1, "zfs",   0 },
+	{ 0xF2F52010, "f2fs",  0 },
+	{ 0x4d44,     "msdos", 0 },
+	{ 0x5346544e, "ntfs",  0 },
+	/*
+	 * sshfs, s3fs and friends are FUSE filesystems too, and we cannot
+	 * tell them from local ones, so err on the side of caution.
+	 */
+	{ 0x65735546, "fuse",  1 },
+	{ 0x6969,     "nfs",   1 },
+	{ 0x517B,     "smbfs", 1 },
+	{ 0xFF534D42, "cifs",  1 },
+	{ 0xFE534D42, "smb2",  1 },
+	{ 0x5346414F, "afs",   1 },
+	{ 0x6B414653, "afs",   1 },
+	{ 0x01021997, "9p",    1 },
+	{ 0x00C36400, "ceph",  1 },
+	{ 0x47504653, "gpfs",  1 },
+	{ 0x0BD00BD0, "lustre", 1 },
+};
+
+int fsmonitor__get_fs_info(const char *path, struct fs_info *fs_info)
+{
+	struct statfs fs;
+	const char *name = "unknown";
+	int is_remote = 0;
+
+	if (statfs(path, &fs) == -1) {
+		int saved_errno = errno;
+		trace_printf_key(&trace_fsmonitor, "statfs('%s') failed: %s",
+				 path, strerror(saved_errno));
+		errno = saved_errno;
+		return -1;
+	}
+
+	for (size_t k = 0; k < ARRAY_SIZE(fs_types); k++) {
+		if ((unsigned long)fs.f_type == fs_types[k].magic) {
+			name = fs_types[k].name;
+			is_remote = fs_types[k].is_remote;
+			break;
+		}
+	}
+
+	trace_printf_key(&trace_fsmonitor,
+			 "statfs('%s') [type 0x%08lx] '%s'",
+			 path, (unsigned long)fs.f_type, name);
+
+	fs_info->is_remote = is_remote;
+	fs_info->typename = xstrdup(name);
+
+	trace_printf_key(&trace_fsmonitor,
+				"'%s' is_remote: %d",
+				path, fs_info->is_remote);
+	return 0;
+}
+
+int fsmonitor__is_fs_remote(const char *path)
+{
+	struct fs_info fs;
+	if (fsmonitor__get_fs_info(path, &fs))
+		return -1;
+
+	free(fs.typename);
+
+	return fs.is_remote;
+}
+
+/*
+ * Linux does not have the synthetic firmlinks of macOS, so there is
+ * never an alias to resolve.
+ */
+int fsmonitor__get_alias(const char *path UNUSED,
+			 struct alias_info *info UNUSED)
+{
+	return 0;
+}
+
+char *fsmonitor__resolve_alias(const char *path UNUSED,
+	const struct alias_info *info UNUSED)
+{
+	return NULL;
+}
@@ -0,0 +1,214 @@
+#include "git-compat-util.h"
+#include "compat/lstat-batch.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+/*
+ * A minimal io_uring user: one ring per batch, used by a single thread,
+ * submitting IORING_OP_STATX requests. The raw system calls are used so
+ * that there is no dependency on liburing.
+ */
+struct lstat_batch {
+	int fd;
+	unsigned int size;
+
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	size_t sqes_len;
+	struct io_uring_cqe *cqes;
+
+	struct statx *stx;
+};
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+			     unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int statx_supported(int fd)
+{
+	struct io_uring_probe *probe;
+	size_t len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	int ret = 0;
+
+	probe = xcalloc(1, len);
+	if (!io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256) &&
+	    probe->last_op >= IORING_OP_STATX &&
+	    (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		ret = 1;
+	free(probe);
+	return ret;
+}
+
+struct lstat_batch *lstat_batch_new(unsigned int size)
+{
+	struct io_uring_params p = { 0 };
+	struct lstat_batch *b;
+	int fd;
+
+	fd = io_uring_setup(size, &p);
+	if (fd < 0)
+		return NULL;
+	if (!statx_supported(fd) || p.sq_entries < size) {
+		close(fd);
+		return NULL;
+	}
+
+	CALLOC_ARRAY(b, 1);
+	b->fd = fd;
+	b->size = size;
+
+	b->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	b->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		b->sq_len = b->cq_len = (b->sq_len > b->cq_len) ? b->sq_len : b->cq_len;
+
+	b->sq_ptr = mmap(NULL, b->sq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (b->sq_ptr == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		b->cq_ptr = b->sq_ptr;
+	} else {
+		b->cq_ptr = mmap(NULL, b->cq_len, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (b->cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+	b->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	b->sqes = mmap(NULL, b->sqes_len, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (b->sqes == MAP_FAILED)
+		goto fail;
+
+	b->sq_tail = (unsigned int *)((char *)b->sq_ptr + p.sq_off.tail);
+	b->sq_mask = (unsigned int *)((char *)b->sq_ptr + p.sq_off.ring_mask);
+	b->sq_array = (unsigned int *)((char *)b->sq_ptr + p.sq_off.array);
+	b->cq_head = (unsigned int *)((char *)b->cq_ptr + p.cq_off.head);
+	b->cq_tail = (unsigned int *)((char *)b->cq_ptr + p.cq_off.tail);
+	b->cq_mask = (unsigned int *)((char *)b->cq_ptr + p.cq_off.ring_mask);
+	b->cqes = (struct io_uring_cqe *)((char *)b->cq_ptr + p.cq_off.cqes);
+
+	CALLOC_ARRAY(b->stx, size);
+	return b;
+
+fail:
+	lstat_batch_free(b);
+	return NULL;
+}
+
+static void statx_to_stat(const struct statx *stx, struct stat *st)
+{
+	memset(st, 0, sizeof(*st));
+	st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+	st->st_ino = stx->stx_ino;
+	st->st_mode = stx->stx_mode;
+	st->st_nlink = stx->stx_nlink;
+	st->st_uid = stx->stx_uid;
+	st->st_gid = stx->stx_gid;
+	st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+	st->st_size = stx->stx_size;
+	st->st_blksize = stx->stx_blksize;
+	st->st_blocks = stx->stx_blocks;
+	st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+void lstat_batch(struct lstat_batch *b, unsigned int nr,
+		 const char **paths, struct stat *st, int *err)
+{
+	unsigned int tail = *b->sq_tail, mask = *b->sq_mask;
+	unsigned int submitted = 0, completed = 0, i;
+
+	if (nr > b->size)
+		BUG("lstat_batch() called with %u paths, batch holds %u",
+		    nr, b->size);
+
+	for (i = 0; i < nr; i++) {
+		unsigned int idx = tail++ & mask;
+		struct io_uring_sqe *sqe = &b->sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)paths[i];
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&b->stx[i];
+		sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+		sqe->user_data = i;
+		b->sq_array[idx] = idx;
+	}
+	__atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (completed < nr) {
+		unsigned int head, cq_tail;
+		int ret;
+
+		ret = io_uring_enter(b->fd, nr - submitted, nr - completed,
+				     IORING_ENTER_GETEVENTS);
+		if (ret < 0) {
+			/*
+			 * Requests that were already submitted may still
+			 * write into our buffers, so we cannot bail out.
+			 */
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			die_errno("io_uring_enter failed");
+		}
+		submitted += ret;
+
+		head = *b->cq_head;
+		cq_tail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != cq_tail; head++) {
+			struct io_uring_cqe *cqe = &b->cqes[head & *b->cq_mask];
+
+			i = cqe->user_data;
+			if (cqe->res < 0) {
+				err[i] = -cqe->res;
+			} else {
+				err[i] = 0;
+				statx_to_stat(&b->stx[i], &st[i]);
+			}
+			completed++;
+		}
+		__atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+void lstat_batch_free(struct lstat_batch *b)
+{
+	if (!b)
+		return;
+	if (b->sqes && b->sqes != MAP_FAILED)
+		munmap(b->sqes, b->sqes_len);
+	if (b->cq_ptr && b->cq_ptr != MAP_FAILED && b->cq_ptr != b->sq_ptr)
+		munmap(b->cq_ptr, b->cq_len);
+	if (b->sq_ptr && b->sq_ptr != MAP_FAILED)
+		munmap(b->sq_ptr, b->sq_len);
+	close(b->fd);
+	free(b->stx);
+	free(b);
+}
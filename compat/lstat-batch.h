@@ -0,0 +1,55 @@
+#ifndef COMPAT_LSTAT_BATCH_H
+#define COMPAT_LSTAT_BATCH_H
+
+/*
+ * Batched lstat(2)
+ *
+ * Submit many lstat() calls at once instead of issuing one system call
+ * per path, so that the kernel can overlap their latencies. This is
+ * implemented with io_uring on Linux (see compat/linux/lstat-batch.c);
+ * elsewhere lstat_batch_new() always returns NULL and callers are
+ * expected to fall back to calling lstat() themselves.
+ */
+struct lstat_batch;
+
+#ifdef HAVE_IO_URING
+
+/*
+ * Set up a batch that can take up to `size` paths per call to
+ * lstat_batch(). Returns NULL if batched lstat is not supported by the
+ * running kernel or is not permitted, e.g. by a seccomp filter.
+ */
+struct lstat_batch *lstat_batch_new(unsigned int size);
+
+/*
+ * lstat() the `nr` paths in `paths`, which must not be more than the
+ * batch was set up for. For each path, `st` is filled in and `err` is
+ * set to 0 on success, or `err` is set to an errno value on failure.
+ */
+void lstat_batch(struct lstat_batch *b, unsigned int nr,
+		 const char **paths, struct stat *st, int *err);
+
+void lstat_batch_free(struct lstat_batch *b);
+
+#else
+
+static inline struct lstat_batch *lstat_batch_new(unsigned int size UNUSED)
+{
+	return NULL;
+}
+
+static inline void lstat_batch(struct lstat_batch *b UNUSED,
+			       unsigned int nr UNUSED,
+			       const char **paths UNUSED,
+			       struct stat *st UNUSED, int *err UNUSED)
+{
+	BUG("lstat_batch() called without batched lstat support");
+}
+
+static inline void lstat_batch_free(struct lstat_batch *b UNUSED)
+{
+}
+
+#endif
+
+#endif /* COMPAT_LSTAT_BATCH_H */
@@ -103,6 +103,11 @@ struct itimerval {
 };
 #define ITIMER_REAL 0
 
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
 struct utsname {
 	char sysname[16];
 	char nodename[1];
@@ -0,0 +1,17 @@
+#include "../git-compat-util.h"
+
+ssize_t git_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	ssize_t total = 0;
+
+	for (int i = 0; i < iovcnt; i++) {
+		ssize_t written = write(fd, iov[i].iov_base, iov[i].iov_len);
+
+		if (written < 0)
+			return total ? total : -1;
+		total += written;
+		if ((size_t)written < iov[i].iov_len)
+			break;
+	}
+	return total;
+}
@@ -10,9 +10,128 @@
 
 #include "git-compat-util.h"
 #include "csum-file.h"
+#include "gettext.h"
 #include "git-zlib.h"
 #include "hash.h"
 #include "progress.h"
+#include "thread-utils.h"
+
+/*
+ * Number of buffers in the ring used by pipelined hashing. While the
+ * helper thread hashes one buffer, the caller can write it out and
+ * fill the next ones.
+ */
+#define HASHFILE_PIPELINE_BUFFERS 4
+
+struct hashfile_pipeline {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct git_hash_ctx *ctx;
+	unsigned char *buffers[HASHFILE_PIPELINE_BUFFERS];
+	unsigned int len[HASHFILE_PIPELINE_BUFFERS];
+	/* number of buffers handed to, and hashed by, the helper thread */
+	unsigned int queued;
+	unsigned int hashed;
+	int shutdown;
+};
+
+static void *hash_thread(void *data)
+{
+	struct hashfile_pipeline *p = data;
+
+	pthread_mutex_lock(&p->mutex);
+	for (;;) {
+		unsigned int slot;
+
+		while (p->hashed == p->queued && !p->shutdown)
+			pthread_cond_wait(&p->cond, &p->mutex);
+		if (p->hashed == p->queued)
+			break;
+
+		slot = p->hashed % HASHFILE_PIPELINE_BUFFERS;
+		pthread_mutex_unlock(&p->mutex);
+		git_hash_update(p->ctx, p->buffers[slot], p->len[slot]);
+		pthread_mutex_lock(&p->mutex);
+
+		p->hashed++;
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
+
+/*
+ * Wait until at most `pending` buffers are still waiting to be hashed.
+ */
+static void pipeline_wait(struct hashfile_pipeline *p, unsigned int pending)
+{
+	pthread_mutex_lock(&p->mutex);
+	while (p->queued - p->hashed > pending)
+		pthread_cond_wait(&p->cond, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/*
+ * Wait until the helper thread has hashed everything queued so far, so
+ * that `f->ctx` can be used by the caller.
+ */
+static void pipeline_drain(struct hashfile *f)
+{
+	if (f->pipeline)
+		pipeline_wait(f->pipeline, 0);
+}
+
+void hashfile_enable_pipeline(struct hashfile *f)
+{
+	struct hashfile_pipeline *p;
+
+	if (!HAVE_THREADS || f->skip_hash || f->pipeline)
+		return;
+
+	CALLOC_ARRAY(p, 1);
+	p->ctx = &f->ctx;
+	p->buffers[0] = f->buffer;
+	for (size_t i = 1; i < ARRAY_SIZE(p->buffers); i++)
+		p->buffers[i] = xmalloc(f->buffer_len);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	if (pthread_create(&p->thread, NULL, hash_thread, p)) {
+		warning(_("unable to create hashing thread, hashing inline"));
+		pthread_mutex_destroy(&p->mutex);
+		pthread_cond_destroy(&p->cond);
+		for (size_t i = 1; i < ARRAY_SIZE(p->buffers); i++)
+			free(p->buffers[i]);
+		free(p);
+		return;
+	}
+
+	f->pipeline = p;
+}
+
+static void stop_pipeline(struct hashfile *f)
+{
+	struct hashfile_pipeline *p = f->pipeline;
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->shutdown = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+	pthread_join(p->thread, NULL);
+
+	pthread_mutex_destroy(&p->mutex);
+	pthread_cond_destroy(&p->cond);
+	/* f->buffer is always one of the ring buffers */
+	for (size_t i = 0; i < ARRAY_SIZE(p->buffers); i++)
+		free(p->buffers[i]);
+	f->buffer = NULL;
+	FREE_AND_NULL(f->pipeline);
+}
 
 static void verify_buffer_or_die(struct hashfile *f,
 				 const void *buf,
@@ -47,16 +166,37 @@ void hashflush(struct hashfile *f)
 {
 	unsigned offset = f->offset;
 
-	if (offset) {
-		if (!f->skip_hash)
-			git_hash_update(&f->ctx, f->buffer, offset);
+	if (!offset)
+		return;
+
+	if (f->pipeline) {
+		struct hashfile_pipeline *p = f->pipeline;
+		unsigned int slot = p->queued % HASHFILE_PIPELINE_BUFFERS;
+
+		pthread_mutex_lock(&p->mutex);
+		p->len[slot] = offset;
+		p->queued++;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->mutex);
+
 		flush(f, f->buffer, offset);
+
+		/* wait until the next buffer in the ring has been hashed */
+		pipeline_wait(p, HASHFILE_PIPELINE_BUFFERS - 1);
+		f->buffer = p->buffers[p->queued % HASHFILE_PIPELINE_BUFFERS];
 		f->offset = 0;
+		return;
 	}
+
+	if (!f->skip_hash)
+		git_hash_update(&f->ctx, f->buffer, offset);
+	flush(f, f->buffer, offset);
+	f->offset = 0;
 }
 
 void free_hashfile(struct hashfile *f)
 {
+	stop_pipeline(f);
 	free(f->buffer);
 	free(f->check_buffer);
 	free(f);
@@ -68,6 +208,7 @@ int finalize_hashfile(struct hashfile *f, unsigned char *result,
 	int fd;
 
 	hashflush(f);
+	pipeline_drain(f);
 
 	if (f->skip_hash)
 		hashclr(f->buffer, f->algop);
@@ -119,12 +260,14 @@ void hashwrite(struct hashfile *f, const void *buf, unsigned int count)
 		if (f->do_crc)
 			f->crc32 = crc32(f->crc32, buf, nr);
 
-		if (nr == f->buffer_len) {
+		if (nr == f->buffer_len && !f->pipeline) {
 			/*
 			 * Flush a full batch worth of data directly
 			 * from the input, skipping the memcpy() to
 			 * the hashfile's buffer. In this block,
-			 * f->offset is necessarily zero.
+			 * f->offset is necessarily zero. We cannot do
+			 * this when pipelining, as the helper thread
+			 * may still be hashing `buf` after we return.
 			 */
 			if (!f->skip_hash)
 				git_hash_update(&f->ctx, buf, nr);
@@ -175,6 +318,7 @@ static struct hashfile *hashfd_internal(const struct git_hash_algo *algop,
 	f->name = name;
 	f->do_crc = 0;
 	f->skip_hash = 0;
+	f->pipeline = NULL;
 
 	f->algop = unsafe_hash_algo(algop);
 	f->algop->init_fn(&f->ctx);
@@ -219,6 +363,7 @@ void hashfile_checkpoint_init(struct hashfile *f,
 void hashfile_checkpoint(struct hashfile *f, struct hashfile_checkpoint *checkpoint)
 {
 	hashflush(f);
+	pipeline_drain(f);
 	checkpoint->offset = f->total;
 	git_hash_clone(&checkpoint->ctx, &f->ctx);
 }
@@ -227,6 +372,7 @@ int hashfile_truncate(struct hashfile *f, struct hashfile_checkpoint *checkpoint
 {
 	off_t offset = checkpoint->offset;
 
+	pipeline_drain(f);
 	if (ftruncate(f->fd, offset) ||
 	    lseek(f->fd, offset, SEEK_SET) != offset)
 		return -1;
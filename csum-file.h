@@ -5,6 +5,7 @@
 #include "write-or-die.h"
 
 struct progress;
+struct hashfile_pipeline;
 
 /* A SHA1-protected file */
 struct hashfile {
@@ -28,6 +29,12 @@ struct hashfile {
 	 * instead only use it as a buffered write.
 	 */
 	int skip_hash;
+
+	/**
+	 * If non-NULL, hashing is done by a helper thread while the
+	 * buffers are written out; see hashfile_enable_pipeline().
+	 */
+	struct hashfile_pipeline *pipeline;
 };
 
 /* Checkpoint */
@@ -52,6 +59,15 @@ struct hashfile *hashfd_check(const struct git_hash_algo *algop,
 struct hashfile *hashfd_throughput(const struct git_hash_algo *algop,
 				   int fd, const char *name, struct progress *tp);
 
+/*
+ * Hash the data on a helper thread, overlapping it with the write(2)
+ * calls, instead of hashing each buffer just before it is written out.
+ * The resulting file and checksum are identical either way. This must
+ * be called after `skip_hash` has been set, and is a no-op when hashing
+ * is skipped or threads are not supported.
+ */
+void hashfile_enable_pipeline(struct hashfile *f);
+
 /*
  * Free the hashfile without flushing its contents to disk. This only
  * needs to be called when not calling `finalize_hashfile()`.
@@ -68,6 +68,19 @@ diff_delta(const void *src_buf, unsigned long src_bufsize,
 	return NULL;
 }
 
+/*
+ * create_delta_sketch: compute a MinHash sketch of the given buffer
+ *
+ * The rolling Rabin fingerprints that create_delta() looks up are hashed
+ * and spread over "nr" bins, each of which keeps the smallest value it
+ * sees.  Buffers sharing many Rabin windows are likely to have equal
+ * values in any given bin, which makes equal runs of bins a cheap hint
+ * that a delta between them is worth trying.  Bins that saw no window at
+ * all (e.g. in small buffers) are set to UINT32_MAX.
+ */
+void create_delta_sketch(const void *buf, unsigned long bufsize,
+			 uint32_t *sketch, unsigned int nr);
+
 /*
  * patch_delta: recreate target buffer given source buffer and delta data
  *
@@ -310,6 +310,48 @@ unsigned long sizeof_delta_index(struct delta_index *index)
 		return 0;
 }
 
+static inline void sketch_add(uint32_t *sketch, unsigned int nr,
+			      unsigned int val)
+{
+	uint32_t h = val;
+	unsigned int bin;
+
+	/* murmur3 finalizer, to spread the fingerprint over all bits */
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+
+	bin = ((uint64_t)h * nr) >> 32;
+	if (h < sketch[bin])
+		sketch[bin] = h;
+}
+
+void create_delta_sketch(const void *buf, unsigned long bufsize,
+			 uint32_t *sketch, unsigned int nr)
+{
+	const unsigned char *data = buf;
+	const unsigned char *top = data + bufsize;
+	unsigned int i, val = 0;
+
+	for (i = 0; i < nr; i++)
+		sketch[i] = UINT32_MAX;
+
+	for (i = 0; i < RABIN_WINDOW && data < top; i++, data++)
+		val = ((val << 8) | *data) ^ T[val >> RABIN_SHIFT];
+	if (i < RABIN_WINDOW)
+		return;
+	sketch_add(sketch, nr, val);
+
+	while (data < top) {
+		val ^= U[data[-RABIN_WINDOW]];
+		val = ((val << 8) | *data) ^ T[val >> RABIN_SHIFT];
+		sketch_add(sketch, nr, val);
+		data++;
+	}
+}
+
 /*
  * The maximum size for any opcode sequence, including the initial header
  * plus Rabin window plus biggest copy.
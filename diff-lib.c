@@ -248,16 +248,17 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 					perror(ce->name);
 					continue;
 				}
-				diff_addremove(&revs->diffopt, '-', ce->ce_mode,
-					       &ce->oid,
-					       !is_null_oid(&ce->oid),
-					       ce->name, 0);
+				revs->diffopt.add_remove(&revs->diffopt, '-',
+							 ce->ce_mode, &ce->oid,
+							 !is_null_oid(&ce->oid),
+							 ce->name, 0);
 				continue;
 			} else if (revs->diffopt.ita_invisible_in_index &&
 				   ce_intent_to_add(ce)) {
 				newmode = ce_mode_from_stat(ce, st.st_mode);
-				diff_addremove(&revs->diffopt, '+', newmode,
-					       null_oid(the_hash_algo), 0, ce->name, 0);
+				revs->diffopt.add_remove(&revs->diffopt, '+', newmode,
+							 null_oid(the_hash_algo), 0,
+							 ce->name, 0);
 				continue;
 			}
 
@@ -275,11 +276,11 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 		oldmode = ce->ce_mode;
 		old_oid = &ce->oid;
 		new_oid = changed ? null_oid(the_hash_algo) : &ce->oid;
-		diff_change(&revs->diffopt, oldmode, newmode,
-			    old_oid, new_oid,
-			    !is_null_oid(old_oid),
-			    !is_null_oid(new_oid),
-			    ce->name, 0, dirty_submodule);
+		revs->diffopt.change(&revs->diffopt, oldmode, newmode,
+				     old_oid, new_oid,
+				     !is_null_oid(old_oid),
+				     !is_null_oid(new_oid),
+				     ce->name, 0, dirty_submodule);
 
 	}
 	diffcore_std(&revs->diffopt);
@@ -32,6 +32,7 @@
 #include "sparse-index.h"
 #include "submodule-config.h"
 #include "symlinks.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "hex.h"
@@ -60,6 +61,7 @@ enum path_treatment {
  */
 struct cached_dir {
 	DIR *fdir;
+	struct dir_listing *listing;
 	struct untracked_cache_dir *untracked;
 	int nr_files;
 	int nr_dirs;
@@ -2531,12 +2533,290 @@ static int valid_cached_dir(struct dir_struct *dir,
 	return untracked->valid;
 }
 
+/*
+ * Directory read-ahead
+ *
+ * With core.untrackedScanThreads, worker threads read the listings of
+ * the subdirectories of each directory the traversal enters, so that
+ * they are usually ready by the time the traversal descends into them.
+ * Everything else, including the exclude checks and the result lists,
+ * stays on the traversal's thread, which therefore visits entries in
+ * the same order as without read-ahead.
+ */
+struct dir_listing_entry {
+	size_t name_off;
+	int d_type;
+};
+
+struct dir_listing {
+	struct hashmap_entry ent;
+	char *path;
+	enum {
+		LISTING_QUEUED,
+		LISTING_READING,
+		LISTING_DONE,
+	} state;
+	int err;
+	struct strbuf names;
+	struct dir_listing_entry *entries;
+	size_t nr, alloc, pos;
+};
+
+struct dir_readahead {
+	pthread_mutex_t mutex;
+	pthread_cond_t queued, done;
+	int shutdown;
+
+	/* listings that have not been taken by the traversal yet */
+	struct hashmap listings;
+
+	/* listings to read, the most recently queued one first */
+	struct dir_listing **queue;
+	size_t queue_nr, queue_alloc;
+
+	pthread_t *threads;
+	int nr_threads;
+};
+
+static int dir_listing_cmp(const void *cmp_data UNUSED,
+			   const struct hashmap_entry *eptr,
+			   const struct hashmap_entry *entry_or_key,
+			   const void *keydata)
+{
+	const struct dir_listing *a, *b;
+
+	a = container_of(eptr, const struct dir_listing, ent);
+	b = container_of(entry_or_key, const struct dir_listing, ent);
+	return strcmp(a->path, keydata ? keydata : b->path);
+}
+
+static void free_dir_listing(struct dir_listing *l)
+{
+	if (!l)
+		return;
+	free(l->path);
+	strbuf_release(&l->names);
+	free(l->entries);
+	free(l);
+}
+
+/*
+ * Read the directory `l->path` into `l`. Entries without a type are
+ * lstat()'ed when `resolve` is set, which is what makes the read-ahead
+ * worthwhile on filesystems that do not report d_type.
+ */
+static void read_dir_listing(struct dir_listing *l, int resolve)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	DIR *fdir;
+	size_t baselen;
+
+	fdir = opendir(*l->path ? l->path : ".");
+	if (!fdir) {
+		l->err = errno;
+		return;
+	}
+
+	strbuf_addstr(&path, l->path);
+	baselen = path.len;
+	while ((de = readdir_skip_dot_and_dotdot(fdir))) {
+		struct dir_listing_entry *e;
+
+		ALLOC_GROW(l->entries, l->nr + 1, l->alloc);
+		e = &l->entries[l->nr++];
+		e->name_off = l->names.len;
+		e->d_type = DTYPE(de);
+		strbuf_addstr(&l->names, de->d_name);
+		strbuf_addch(&l->names, '\0');
+
+		if (e->d_type == DT_UNKNOWN && resolve) {
+			struct stat st;
+
+			strbuf_setlen(&path, baselen);
+			strbuf_addstr(&path, de->d_name);
+			if (!lstat(path.buf, &st)) {
+				if (S_ISREG(st.st_mode))
+					e->d_type = DT_REG;
+				else if (S_ISDIR(st.st_mode))
+					e->d_type = DT_DIR;
+				else if (S_ISLNK(st.st_mode))
+					e->d_type = DT_LNK;
+			}
+		}
+	}
+	closedir(fdir);
+	strbuf_release(&path);
+}
+
+static void *dir_readahead_thread(void *data)
+{
+	struct dir_readahead *ra = data;
+
+	pthread_mutex_lock(&ra->mutex);
+	for (;;) {
+		struct dir_listing *l;
+
+		while (!ra->queue_nr && !ra->shutdown)
+			pthread_cond_wait(&ra->queued, &ra->mutex);
+		if (ra->shutdown)
+			break;
+
+		l = ra->queue[--ra->queue_nr];
+		l->state = LISTING_READING;
+		pthread_mutex_unlock(&ra->mutex);
+
+		read_dir_listing(l, 1);
+
+		pthread_mutex_lock(&ra->mutex);
+		l->state = LISTING_DONE;
+		pthread_cond_broadcast(&ra->done);
+	}
+	pthread_mutex_unlock(&ra->mutex);
+
+	return NULL;
+}
+
+static struct dir_readahead *dir_readahead_start(int nr_threads)
+{
+	struct dir_readahead *ra;
+	int i;
+
+	CALLOC_ARRAY(ra, 1);
+	pthread_mutex_init(&ra->mutex, NULL);
+	pthread_cond_init(&ra->queued, NULL);
+	pthread_cond_init(&ra->done, NULL);
+	hashmap_init(&ra->listings, dir_listing_cmp, NULL, 0);
+
+	CALLOC_ARRAY(ra->threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&ra->threads[i], NULL, dir_readahead_thread, ra))
+			break;
+		ra->nr_threads++;
+	}
+	return ra;
+}
+
+static void dir_readahead_stop(struct dir_readahead *ra)
+{
+	struct hashmap_iter iter;
+	struct dir_listing *l;
+	int i;
+
+	if (!ra)
+		return;
+
+	pthread_mutex_lock(&ra->mutex);
+	ra->shutdown = 1;
+	pthread_cond_broadcast(&ra->queued);
+	pthread_mutex_unlock(&ra->mutex);
+	for (i = 0; i < ra->nr_threads; i++)
+		pthread_join(ra->threads[i], NULL);
+
+	hashmap_for_each_entry(&ra->listings, &iter, l, ent)
+		free_dir_listing(l);
+	hashmap_clear(&ra->listings);
+	pthread_mutex_destroy(&ra->mutex);
+	pthread_cond_destroy(&ra->queued);
+	pthread_cond_destroy(&ra->done);
+	free(ra->threads);
+	free(ra->queue);
+	free(ra);
+}
+
+/*
+ * Take the listing of `path` for the traversal. A listing that has not
+ * been picked up by a worker yet is read right away instead of waiting.
+ */
+static struct dir_listing *dir_readahead_take(struct dir_readahead *ra,
+					      const char *path)
+{
+	struct dir_listing *l;
+	int read_here = 0;
+
+	pthread_mutex_lock(&ra->mutex);
+	l = hashmap_get_entry_from_hash(&ra->listings, strhash(path), path,
+					struct dir_listing, ent);
+	if (l) {
+		hashmap_remove(&ra->listings, &l->ent, path);
+		if (l->state == LISTING_QUEUED) {
+			size_t i = ra->queue_nr;
+
+			while (ra->queue[--i] != l)
+				; /* it is usually at the top */
+			MOVE_ARRAY(ra->queue + i, ra->queue + i + 1,
+				   ra->queue_nr - i - 1);
+			ra->queue_nr--;
+			read_here = 1;
+		} else {
+			while (l->state != LISTING_DONE)
+				pthread_cond_wait(&ra->done, &ra->mutex);
+		}
+	}
+	pthread_mutex_unlock(&ra->mutex);
+
+	if (!l) {
+		CALLOC_ARRAY(l, 1);
+		l->path = xstrdup(path);
+		strbuf_init(&l->names, 0);
+		read_here = 1;
+	}
+	if (read_here)
+		read_dir_listing(l, 0);
+	return l;
+}
+
+/*
+ * Queue the subdirectories in listing `l` (read from `path`) that the
+ * traversal may descend into.
+ */
+static void dir_readahead_queue_subdirs(struct dir_readahead *ra,
+					struct strbuf *path,
+					struct dir_listing *l,
+					const struct pathspec *pathspec)
+{
+	size_t baselen = path->len, i;
+
+	if (!ra->nr_threads)
+		return;
+
+	pthread_mutex_lock(&ra->mutex);
+	/* queue them in reverse so that the first one is read first */
+	for (i = l->nr; i--; ) {
+		const char *name = l->names.buf + l->entries[i].name_off;
+		struct dir_listing *sub;
+
+		if (l->entries[i].d_type != DT_DIR || !fspathcmp(name, ".git"))
+			continue;
+		strbuf_setlen(path, baselen);
+		strbuf_addstr(path, name);
+		if (simplify_away(path->buf, path->len, pathspec))
+			continue;
+		strbuf_addch(path, '/');
+		if (hashmap_get_from_hash(&ra->listings, strhash(path->buf),
+					  path->buf))
+			continue;
+
+		CALLOC_ARRAY(sub, 1);
+		sub->path = xstrdup(path->buf);
+		strbuf_init(&sub->names, 0);
+		hashmap_entry_init(&sub->ent, strhash(sub->path));
+		hashmap_add(&ra->listings, &sub->ent);
+		ALLOC_GROW(ra->queue, ra->queue_nr + 1, ra->queue_alloc);
+		ra->queue[ra->queue_nr++] = sub;
+	}
+	pthread_cond_broadcast(&ra->queued);
+	pthread_mutex_unlock(&ra->mutex);
+	strbuf_setlen(path, baselen);
+}
+
 static int open_cached_dir(struct cached_dir *cdir,
 			   struct dir_struct *dir,
 			   struct untracked_cache_dir *untracked,
 			   struct index_state *istate,
 			   struct strbuf *path,
-			   int check_only)
+			   int check_only,
+			   const struct pathspec *pathspec)
 {
 	const char *c_path;
 
@@ -2545,14 +2825,28 @@ static int open_cached_dir(struct cached_dir *cdir,
 	if (valid_cached_dir(dir, untracked, istate, path, check_only))
 		return 0;
 	c_path = path->len ? path->buf : ".";
-	cdir->fdir = opendir(c_path);
-	if (!cdir->fdir)
+	if (dir->internal.readahead) {
+		cdir->listing = dir_readahead_take(dir->internal.readahead,
+						   path->buf);
+		if (cdir->listing->err) {
+			int err = cdir->listing->err;
+
+			FREE_AND_NULL(cdir->listing);
+			errno = err;
+		} else {
+			dir_readahead_queue_subdirs(dir->internal.readahead,
+						    path, cdir->listing, pathspec);
+		}
+	} else {
+		cdir->fdir = opendir(c_path);
+	}
+	if (!cdir->fdir && !cdir->listing)
 		warning_errno(_("could not open directory '%s'"), c_path);
 	if (dir->untracked) {
 		invalidate_directory(dir->untracked, untracked);
 		dir->untracked->dir_opened++;
 	}
-	if (!cdir->fdir)
+	if (!cdir->fdir && !cdir->listing)
 		return -1;
 	return 0;
 }
@@ -2561,6 +2855,19 @@ static int read_cached_dir(struct cached_dir *cdir)
 {
 	struct dirent *de;
 
+	if (cdir->listing) {
+		struct dir_listing *l = cdir->listing;
+
+		if (l->pos == l->nr) {
+			cdir->d_name = NULL;
+			cdir->d_type = DT_UNKNOWN;
+			return -1;
+		}
+		cdir->d_name = l->names.buf + l->entries[l->pos].name_off;
+		cdir->d_type = l->entries[l->pos].d_type;
+		l->pos++;
+		return 0;
+	}
 	if (cdir->fdir) {
 		de = readdir_skip_dot_and_dotdot(cdir->fdir);
 		if (!de) {
@@ -2595,6 +2902,7 @@ static void close_cached_dir(struct cached_dir *cdir)
 {
 	if (cdir->fdir)
 		closedir(cdir->fdir);
+	free_dir_listing(cdir->listing);
 	/*
 	 * We have gone through this directory and found no untracked
 	 * entries. Mark it valid.
@@ -2630,7 +2938,7 @@ static void add_path_to_appropriate_result_list(struct dir_struct *dir,
 		if (dir->flags & DIR_SHOW_IGNORED)
 			break;
 		dir_add_name(dir, istate, path->buf, path->len);
-		if (cdir->fdir)
+		if (cdir->fdir || cdir->listing)
 			add_untracked(untracked, path->buf + baselen);
 		break;
 
@@ -2674,7 +2982,8 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 	strbuf_add(&path, base, baselen);
 
-	if (open_cached_dir(&cdir, dir, untracked, istate, &path, check_only))
+	if (open_cached_dir(&cdir, dir, untracked, istate, &path, check_only,
+			    pathspec))
 		goto out;
 	dir->internal.visited_directories++;
 
@@ -2736,7 +3045,7 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 
 			/* abort early if maximum state has been reached */
 			if (dir_state == path_untracked) {
-				if (cdir.fdir)
+				if (cdir.fdir || cdir.listing)
 					add_untracked(untracked, path.buf + baselen);
 				break;
 			}
@@ -3095,6 +3404,21 @@ static void emit_traversal_statistics(struct dir_struct *dir,
 			   "opendir", dir->untracked->dir_opened);
 }
 
+static int untracked_scan_threads(struct repository *r)
+{
+	int nr_threads;
+
+	/* the setting is per repository, e.g. not for "grep --no-index" */
+	if (!HAVE_THREADS || !r || !r->gitdir)
+		return 1;
+
+	prepare_repo_settings(r);
+	nr_threads = r->settings.untracked_scan_threads;
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
 int read_directory(struct dir_struct *dir, struct index_state *istate,
 		   const char *path, int len, const struct pathspec *pathspec)
 {
@@ -3116,8 +3440,20 @@ int read_directory(struct dir_struct *dir, struct index_state *istate,
 		 * e.g. prep_exclude()
 		 */
 		dir->untracked = NULL;
-	if (!len || treat_leading_path(dir, istate, path, len, pathspec))
+	if (!len || treat_leading_path(dir, istate, path, len, pathspec)) {
+		int nr_threads = untracked_scan_threads(istate->repo);
+
+		/*
+		 * The untracked cache records the stat data of the
+		 * directories it reads, which must not be newer than
+		 * their listings; do not read ahead when it is in use.
+		 */
+		if (nr_threads > 1 && !dir->untracked)
+			dir->internal.readahead = dir_readahead_start(nr_threads);
 		read_directory_recursive(dir, istate, path, len, untracked, 0, 0, pathspec);
+		dir_readahead_stop(dir->internal.readahead);
+		dir->internal.readahead = NULL;
+	}
 	QSORT(dir->entries, dir->nr, cmp_dir_entry);
 	QSORT(dir->ignored, dir->ignored_nr, cmp_dir_entry);
 
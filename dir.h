@@ -7,6 +7,7 @@
 #include "statinfo.h"
 #include "strbuf.h"
 
+struct dir_readahead;
 struct repository;
 
 /**
@@ -353,6 +354,9 @@ struct dir_struct {
 		/* Stats about the traversal */
 		unsigned visited_paths;
 		unsigned visited_directories;
+
+		/* Reads directories ahead of the traversal, if enabled. */
+		struct dir_readahead *readahead;
 	} internal;
 };
 
@@ -617,6 +617,7 @@ void enable_obj_read_lock(void)
 
 	obj_read_use_lock = 1;
 	init_recursive_mutex(&obj_read_mutex);
+	enable_delta_base_cache_lock();
 }
 
 void disable_obj_read_lock(void)
@@ -626,6 +627,7 @@ void disable_obj_read_lock(void)
 
 	obj_read_use_lock = 0;
 	pthread_mutex_destroy(&obj_read_mutex);
+	disable_delta_base_cache_lock();
 }
 
 int fetch_if_missing = 1;
@@ -27,6 +27,7 @@
 #include "strmap.h"
 #include "midx.h"
 #include "pack-revindex.h"
+#include "thread-utils.h"
 
 struct bitmapped_commit {
 	struct commit *commit;
@@ -59,6 +60,21 @@ void bitmap_writer_init(struct bitmap_writer *writer, struct repository *r,
 	string_list_init_dup(&writer->pseudo_merge_groups);
 
 	load_pseudo_merges_from_config(r, &writer->pseudo_merge_groups);
+
+	if (repo_config_get_int(r, "pack.writebitmapthreads",
+				&writer->nr_threads))
+		writer->nr_threads = 0;
+	if (writer->nr_threads < 0)
+		die(_("invalid number of threads specified (%d) for %s"),
+		    writer->nr_threads, "pack.writeBitmapThreads");
+	if (!HAVE_THREADS) {
+		if (writer->nr_threads > 1)
+			warning(_("no threads support, ignoring %s"),
+				"pack.writeBitmapThreads");
+		writer->nr_threads = 1;
+	}
+	if (!writer->nr_threads)
+		writer->nr_threads = online_cpus();
 }
 
 static void free_pseudo_merge_commit_idx(struct pseudo_merge_commit_idx *idx)
@@ -249,49 +265,109 @@ static uint32_t find_object_pos(struct bitmap_writer *writer,
 	return 0;
 }
 
-static void compute_xor_offsets(struct bitmap_writer *writer)
+/*
+ * Find the best XOR base among the preceding bitmaps for the bitmap at
+ * position "next". The scratch bitmaps come from the EWAH pool unless
+ * "threaded" is set, as the pool is not safe to share between threads.
+ */
+static void compute_xor_offset(struct bitmap_writer *writer, int next,
+			       int threaded)
 {
 	static const int MAX_XOR_OFFSET_SEARCH = 10;
 
-	int i, next = 0;
-
-	while (next < writer->selected_nr) {
-		struct bitmapped_commit *stored = &writer->selected[next];
-		int best_offset = 0;
-		struct ewah_bitmap *best_bitmap = stored->bitmap;
-		struct ewah_bitmap *test_xor;
+	struct bitmapped_commit *stored = &writer->selected[next];
+	int i, best_offset = 0;
+	struct ewah_bitmap *best_bitmap = stored->bitmap;
+	struct ewah_bitmap *test_xor;
 
-		if (stored->pseudo_merge)
-			goto next;
+	if (stored->pseudo_merge)
+		goto done;
 
-		for (i = 1; i <= MAX_XOR_OFFSET_SEARCH; ++i) {
-			int curr = next - i;
+	for (i = 1; i <= MAX_XOR_OFFSET_SEARCH; ++i) {
+		int curr = next - i;
 
-			if (curr < 0)
-				break;
-			if (writer->selected[curr].pseudo_merge)
-				continue;
+		if (curr < 0)
+			break;
+		if (writer->selected[curr].pseudo_merge)
+			continue;
 
-			test_xor = ewah_pool_new();
-			ewah_xor(writer->selected[curr].bitmap, stored->bitmap, test_xor);
+		test_xor = threaded ? ewah_new() : ewah_pool_new();
+		ewah_xor(writer->selected[curr].bitmap, stored->bitmap, test_xor);
 
-			if (test_xor->buffer_size < best_bitmap->buffer_size) {
-				if (best_bitmap != stored->bitmap)
+		if (test_xor->buffer_size < best_bitmap->buffer_size) {
+			if (best_bitmap != stored->bitmap) {
+				if (threaded)
+					ewah_free(best_bitmap);
+				else
 					ewah_pool_free(best_bitmap);
-
-				best_bitmap = test_xor;
-				best_offset = i;
-			} else {
-				ewah_pool_free(test_xor);
 			}
+
+			best_bitmap = test_xor;
+			best_offset = i;
+		} else if (threaded) {
+			ewah_free(test_xor);
+		} else {
+			ewah_pool_free(test_xor);
 		}
+	}
 
-next:
-		stored->xor_offset = best_offset;
-		stored->write_as = best_bitmap;
+done:
+	stored->xor_offset = best_offset;
+	stored->write_as = best_bitmap;
+}
+
+struct xor_offsets_thread_data {
+	pthread_t pthread;
+	struct bitmap_writer *writer;
+	int offset, stride;
+};
+
+static void *compute_xor_offsets_thread(void *_data)
+{
+	struct xor_offsets_thread_data *data = _data;
+	int i;
 
-		next++;
+	trace2_thread_start("bitmap-xor");
+	for (i = data->offset; i < data->writer->selected_nr; i += data->stride)
+		compute_xor_offset(data->writer, i, 1);
+	trace2_thread_exit();
+	return NULL;
+}
+
+static void compute_xor_offsets(struct bitmap_writer *writer)
+{
+	struct xor_offsets_thread_data *data;
+	int i, nr_threads = writer->nr_threads;
+
+	if (nr_threads > writer->selected_nr)
+		nr_threads = writer->selected_nr;
+
+	if (nr_threads <= 1) {
+		for (i = 0; i < writer->selected_nr; i++)
+			compute_xor_offset(writer, i, 0);
+		return;
+	}
+
+	/*
+	 * Each bitmap only reads its predecessors' "bitmap" and writes its
+	 * own "write_as", so the searches are independent and the result
+	 * does not depend on how they are scheduled.
+	 */
+	CALLOC_ARRAY(data, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret;
+
+		data[i].writer = writer;
+		data[i].offset = i;
+		data[i].stride = nr_threads;
+		ret = pthread_create(&data[i].pthread, NULL,
+				     compute_xor_offsets_thread, &data[i]);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
 	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(data[i].pthread, NULL);
+	free(data);
 }
 
 struct bb_commit {
@@ -302,6 +378,7 @@ struct bb_commit {
 		 maximal:1,
 		 pseudo_merge:1;
 	unsigned idx; /* within selected array */
+	unsigned pos; /* within bitmap_builder.commits, when threaded */
 };
 
 static void clear_bb_commit(struct bb_commit *commit)
@@ -506,6 +583,59 @@ static int fill_bitmap_tree(struct bitmap_writer *writer,
 	return 0;
 }
 
+/*
+ * Like fill_bitmap_tree(), but safe to call from several threads at once:
+ * tree contents are read into a private buffer rather than being parsed
+ * into the (shared) "struct tree", and no new objects are looked up.
+ */
+static int fill_bitmap_tree_oid(struct bitmap_writer *writer,
+				struct bitmap *bitmap,
+				const struct object_id *oid)
+{
+	int found, ret = 0;
+	uint32_t pos;
+	enum object_type type;
+	unsigned long size;
+	void *buf;
+	struct tree_desc desc;
+	struct name_entry entry;
+
+	pos = find_object_pos(writer, oid, &found);
+	if (!found)
+		return -1;
+	if (bitmap_get(bitmap, pos))
+		return 0;
+	bitmap_set(bitmap, pos);
+
+	buf = odb_read_object(writer->repo->objects, oid, &type, &size);
+	if (!buf || type != OBJ_TREE)
+		die("unable to load tree object %s", oid_to_hex(oid));
+	init_tree_desc(&desc, oid, buf, size);
+
+	while (tree_entry(&desc, &entry)) {
+		switch (object_type(entry.mode)) {
+		case OBJ_TREE:
+			ret = fill_bitmap_tree_oid(writer, bitmap, &entry.oid);
+			break;
+		case OBJ_BLOB:
+			pos = find_object_pos(writer, &entry.oid, &found);
+			if (!found)
+				ret = -1;
+			else
+				bitmap_set(bitmap, pos);
+			break;
+		default:
+			/* Gitlink, etc; not reachable */
+			break;
+		}
+		if (ret < 0)
+			break;
+	}
+
+	free(buf);
+	return ret;
+}
+
 static int reused_bitmaps_nr;
 static int reused_pseudo_merge_bitmaps_nr;
 
@@ -515,7 +645,8 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 			      struct prio_queue *queue,
 			      struct prio_queue *tree_queue,
 			      struct bitmap_index *old_bitmap,
-			      const uint32_t *mapping)
+			      const uint32_t *mapping,
+			      pthread_mutex_t *lock)
 {
 	int found;
 	uint32_t pos;
@@ -532,10 +663,15 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 			struct ewah_bitmap *old;
 			struct bitmap *remapped = bitmap_new();
 
+			/* old bitmaps are loaded lazily */
+			if (lock)
+				pthread_mutex_lock(lock);
 			if (commit->object.flags & BITMAP_PSEUDO_MERGE)
 				old = pseudo_merge_bitmap_for_commit(old_bitmap, c);
 			else
 				old = bitmap_for_commit(old_bitmap, c);
+			if (lock)
+				pthread_mutex_unlock(lock);
 			/*
 			 * If this commit has an old bitmap, then translate that
 			 * bitmap and add its bits to this one. No need to walk
@@ -544,10 +680,14 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 			if (old && !rebuild_bitmap(mapping, old, remapped)) {
 				bitmap_or(ent->bitmap, remapped);
 				bitmap_free(remapped);
+				if (lock)
+					pthread_mutex_lock(lock);
 				if (commit->object.flags & BITMAP_PSEUDO_MERGE)
 					reused_pseudo_merge_bitmaps_nr++;
 				else
 					reused_bitmaps_nr++;
+				if (lock)
+					pthread_mutex_unlock(lock);
 				continue;
 			}
 			bitmap_free(remapped);
@@ -558,12 +698,20 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 		 * walk ensures we cover all parents.
 		 */
 		if (!(c->object.flags & BITMAP_PSEUDO_MERGE)) {
+			struct tree *tree;
+
 			pos = find_object_pos(writer, &c->object.oid, &found);
 			if (!found)
 				return -1;
 			bitmap_set(ent->bitmap, pos);
-			prio_queue_put(tree_queue,
-				       repo_get_commit_tree(writer->repo, c));
+
+			/* the tree may have to be looked up from the commit-graph */
+			if (lock)
+				pthread_mutex_lock(lock);
+			tree = repo_get_commit_tree(writer->repo, c);
+			if (lock)
+				pthread_mutex_unlock(lock);
+			prio_queue_put(tree_queue, tree);
 		}
 
 		for (p = c->parents; p; p = p->next) {
@@ -579,9 +727,15 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 	}
 
 	while (tree_queue->nr) {
-		if (fill_bitmap_tree(writer, ent->bitmap,
-				     prio_queue_get(tree_queue)) < 0)
+		struct tree *tree = prio_queue_get(tree_queue);
+
+		if (lock) {
+			if (fill_bitmap_tree_oid(writer, ent->bitmap,
+						 &tree->object.oid) < 0)
+				return -1;
+		} else if (fill_bitmap_tree(writer, ent->bitmap, tree) < 0) {
 			return -1;
+		}
 	}
 	return 0;
 }
@@ -605,40 +759,26 @@ static void store_selected(struct bitmap_writer *writer,
 	kh_value(writer->bitmaps, hash_pos) = stored;
 }
 
-int bitmap_writer_build(struct bitmap_writer *writer)
+static int build_bitmaps_serial(struct bitmap_writer *writer,
+				struct bitmap_builder *bb,
+				struct bitmap_index *old_bitmap,
+				const uint32_t *mapping)
 {
-	struct bitmap_builder bb;
 	size_t i;
 	int nr_stored = 0; /* for progress */
 	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 	struct prio_queue tree_queue = { NULL };
-	struct bitmap_index *old_bitmap;
-	uint32_t *mapping = NULL;
-	int closed = 1; /* until proven otherwise */
+	int ret = 0;
 
-	if (writer->show_progress)
-		writer->progress = start_progress(writer->repo,
-						  "Building bitmaps",
-						  writer->selected_nr);
-	trace2_region_enter("pack-bitmap-write", "building_bitmaps_total",
-			    writer->repo);
-
-	old_bitmap = prepare_bitmap_git(writer->to_pack->repo);
-	if (old_bitmap)
-		mapping = create_bitmap_mapping(old_bitmap, writer->to_pack);
-	else
-		mapping = NULL;
-
-	bitmap_builder_init(&bb, writer, old_bitmap);
-	for (i = bb.commits_nr; i > 0; i--) {
-		struct commit *commit = bb.commits[i-1];
-		struct bb_commit *ent = bb_data_at(&bb.data, commit);
+	for (i = bb->commits_nr; i > 0; i--) {
+		struct commit *commit = bb->commits[i-1];
+		struct bb_commit *ent = bb_data_at(&bb->data, commit);
 		struct commit *child;
 		int reused = 0;
 
 		if (fill_bitmap_commit(writer, ent, commit, &queue, &tree_queue,
-				       old_bitmap, mapping) < 0) {
-			closed = 0;
+				       old_bitmap, mapping, NULL) < 0) {
+			ret = -1;
 			break;
 		}
 
@@ -650,7 +790,7 @@ int bitmap_writer_build(struct bitmap_writer *writer)
 
 		while ((child = pop_commit(&ent->reverse_edges))) {
 			struct bb_commit *child_ent =
-				bb_data_at(&bb.data, child);
+				bb_data_at(&bb->data, child);
 
 			if (child_ent->bitmap)
 				bitmap_or(child_ent->bitmap, ent->bitmap);
@@ -667,6 +807,256 @@ int bitmap_writer_build(struct bitmap_writer *writer)
 	}
 	clear_prio_queue(&queue);
 	clear_prio_queue(&tree_queue);
+
+	return ret;
+}
+
+/*
+ * A maximal commit whose bitmap is built by one of the worker threads.
+ * Its bitmap starts out as the union of the bitmaps of its "inputs"
+ * (the commits whose "reverse_edges" name it), so it may only be built
+ * once all of those are done.
+ */
+struct bitmap_build_task {
+	struct commit *commit;
+	struct bb_commit *ent;
+
+	struct bitmap_build_task **inputs;
+	size_t inputs_nr, inputs_alloc;
+	struct bitmap_build_task **outputs;
+	size_t outputs_nr, outputs_alloc;
+
+	size_t pending; /* inputs not yet built */
+	size_t unread; /* outputs that have not yet read our bitmap */
+};
+
+struct bitmap_build_state {
+	struct bitmap_writer *writer;
+	struct bitmap_index *old_bitmap;
+	const uint32_t *mapping;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	struct bitmap_build_task **ready;
+	size_t ready_nr;
+	size_t remaining;
+	int nr_stored; /* for progress */
+	int failed;
+};
+
+static void release_build_inputs(struct bitmap_build_task *task)
+{
+	size_t i;
+
+	for (i = 0; i < task->inputs_nr; i++) {
+		struct bitmap_build_task *in = task->inputs[i];
+
+		if (!--in->unread) {
+			bitmap_free(in->ent->bitmap);
+			in->ent->bitmap = NULL;
+		}
+	}
+}
+
+static void *build_bitmaps_thread(void *_data)
+{
+	struct bitmap_build_state *state = _data;
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct prio_queue tree_queue = { NULL };
+
+	trace2_thread_start("bitmap-build");
+
+	pthread_mutex_lock(&state->mutex);
+	for (;;) {
+		struct bitmap_build_task *task;
+		struct bb_commit *ent;
+		size_t i;
+		int ret;
+
+		while (!state->ready_nr && state->remaining && !state->failed)
+			pthread_cond_wait(&state->cond, &state->mutex);
+		if (state->failed || !state->ready_nr)
+			break;
+
+		task = state->ready[--state->ready_nr];
+		ent = task->ent;
+		pthread_mutex_unlock(&state->mutex);
+
+		for (i = 0; i < task->inputs_nr; i++) {
+			struct bitmap *in = task->inputs[i]->ent->bitmap;
+
+			if (ent->bitmap)
+				bitmap_or(ent->bitmap, in);
+			else
+				ent->bitmap = bitmap_dup(in);
+		}
+
+		pthread_mutex_lock(&state->mutex);
+		release_build_inputs(task);
+		pthread_mutex_unlock(&state->mutex);
+
+		ret = fill_bitmap_commit(state->writer, ent, task->commit,
+					 &queue, &tree_queue, state->old_bitmap,
+					 state->mapping, &state->mutex);
+
+		/*
+		 * Nobody adds to writer->bitmaps while we are building, so
+		 * the lookup in store_selected() is safe without the lock,
+		 * and the EWAH compression can run in parallel.
+		 */
+		if (!ret && ent->selected)
+			store_selected(state->writer, ent, task->commit);
+
+		pthread_mutex_lock(&state->mutex);
+		if (ret < 0) {
+			state->failed = 1;
+			pthread_cond_broadcast(&state->cond);
+			break;
+		}
+
+		if (ent->selected)
+			display_progress(state->writer->progress,
+					 ++state->nr_stored);
+
+		task->unread = task->outputs_nr;
+		if (!task->unread) {
+			bitmap_free(ent->bitmap);
+			ent->bitmap = NULL;
+		}
+		for (i = 0; i < task->outputs_nr; i++) {
+			struct bitmap_build_task *out = task->outputs[i];
+
+			if (!--out->pending)
+				state->ready[state->ready_nr++] = out;
+		}
+		state->remaining--;
+		pthread_cond_broadcast(&state->cond);
+	}
+	pthread_mutex_unlock(&state->mutex);
+
+	clear_prio_queue(&queue);
+	clear_prio_queue(&tree_queue);
+
+	trace2_thread_exit();
+	return NULL;
+}
+
+static int build_bitmaps_threaded(struct bitmap_writer *writer,
+				  struct bitmap_builder *bb,
+				  struct bitmap_index *old_bitmap,
+				  const uint32_t *mapping)
+{
+	struct bitmap_build_state state = {
+		.writer = writer,
+		.old_bitmap = old_bitmap,
+		.mapping = mapping,
+	};
+	struct bitmap_build_task *tasks;
+	pthread_t *threads;
+	int i, nr_threads = writer->nr_threads;
+	size_t j;
+
+	if (nr_threads > bb->commits_nr)
+		nr_threads = bb->commits_nr;
+
+	CALLOC_ARRAY(tasks, bb->commits_nr);
+	for (j = 0; j < bb->commits_nr; j++) {
+		tasks[j].commit = bb->commits[j];
+		tasks[j].ent = bb_data_at(&bb->data, bb->commits[j]);
+		tasks[j].ent->pos = j;
+	}
+
+	for (j = 0; j < bb->commits_nr; j++) {
+		struct bitmap_build_task *task = &tasks[j];
+		struct commit *child;
+
+		while ((child = pop_commit(&task->ent->reverse_edges))) {
+			struct bb_commit *child_ent = bb_data_at(&bb->data, child);
+			struct bitmap_build_task *out = &tasks[child_ent->pos];
+
+			if (out->commit != child)
+				BUG("bitmap for '%s' has no builder",
+				    oid_to_hex(&child->object.oid));
+
+			ALLOC_GROW(task->outputs, task->outputs_nr + 1,
+				   task->outputs_alloc);
+			task->outputs[task->outputs_nr++] = out;
+			ALLOC_GROW(out->inputs, out->inputs_nr + 1,
+				   out->inputs_alloc);
+			out->inputs[out->inputs_nr++] = task;
+			out->pending++;
+		}
+	}
+
+	/*
+	 * Queue up the commits that can be built right away such that the
+	 * last one queued, which is picked up first, is the one the serial
+	 * builder would start with.
+	 */
+	ALLOC_ARRAY(state.ready, bb->commits_nr);
+	for (j = 0; j < bb->commits_nr; j++)
+		if (!tasks[j].pending)
+			state.ready[state.ready_nr++] = &tasks[j];
+	state.remaining = bb->commits_nr;
+
+	pthread_mutex_init(&state.mutex, NULL);
+	pthread_cond_init(&state.cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&threads[i], NULL,
+					 build_bitmaps_thread, &state);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.mutex);
+
+	for (j = 0; j < bb->commits_nr; j++) {
+		free(tasks[j].inputs);
+		free(tasks[j].outputs);
+	}
+	free(tasks);
+	free(threads);
+	free(state.ready);
+
+	return state.failed ? -1 : 0;
+}
+
+int bitmap_writer_build(struct bitmap_writer *writer)
+{
+	struct bitmap_builder bb;
+	struct bitmap_index *old_bitmap;
+	uint32_t *mapping = NULL;
+	int closed = 1; /* until proven otherwise */
+	int ret;
+
+	if (writer->show_progress)
+		writer->progress = start_progress(writer->repo,
+						  "Building bitmaps",
+						  writer->selected_nr);
+	trace2_region_enter("pack-bitmap-write", "building_bitmaps_total",
+			    writer->repo);
+
+	old_bitmap = prepare_bitmap_git(writer->to_pack->repo);
+	if (old_bitmap)
+		mapping = create_bitmap_mapping(old_bitmap, writer->to_pack);
+	else
+		mapping = NULL;
+
+	bitmap_builder_init(&bb, writer, old_bitmap);
+	if (writer->nr_threads > 1 && bb.commits_nr > 1)
+		ret = build_bitmaps_threaded(writer, &bb, old_bitmap, mapping);
+	else
+		ret = build_bitmaps_serial(writer, &bb, old_bitmap, mapping);
+	if (ret < 0)
+		closed = 0;
 	bitmap_builder_clear(&bb);
 	free_bitmap_index(old_bitmap);
 	free(mapping);
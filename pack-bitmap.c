@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "commit.h"
+#include "commit-reach.h"
 #include "gettext.h"
 #include "hex.h"
 #include "strbuf.h"
@@ -2636,6 +2637,126 @@ void count_bitmap_commit_list(struct bitmap_index *bitmap_git,
 		*tags = count_object_type(bitmap_git, OBJ_TAG);
 }
 
+static uint32_t count_commits_and_not(struct bitmap_index *bitmap_git,
+				      struct bitmap *objects,
+				      struct bitmap *exclude)
+{
+	struct eindex *eindex = &bitmap_git->ext_index;
+
+	uint32_t i = 0, count = 0;
+	struct ewah_or_iterator it;
+	eword_t filter;
+
+	init_type_iterator(&it, bitmap_git, OBJ_COMMIT);
+
+	while (i < objects->word_alloc && ewah_or_iterator_next(&filter, &it)) {
+		eword_t word = objects->words[i] & filter;
+		if (i < exclude->word_alloc)
+			word &= ~exclude->words[i];
+		count += ewah_bit_popcount64(word);
+		i++;
+	}
+
+	for (i = 0; i < eindex->count; ++i) {
+		size_t pos = st_add(bitmap_num_objects_total(bitmap_git), i);
+
+		if (eindex->objects[i]->type == OBJ_COMMIT &&
+		    bitmap_get(objects, pos) && !bitmap_get(exclude, pos))
+			count++;
+	}
+
+	ewah_or_iterator_release(&it);
+
+	return count;
+}
+
+/*
+ * Compute the set of commits reachable from "commit". Only commits
+ * are walked; trees and blobs only show up in the result when they
+ * come from an on-disk bitmap.
+ */
+static struct bitmap *find_reachable_commits(struct bitmap_index *bitmap_git,
+					     struct commit *commit)
+{
+	struct rev_info revs;
+	struct object_list *roots = NULL;
+	struct bitmap *result;
+
+	repo_init_revisions(bitmap_repo(bitmap_git), &revs, NULL);
+	object_list_insert(&commit->object, &roots);
+
+	result = find_objects(bitmap_git, &revs, roots, NULL);
+	if (!result)
+		BUG("failed to perform bitmap walk");
+
+	clear_commit_marks(commit, ALL_REV_FLAGS);
+	object_list_free(&roots);
+	release_revisions(&revs);
+
+	return result;
+}
+
+int bitmap_ahead_behind(struct repository *r,
+			struct commit **commits, size_t commits_nr,
+			struct ahead_behind_count *counts, size_t counts_nr)
+{
+	struct bitmap_index *bitmap_git;
+	struct bitmap **reachable;
+	struct bitmap *is_base;
+	size_t i;
+
+	bitmap_git = prepare_bitmap_git(r);
+	if (!bitmap_git)
+		return -1;
+
+	trace2_region_enter("pack-bitmap", "ahead-behind", r);
+
+	CALLOC_ARRAY(reachable, commits_nr);
+	is_base = bitmap_word_alloc(DIV_ROUND_UP(commits_nr, BITS_IN_EWORD));
+	for (i = 0; i < counts_nr; i++)
+		bitmap_set(is_base, counts[i].base_index);
+
+	for (i = 0; i < counts_nr; i++) {
+		size_t tip = counts[i].tip_index;
+		size_t base = counts[i].base_index;
+
+		if (!reachable[tip])
+			reachable[tip] = find_reachable_commits(bitmap_git,
+								commits[tip]);
+		if (!reachable[base])
+			reachable[base] = find_reachable_commits(bitmap_git,
+								 commits[base]);
+
+		counts[i].ahead = count_commits_and_not(bitmap_git,
+							reachable[tip],
+							reachable[base]);
+		counts[i].behind = count_commits_and_not(bitmap_git,
+							 reachable[base],
+							 reachable[tip]);
+
+		/*
+		 * Counts are usually grouped by tip, and there can be
+		 * many more tips than bases. Keep only the bitmaps of
+		 * the bases around once we are done with a tip.
+		 */
+		if (!bitmap_get(is_base, tip) &&
+		    (i + 1 == counts_nr || counts[i + 1].tip_index != tip)) {
+			bitmap_free(reachable[tip]);
+			reachable[tip] = NULL;
+		}
+	}
+
+	for (i = 0; i < commits_nr; i++)
+		bitmap_free(reachable[i]);
+	free(reachable);
+	bitmap_free(is_base);
+	free_bitmap_index(bitmap_git);
+
+	trace2_region_leave("pack-bitmap", "ahead-behind", r);
+
+	return 0;
+}
+
 struct bitmap_test_data {
 	struct bitmap_index *bitmap_git;
 	struct bitmap *base;
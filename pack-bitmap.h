@@ -112,6 +112,18 @@ void reuse_partial_packfile_from_bitmap(struct bitmap_index *bitmap_git,
 int rebuild_existing_bitmaps(struct bitmap_index *, struct packing_data *mapping,
 			     kh_oid_map_t *reused_bitmaps, int show_progress);
 void free_bitmap_index(struct bitmap_index *);
+
+struct ahead_behind_count;
+
+/*
+ * Compute the ahead/behind counts of ahead_behind() from the
+ * reachability bitmaps of the repository. Returns -1 without touching
+ * "counts" if no bitmap is available.
+ */
+int bitmap_ahead_behind(struct repository *r,
+			struct commit **commits, size_t commits_nr,
+			struct ahead_behind_count *counts, size_t counts_nr);
+
 int bitmap_walk_contains(struct bitmap_index *,
 			 struct bitmap *bitmap, const struct object_id *oid);
 
@@ -144,6 +156,7 @@ struct bitmap_writer {
 
 	struct progress *progress;
 	int show_progress;
+	int nr_threads; /* from pack.writeBitmapThreads */
 	unsigned char pack_checksum[GIT_MAX_RAWSZ];
 };
 
@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "environment.h"
+#include "gettext.h"
 #include "hex.h"
 #include "repository.h"
 #include "pack.h"
@@ -9,6 +10,7 @@
 #include "packfile.h"
 #include "object-file.h"
 #include "odb.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -37,7 +39,13 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 		void *data = use_pack(p, w_curs, offset, &avail);
 		if (avail > len)
 			avail = len;
+		/*
+		 * The window is kept alive by w_curs, see the comment
+		 * in get_size_from_delta().
+		 */
+		obj_read_unlock();
 		data_crc = crc32(data_crc, data, avail);
+		obj_read_lock();
 		offset += avail;
 		len -= avail;
 	} while (len);
@@ -48,11 +56,174 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+/*
+ * Check a single object: its CRC (if the index records one), that it
+ * can be unpacked and that its contents hash to the name recorded in
+ * the index.  Then hand it to `fn`.
+ *
+ * When called from a worker thread, the caller has enabled the object
+ * read lock.  We hold it for everything that touches shared state
+ * (pack windows, the delta base cache and whatever `fn` does) and
+ * drop it for the expensive parts that do not: unpack_entry() drops
+ * it while inflating, and we drop it while computing the CRC and the
+ * object hash.
+ */
+static int verify_one_object(struct repository *r,
+			     struct packed_git *p,
+			     struct pack_window **w_curs,
+			     struct idx_entry *entries, uint32_t i,
+			     verify_fn fn)
+{
+	void *data;
+	struct object_id oid;
+	enum object_type type;
+	unsigned long size;
+	off_t curpos;
+	int data_valid;
+	int err = 0;
+
+	obj_read_lock();
+
+	if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
+		BUG("unable to get oid of object %lu from %s",
+		    (unsigned long)entries[i].nr, p->pack_name);
+
+	if (p->index_version > 1) {
+		off_t offset = entries[i].offset;
+		off_t len = entries[i+1].offset - offset;
+		unsigned int nr = entries[i].nr;
+		if (check_pack_crc(p, w_curs, offset, len, nr))
+			err = error("index CRC mismatch for object %s "
+				    "from %s at offset %"PRIuMAX"",
+				    oid_to_hex(&oid),
+				    p->pack_name, (uintmax_t)offset);
+	}
+
+	curpos = entries[i].offset;
+	type = unpack_object_header(p, w_curs, &curpos, &size);
+	unuse_pack(w_curs);
+
+	if (type == OBJ_BLOB &&
+	    repo_settings_get_big_file_threshold(r) <= size) {
+		/*
+		 * Let stream_object_signature() check it with
+		 * the streaming interface; no point slurping
+		 * the data in-core only to discard.
+		 */
+		data = NULL;
+		data_valid = 0;
+	} else {
+		data = unpack_entry(r, p, entries[i].offset, &type, &size);
+		data_valid = 1;
+	}
+
+	if (data_valid && !data) {
+		err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
+			    oid_to_hex(&oid), p->pack_name,
+			    (uintmax_t)entries[i].offset);
+		goto out;
+	}
+
+	if (data) {
+		int bad;
+
+		obj_read_unlock();
+		bad = check_object_signature(r, &oid, data, size, type) < 0;
+		obj_read_lock();
+		if (bad) {
+			err = error("packed %s from %s is corrupt",
+				    oid_to_hex(&oid), p->pack_name);
+			goto out;
+		}
+	} else if (stream_object_signature(r, &oid) < 0) {
+		err = error("packed %s from %s is corrupt",
+			    oid_to_hex(&oid), p->pack_name);
+		goto out;
+	}
+
+	if (fn) {
+		int eaten = 0;
+		err |= fn(&oid, type, size, data, &eaten);
+		if (eaten)
+			data = NULL;
+	}
+
+out:
+	obj_read_unlock();
+	free(data);
+	return err;
+}
+
+/*
+ * Objects are handed out to the worker threads in slices of this
+ * many consecutive entries (in pack order), which keeps each thread
+ * reading a contiguous region of the pack and lets delta chains
+ * mostly be resolved from bases that the same thread just unpacked.
+ */
+#define VERIFY_SLICE_SIZE 1024
+
+struct verify_pack_data {
+	struct repository *r;
+	struct packed_git *p;
+	struct idx_entry *entries;
+	uint32_t nr_objects;
+	verify_fn fn;
+	struct progress *progress;
+	uint32_t base_count;
+
+	/* protected by obj_read_lock() */
+	uint32_t next;
+	uint32_t done;
+};
+
+struct verify_thread_data {
+	pthread_t thread;
+	struct verify_pack_data *shared;
+	int err;
+};
+
+static void *verify_pack_thread(void *arg)
+{
+	struct verify_thread_data *me = arg;
+	struct verify_pack_data *d = me->shared;
+	struct pack_window *w_curs = NULL;
+
+	for (;;) {
+		uint32_t start, end;
+
+		obj_read_lock();
+		start = d->next;
+		end = start + VERIFY_SLICE_SIZE;
+		if (end > d->nr_objects)
+			end = d->nr_objects;
+		d->next = end;
+		obj_read_unlock();
+
+		if (start >= end)
+			break;
+
+		for (uint32_t i = start; i < end; i++)
+			me->err |= verify_one_object(d->r, d->p, &w_curs,
+						     d->entries, i, d->fn);
+
+		obj_read_lock();
+		d->done += end - start;
+		display_progress(d->progress, d->base_count + d->done);
+		obj_read_unlock();
+	}
+
+	obj_read_lock();
+	unuse_pack(&w_curs);
+	obj_read_unlock();
+	return NULL;
+}
+
 static int verify_packfile(struct repository *r,
 			   struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
 
 {
 	off_t index_size = p->index_size;
@@ -103,70 +274,46 @@ static int verify_packfile(struct repository *r,
 	}
 	QSORT(entries, nr_objects, compare_entries);
 
-	for (i = 0; i < nr_objects; i++) {
-		void *data;
-		struct object_id oid;
-		enum object_type type;
-		unsigned long size;
-		off_t curpos;
-		int data_valid;
-
-		if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
-			BUG("unable to get oid of object %lu from %s",
-			    (unsigned long)entries[i].nr, p->pack_name);
-
-		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(&oid),
-					    p->pack_name, (uintmax_t)offset);
-		}
+	if (nr_threads > DIV_ROUND_UP(nr_objects, VERIFY_SLICE_SIZE))
+		nr_threads = DIV_ROUND_UP(nr_objects, VERIFY_SLICE_SIZE);
 
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB &&
-		    repo_settings_get_big_file_threshold(r) <= size) {
-			/*
-			 * Let stream_object_signature() check it with
-			 * the streaming interface; no point slurping
-			 * the data in-core only to discard.
-			 */
-			data = NULL;
-			data_valid = 0;
-		} else {
-			data = unpack_entry(r, p, entries[i].offset, &type, &size);
-			data_valid = 1;
-		}
+	if (HAVE_THREADS && nr_threads > 1) {
+		struct verify_pack_data shared = {
+			.r = r,
+			.p = p,
+			.entries = entries,
+			.nr_objects = nr_objects,
+			.fn = fn,
+			.progress = progress,
+			.base_count = base_count,
+		};
+		struct verify_thread_data *threads;
 
-		if (data_valid && !data)
-			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(&oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
-							type) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (!data && stream_object_signature(r, &oid) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (fn) {
-			int eaten = 0;
-			err |= fn(&oid, type, size, data, &eaten);
-			if (eaten)
-				data = NULL;
-		}
-		if (((base_count + i) & 1023) == 0)
-			display_progress(progress, base_count + i);
-		free(data);
+		/* lazily initialized; make sure it happens before we fork off */
+		repo_settings_get_big_file_threshold(r);
 
+		CALLOC_ARRAY(threads, nr_threads);
+		enable_obj_read_lock();
+		for (i = 0; i < nr_threads; i++) {
+			threads[i].shared = &shared;
+			if (pthread_create(&threads[i].thread, NULL,
+					   verify_pack_thread, &threads[i]))
+				die(_("unable to create thread"));
+		}
+		for (i = 0; i < nr_threads; i++) {
+			pthread_join(threads[i].thread, NULL);
+			err |= threads[i].err;
+		}
+		disable_obj_read_lock();
+		free(threads);
+	} else {
+		for (i = 0; i < nr_objects; i++) {
+			err |= verify_one_object(r, p, w_curs, entries, i, fn);
+			if (((base_count + i) & 1023) == 0)
+				display_progress(progress, base_count + i);
+		}
 	}
-	display_progress(progress, base_count + i);
+	display_progress(progress, base_count + nr_objects);
 	free(entries);
 
 	return err;
@@ -187,7 +334,7 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count, int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -196,7 +343,8 @@ int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count);
+	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -0,0 +1,231 @@
+#include "git-compat-util.h"
+#include "chunk-format.h"
+#include "csum-file.h"
+#include "gettext.h"
+#include "odb.h"
+#include "pack-delta-hints.h"
+#include "packfile.h"
+#include "path.h"
+#include "repository.h"
+#include "strbuf.h"
+
+#define DELTA_HINTS_HEADER_SIZE 8
+#define DELTA_HINTS_BYTE_VERSION 4
+#define DELTA_HINTS_BYTE_HASH_VERSION 5
+#define DELTA_HINTS_BYTE_NUM_CHUNKS 6
+#define DELTA_HINTS_CHUNK_ALIGNMENT 4
+
+struct pack_delta_hints {
+	const unsigned char *data;
+	size_t data_len;
+	const struct git_hash_algo *algop;
+
+	uint32_t num_objects;
+	const unsigned char *chunk_offsets;
+	const unsigned char *chunk_bases;
+	uint32_t num_bases;
+};
+
+struct write_delta_hints_context {
+	const struct git_hash_algo *algop;
+	const struct delta_hint *hints;
+	uint32_t nr;
+};
+
+static int write_delta_hints_offsets(struct hashfile *f, void *data)
+{
+	struct write_delta_hints_context *ctx = data;
+	uint32_t end = 0;
+
+	for (uint32_t i = 0; i < ctx->nr; i++) {
+		for (int j = 0; j < DELTA_HINTS_MAX; j++)
+			if (ctx->hints[i].base[j])
+				end++;
+		hashwrite_be32(f, end);
+	}
+	return 0;
+}
+
+static int write_delta_hints_bases(struct hashfile *f, void *data)
+{
+	struct write_delta_hints_context *ctx = data;
+
+	for (uint32_t i = 0; i < ctx->nr; i++)
+		for (int j = 0; j < DELTA_HINTS_MAX; j++)
+			if (ctx->hints[i].base[j])
+				hashwrite(f, ctx->hints[i].base[j]->hash,
+					  ctx->algop->rawsz);
+	return 0;
+}
+
+void write_delta_hints_file(struct repository *r, const char *filename,
+			    const struct delta_hint *hints, uint32_t nr)
+{
+	struct write_delta_hints_context ctx = {
+		.algop = r->hash_algo,
+		.hints = hints,
+		.nr = nr,
+	};
+	struct strbuf tmp_file = STRBUF_INIT;
+	struct chunkfile *cf;
+	struct hashfile *f;
+	uint64_t num_bases = 0;
+	int fd;
+
+	for (uint32_t i = 0; i < nr; i++)
+		for (int j = 0; j < DELTA_HINTS_MAX; j++)
+			if (hints[i].base[j])
+				num_bases++;
+	if (num_bases > UINT32_MAX)
+		die(_("too many delta hints"));
+
+	fd = odb_mkstemp(r->objects, &tmp_file, "pack/tmp_dhints_XXXXXX");
+	f = hashfd(r->hash_algo, fd, tmp_file.buf);
+
+	cf = init_chunkfile(f);
+	add_chunk(cf, DELTA_HINTS_CHUNKID_OFFSETS,
+		  st_mult(nr, sizeof(uint32_t)), write_delta_hints_offsets);
+	add_chunk(cf, DELTA_HINTS_CHUNKID_BASES,
+		  st_mult(num_bases, r->hash_algo->rawsz),
+		  write_delta_hints_bases);
+
+	hashwrite_be32(f, DELTA_HINTS_SIGNATURE);
+	hashwrite_u8(f, DELTA_HINTS_VERSION);
+	hashwrite_u8(f, oid_version(r->hash_algo));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused */
+	write_chunkfile(cf, &ctx);
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_PACK_METADATA,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC | CSUM_CLOSE);
+	free_chunkfile(cf);
+
+	if (adjust_shared_perm(r, tmp_file.buf))
+		die_errno("unable to make temporary delta hints file readable");
+
+	if (rename(tmp_file.buf, filename))
+		die_errno("unable to rename temporary delta hints file to '%s'",
+			  filename);
+
+	strbuf_release(&tmp_file);
+}
+
+static char *pack_delta_hints_filename(struct packed_git *p)
+{
+	size_t len;
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		BUG("pack_name does not end in .pack");
+	return xstrfmt("%.*s.dhints", (int)len, p->pack_name);
+}
+
+struct pack_delta_hints *load_pack_delta_hints(struct packed_git *p)
+{
+	const struct git_hash_algo *algop = p->repo->hash_algo;
+	struct pack_delta_hints *hints = NULL;
+	struct chunkfile *cf = NULL;
+	const unsigned char *offsets, *bases;
+	size_t offsets_len, bases_len;
+	unsigned char *data = NULL;
+	size_t data_len = 0;
+	char *name = NULL;
+	struct stat st;
+	int fd;
+
+	if (open_pack_index(p))
+		return NULL;
+
+	name = pack_delta_hints_filename(p);
+	fd = git_open(name);
+	if (fd < 0)
+		goto cleanup;
+	if (fstat(fd, &st)) {
+		error_errno(_("failed to read %s"), name);
+		close(fd);
+		goto cleanup;
+	}
+
+	data_len = xsize_t(st.st_size);
+	if (data_len < DELTA_HINTS_HEADER_SIZE + algop->rawsz) {
+		error(_("delta hints file %s is too small"), name);
+		close(fd);
+		goto cleanup;
+	}
+
+	data = xmmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(data) != DELTA_HINTS_SIGNATURE) {
+		error(_("delta hints file %s has unknown signature"), name);
+		goto cleanup;
+	}
+	if (data[DELTA_HINTS_BYTE_VERSION] != DELTA_HINTS_VERSION) {
+		error(_("delta hints file %s has unsupported version %u"),
+		      name, data[DELTA_HINTS_BYTE_VERSION]);
+		goto cleanup;
+	}
+	if (data[DELTA_HINTS_BYTE_HASH_VERSION] != oid_version(algop)) {
+		error(_("delta hints file %s hash version %u does not match version %u"),
+		      name, data[DELTA_HINTS_BYTE_HASH_VERSION],
+		      oid_version(algop));
+		goto cleanup;
+	}
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, data, data_len,
+				   DELTA_HINTS_HEADER_SIZE,
+				   data[DELTA_HINTS_BYTE_NUM_CHUNKS],
+				   DELTA_HINTS_CHUNK_ALIGNMENT) ||
+	    pair_chunk(cf, DELTA_HINTS_CHUNKID_OFFSETS, &offsets, &offsets_len) ||
+	    pair_chunk(cf, DELTA_HINTS_CHUNKID_BASES, &bases, &bases_len) ||
+	    offsets_len != st_mult(p->num_objects, sizeof(uint32_t)) ||
+	    bases_len % algop->rawsz ||
+	    bases_len / algop->rawsz > UINT32_MAX) {
+		error(_("delta hints file %s is corrupt"), name);
+		goto cleanup;
+	}
+
+	CALLOC_ARRAY(hints, 1);
+	hints->data = data;
+	hints->data_len = data_len;
+	hints->algop = algop;
+	hints->num_objects = p->num_objects;
+	hints->chunk_offsets = offsets;
+	hints->chunk_bases = bases;
+	hints->num_bases = bases_len / algop->rawsz;
+
+cleanup:
+	if (!hints && data)
+		munmap(data, data_len);
+	free_chunkfile(cf);
+	free(name);
+	return hints;
+}
+
+uint32_t nth_packed_delta_hints(struct pack_delta_hints *hints, uint32_t pos,
+				struct object_id *bases, uint32_t nr)
+{
+	uint32_t start, end, i;
+
+	if (pos >= hints->num_objects)
+		BUG("delta hints out-of-bounds (%"PRIu32" vs %"PRIu32")",
+		    pos, hints->num_objects);
+
+	start = pos ? get_be32(hints->chunk_offsets + st_mult(pos - 1, 4)) : 0;
+	end = get_be32(hints->chunk_offsets + st_mult(pos, 4));
+	if (end < start || end > hints->num_bases)
+		return 0; /* corrupt; these are only hints */
+
+	for (i = 0; i < nr && i < end - start; i++)
+		oidread(&bases[i],
+			hints->chunk_bases + st_mult(start + i, hints->algop->rawsz),
+			hints->algop);
+	return i;
+}
+
+void free_pack_delta_hints(struct pack_delta_hints *hints)
+{
+	if (!hints)
+		return;
+	munmap((void *)hints->data, hints->data_len);
+	free(hints);
+}
@@ -0,0 +1,54 @@
+#ifndef PACK_DELTA_HINTS_H
+#define PACK_DELTA_HINTS_H
+
+#include "hash.h"
+
+#define DELTA_HINTS_SIGNATURE 0x44484e54 /* "DHNT" */
+#define DELTA_HINTS_VERSION 1
+
+#define DELTA_HINTS_CHUNKID_OFFSETS 0x44484f46 /* "DHOF" */
+#define DELTA_HINTS_CHUNKID_BASES 0x4448424f /* "DHBO" */
+
+/*
+ * Number of delta base candidates kept for each object: the base the
+ * object was stored against and the best base it had before that one.
+ */
+#define DELTA_HINTS_MAX 2
+
+struct packed_git;
+struct repository;
+
+/*
+ * The delta base candidates of one object, best first; unused slots
+ * are NULL.
+ */
+struct delta_hint {
+	const struct object_id *base[DELTA_HINTS_MAX];
+};
+
+/*
+ * Writes the delta hints of the "nr" objects of a pack to "filename".
+ * There is one entry in "hints" for each object, in index order.
+ */
+void write_delta_hints_file(struct repository *r, const char *filename,
+			    const struct delta_hint *hints, uint32_t nr);
+
+struct pack_delta_hints;
+
+/*
+ * Loads the .dhints file corresponding to "p", returning NULL if there
+ * is none or it cannot be used.
+ */
+struct pack_delta_hints *load_pack_delta_hints(struct packed_git *p);
+
+/*
+ * Stores up to "nr" delta base candidates recorded for the object at
+ * position "pos" (in index order) of the pack into "bases", best first,
+ * and returns how many were stored.
+ */
+uint32_t nth_packed_delta_hints(struct pack_delta_hints *hints, uint32_t pos,
+				struct object_id *bases, uint32_t nr);
+
+void free_pack_delta_hints(struct pack_delta_hints *hints);
+
+#endif
@@ -157,6 +157,7 @@ void clear_packing_data(struct packing_data *pdata)
 		return;
 
 	free(pdata->cruft_mtime);
+	free(pdata->delta_alt);
 	free(pdata->in_pack);
 	free(pdata->in_pack_by_idx);
 	free(pdata->in_pack_pos);
@@ -188,6 +189,9 @@ struct object_entry *packlist_alloc(struct packing_data *pdata,
 
 		if (pdata->cruft_mtime)
 			REALLOC_ARRAY(pdata->cruft_mtime, pdata->nr_alloc);
+
+		if (pdata->delta_alt)
+			REALLOC_ARRAY(pdata->delta_alt, pdata->nr_alloc);
 	}
 
 	new_entry = pdata->objects + pdata->nr_objects++;
@@ -219,6 +223,9 @@ struct object_entry *packlist_alloc(struct packing_data *pdata,
 	if (pdata->cruft_mtime)
 		pdata->cruft_mtime[pdata->nr_objects - 1] = 0;
 
+	if (pdata->delta_alt)
+		pdata->delta_alt[pdata->nr_objects - 1] = 0;
+
 	return new_entry;
 }
 
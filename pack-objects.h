@@ -180,6 +180,14 @@ struct packing_data {
 	 * written out in lexicographic (index) order.
 	 */
 	uint32_t *cruft_mtime;
+
+	/*
+	 * Used when writing delta hints.
+	 *
+	 * The best delta base each object had before the one it ended
+	 * up with, if any, as an index into "objects" plus one.
+	 */
+	uint32_t *delta_alt;
 };
 
 void prepare_packing_data(struct repository *r, struct packing_data *pdata);
@@ -347,4 +355,25 @@ static inline void oe_set_cruft_mtime(struct packing_data *pack,
 	pack->cruft_mtime[e - pack->objects] = mtime;
 }
 
+static inline struct object_entry *oe_delta_alt(struct packing_data *pack,
+						struct object_entry *e)
+{
+	if (!pack->delta_alt || !pack->delta_alt[e - pack->objects])
+		return NULL;
+	return &pack->objects[pack->delta_alt[e - pack->objects] - 1];
+}
+
+/*
+ * Unlike the other setters, this does not allocate the array; it is
+ * a no-op unless "delta_alt" was allocated before the delta search.
+ */
+static inline void oe_set_delta_alt(struct packing_data *pack,
+				    struct object_entry *e,
+				    struct object_entry *alt)
+{
+	if (!pack->delta_alt)
+		return;
+	pack->delta_alt[e - pack->objects] = alt ? (alt - pack->objects) + 1 : 0;
+}
+
 #endif
@@ -379,7 +379,8 @@ void close_object_store(struct object_database *o)
 
 void unlink_pack_path(const char *pack_name, int force_delete)
 {
-	static const char *exts[] = {".idx", ".pack", ".rev", ".keep", ".bitmap", ".promisor", ".mtimes"};
+	static const char *exts[] = {".idx", ".pack", ".rev", ".keep", ".bitmap", ".promisor", ".mtimes",
+				     ".dhints"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -927,7 +928,8 @@ static void prepare_pack(const char *full_name, size_t full_name_len,
 	    ends_with(file_name, ".bitmap") ||
 	    ends_with(file_name, ".keep") ||
 	    ends_with(file_name, ".promisor") ||
-	    ends_with(file_name, ".mtimes"))
+	    ends_with(file_name, ".mtimes") ||
+	    ends_with(file_name, ".dhints"))
 		string_list_append(data->garbage, full_name);
 	else
 		report_garbage(PACKDIR_FILE_GARBAGE, full_name);
@@ -1397,10 +1399,37 @@ static enum object_type packed_to_object_type(struct repository *r,
 	goto out;
 }
 
-static struct hashmap delta_base_cache;
-static size_t delta_base_cached;
+/*
+ * The delta base cache is split into shards, each with its own hashmap,
+ * LRU list and lock.  When multiple threads read objects (see
+ * enable_obj_read_lock()), unpack_entry() applies deltas and adds the
+ * resulting bases to the cache without holding the object read lock,
+ * so the cache protects itself.  Sharding keeps those threads from
+ * serializing on a single cache lock.
+ *
+ * The memory limit applies to the cache as a whole.  When we are over
+ * it, we evict the oldest entry of each shard in turn, which
+ * approximates evicting the least recently used entries overall.
+ *
+ * Lock ordering: the object read lock (if held) is taken before any
+ * shard lock, and a thread never holds more than one shard lock or a
+ * shard lock and `delta_base_cached_mutex` at the same time.
+ */
+#define DELTA_BASE_CACHE_SHARDS 16
+
+struct delta_base_cache_shard {
+	struct hashmap map;
+	struct list_head lru;
+	pthread_mutex_t mutex;
+};
 
-static LIST_HEAD(delta_base_cache_lru);
+static struct delta_base_cache_shard delta_base_cache[DELTA_BASE_CACHE_SHARDS];
+static int delta_base_cache_initialized;
+static int delta_base_cache_use_lock;
+
+static size_t delta_base_cached;
+static unsigned int delta_base_evict_next;
+static pthread_mutex_t delta_base_cached_mutex;
 
 struct delta_base_cache_key {
 	struct packed_git *p;
@@ -1425,22 +1454,6 @@ static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
 	return hash;
 }
 
-static struct delta_base_cache_entry *
-get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
-{
-	struct hashmap_entry entry, *e;
-	struct delta_base_cache_key key;
-
-	if (!delta_base_cache.cmpfn)
-		return NULL;
-
-	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
-	key.p = p;
-	key.base_offset = base_offset;
-	e = hashmap_get(&delta_base_cache, &entry, &key);
-	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
-}
-
 static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
 				   const struct delta_base_cache_key *b)
 {
@@ -1464,55 +1477,206 @@ static int delta_base_cache_hash_cmp(const void *cmp_data UNUSED,
 		return !delta_base_cache_key_eq(&a->key, &b->key);
 }
 
+static void init_delta_base_cache(void)
+{
+	if (delta_base_cache_initialized)
+		return;
+
+	for (size_t i = 0; i < ARRAY_SIZE(delta_base_cache); i++) {
+		hashmap_init(&delta_base_cache[i].map,
+			     delta_base_cache_hash_cmp, NULL, 0);
+		INIT_LIST_HEAD(&delta_base_cache[i].lru);
+	}
+	delta_base_cache_initialized = 1;
+}
+
+void enable_delta_base_cache_lock(void)
+{
+	if (delta_base_cache_use_lock)
+		return;
+
+	init_delta_base_cache();
+	for (size_t i = 0; i < ARRAY_SIZE(delta_base_cache); i++)
+		pthread_mutex_init(&delta_base_cache[i].mutex, NULL);
+	pthread_mutex_init(&delta_base_cached_mutex, NULL);
+	delta_base_cache_use_lock = 1;
+}
+
+void disable_delta_base_cache_lock(void)
+{
+	if (!delta_base_cache_use_lock)
+		return;
+
+	delta_base_cache_use_lock = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(delta_base_cache); i++)
+		pthread_mutex_destroy(&delta_base_cache[i].mutex);
+	pthread_mutex_destroy(&delta_base_cached_mutex);
+}
+
+static struct delta_base_cache_shard *lock_delta_base_cache_shard(unsigned int hash)
+{
+	struct delta_base_cache_shard *shard;
+
+	init_delta_base_cache();
+	shard = &delta_base_cache[hash % DELTA_BASE_CACHE_SHARDS];
+	if (delta_base_cache_use_lock)
+		pthread_mutex_lock(&shard->mutex);
+	return shard;
+}
+
+static void unlock_delta_base_cache_shard(struct delta_base_cache_shard *shard)
+{
+	if (delta_base_cache_use_lock)
+		pthread_mutex_unlock(&shard->mutex);
+}
+
+static void update_delta_base_cached(ssize_t delta)
+{
+	if (delta_base_cache_use_lock)
+		pthread_mutex_lock(&delta_base_cached_mutex);
+	delta_base_cached += delta;
+	if (delta_base_cache_use_lock)
+		pthread_mutex_unlock(&delta_base_cached_mutex);
+}
+
+/*
+ * Look up an entry in a shard; the caller must hold the shard lock.
+ */
+static struct delta_base_cache_entry *
+get_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+			   struct packed_git *p, off_t base_offset)
+{
+	struct hashmap_entry entry, *e;
+	struct delta_base_cache_key key;
+
+	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
+	key.p = p;
+	key.base_offset = base_offset;
+	e = hashmap_get(&shard->map, &entry, &key);
+	return e ? container_of(e, struct delta_base_cache_entry, ent) : NULL;
+}
+
 static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	return !!get_delta_base_cache_entry(p, base_offset);
+	struct delta_base_cache_shard *shard;
+	int ret;
+
+	shard = lock_delta_base_cache_shard(pack_entry_hash(p, base_offset));
+	ret = !!get_delta_base_cache_entry(shard, p, base_offset);
+	unlock_delta_base_cache_shard(shard);
+
+	return ret;
 }
 
 /*
- * Remove the entry from the cache, but do _not_ free the associated
- * entry data. The caller takes ownership of the "data" buffer, and
- * should copy out any fields it wants before detaching.
+ * Remove the entry from its shard, but do _not_ free the associated
+ * entry data, nor update the total size of the cache.  The caller must
+ * hold the shard lock, takes ownership of the "data" buffer, and should
+ * copy out any fields it wants before detaching.
  */
-static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+static void detach_delta_base_cache_entry(struct delta_base_cache_shard *shard,
+					  struct delta_base_cache_entry *ent)
 {
-	hashmap_remove(&delta_base_cache, &ent->ent, &ent->key);
+	hashmap_remove(&shard->map, &ent->ent, &ent->key);
 	list_del(&ent->lru);
-	delta_base_cached -= ent->size;
 	free(ent);
 }
 
+/*
+ * Remove the entry for the given pack and offset from the cache and
+ * hand its data over to the caller.  Returns NULL if there is no such
+ * entry.
+ */
+static void *take_delta_base_cache_entry(struct packed_git *p, off_t base_offset,
+					 enum object_type *type,
+					 unsigned long *size)
+{
+	struct delta_base_cache_shard *shard;
+	struct delta_base_cache_entry *ent;
+	void *data = NULL;
+
+	shard = lock_delta_base_cache_shard(pack_entry_hash(p, base_offset));
+	ent = get_delta_base_cache_entry(shard, p, base_offset);
+	if (ent) {
+		*type = ent->type;
+		*size = ent->size;
+		data = ent->data;
+		detach_delta_base_cache_entry(shard, ent);
+	}
+	unlock_delta_base_cache_shard(shard);
+
+	if (data)
+		update_delta_base_cached(-(ssize_t)*size);
+	return data;
+}
+
 static void *cache_or_unpack_entry(struct repository *r, struct packed_git *p,
 				   off_t base_offset, unsigned long *base_size,
 				   enum object_type *type)
 {
+	struct delta_base_cache_shard *shard;
 	struct delta_base_cache_entry *ent;
+	void *data = NULL;
 
-	ent = get_delta_base_cache_entry(p, base_offset);
-	if (!ent)
-		return unpack_entry(r, p, base_offset, type, base_size);
+	shard = lock_delta_base_cache_shard(pack_entry_hash(p, base_offset));
+	ent = get_delta_base_cache_entry(shard, p, base_offset);
+	if (ent) {
+		if (type)
+			*type = ent->type;
+		if (base_size)
+			*base_size = ent->size;
+		data = xmemdupz(ent->data, ent->size);
+	}
+	unlock_delta_base_cache_shard(shard);
 
-	if (type)
-		*type = ent->type;
-	if (base_size)
-		*base_size = ent->size;
-	return xmemdupz(ent->data, ent->size);
+	if (!data)
+		return unpack_entry(r, p, base_offset, type, base_size);
+	return data;
 }
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
-{
-	free(ent->data);
-	detach_delta_base_cache_entry(ent);
+/*
+ * Evict the oldest entry of the next non-empty shard.  Returns 0 if the
+ * cache is empty.
+ */
+static int evict_delta_base_cache_entry(void)
+{
+	unsigned int start;
+
+	if (delta_base_cache_use_lock)
+		pthread_mutex_lock(&delta_base_cached_mutex);
+	start = delta_base_evict_next++;
+	if (delta_base_cache_use_lock)
+		pthread_mutex_unlock(&delta_base_cached_mutex);
+
+	for (unsigned int i = 0; i < DELTA_BASE_CACHE_SHARDS; i++) {
+		struct delta_base_cache_shard *shard;
+		struct delta_base_cache_entry *ent = NULL;
+		void *data = NULL;
+		unsigned long size = 0;
+
+		shard = lock_delta_base_cache_shard(start + i);
+		if (!list_empty(&shard->lru)) {
+			ent = list_first_entry(&shard->lru,
+					       struct delta_base_cache_entry, lru);
+			data = ent->data;
+			size = ent->size;
+			detach_delta_base_cache_entry(shard, ent);
+		}
+		unlock_delta_base_cache_shard(shard);
+
+		if (ent) {
+			free(data);
+			update_delta_base_cached(-(ssize_t)size);
+			return 1;
+		}
+	}
+	return 0;
 }
 
 void clear_delta_base_cache(void)
 {
-	struct list_head *lru, *tmp;
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *entry =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		release_delta_base_cache(entry);
-	}
+	while (evict_delta_base_cache_entry())
+		; /* nothing */
 }
 
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
@@ -1520,27 +1684,23 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 				 unsigned long delta_base_cache_limit,
 				 enum object_type type)
 {
+	struct delta_base_cache_shard *shard;
 	struct delta_base_cache_entry *ent;
-	struct list_head *lru, *tmp;
+	unsigned int hash = pack_entry_hash(p, base_offset);
 
-	/*
-	 * Check required to avoid redundant entries when more than one thread
-	 * is unpacking the same object, in unpack_entry() (since its phases I
-	 * and III might run concurrently across multiple threads).
-	 */
-	if (in_delta_base_cache(p, base_offset)) {
-		free(base);
-		return;
-	}
+	/* make room for the new entry */
+	for (;;) {
+		size_t cached;
 
-	delta_base_cached += base_size;
+		if (delta_base_cache_use_lock)
+			pthread_mutex_lock(&delta_base_cached_mutex);
+		cached = delta_base_cached;
+		if (delta_base_cache_use_lock)
+			pthread_mutex_unlock(&delta_base_cached_mutex);
 
-	list_for_each_safe(lru, tmp, &delta_base_cache_lru) {
-		struct delta_base_cache_entry *f =
-			list_entry(lru, struct delta_base_cache_entry, lru);
-		if (delta_base_cached <= delta_base_cache_limit)
+		if (cached + base_size <= delta_base_cache_limit ||
+		    !evict_delta_base_cache_entry())
 			break;
-		release_delta_base_cache(f);
 	}
 
 	ent = xmalloc(sizeof(*ent));
@@ -1549,12 +1709,25 @@ static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
-	list_add_tail(&ent->lru, &delta_base_cache_lru);
+	hashmap_entry_init(&ent->ent, hash);
+
+	shard = lock_delta_base_cache_shard(hash);
+	/*
+	 * Check required to avoid redundant entries when more than one thread
+	 * is unpacking the same object, in unpack_entry() (since its phases I
+	 * and III might run concurrently across multiple threads).
+	 */
+	if (get_delta_base_cache_entry(shard, p, base_offset)) {
+		unlock_delta_base_cache_shard(shard);
+		free(ent);
+		free(base);
+		return;
+	}
+	list_add_tail(&ent->lru, &shard->lru);
+	hashmap_add(&shard->map, &ent->ent);
+	unlock_delta_base_cache_shard(shard);
 
-	if (!delta_base_cache.cmpfn)
-		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, NULL, 0);
-	hashmap_entry_init(&ent->ent, pack_entry_hash(p, base_offset));
-	hashmap_add(&delta_base_cache, &ent->ent);
+	update_delta_base_cached(base_size);
 }
 
 int packed_object_info(struct repository *r, struct packed_git *p,
@@ -1723,14 +1896,9 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 	for (;;) {
 		off_t base_offset;
 		int i;
-		struct delta_base_cache_entry *ent;
 
-		ent = get_delta_base_cache_entry(p, curpos);
-		if (ent) {
-			type = ent->type;
-			data = ent->data;
-			size = ent->size;
-			detach_delta_base_cache_entry(ent);
+		data = take_delta_base_cache_entry(p, curpos, &type, &size);
+		if (data) {
 			base_from_cache = 1;
 			break;
 		}
@@ -1867,6 +2035,13 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		delta_data = unpack_compressed_entry(p, &w_curs, curpos, delta_size);
 
+		/*
+		 * Neither applying the delta nor the delta base cache need
+		 * the object read lock, so let other threads read objects
+		 * in the meantime.
+		 */
+		obj_read_unlock();
+
 		if (!delta_data) {
 			error("failed to unpack compressed delta "
 			      "at offset %"PRIuMAX" from %s",
@@ -1904,6 +2079,8 @@ void *unpack_entry(struct repository *r, struct packed_git *p, off_t obj_offset,
 
 		free(delta_data);
 		free(external_base);
+
+		obj_read_lock();
 	}
 
 	if (final_type)
@@ -191,6 +191,15 @@ void close_pack(struct packed_git *);
 void close_object_store(struct object_database *o);
 void unuse_pack(struct pack_window **);
 void clear_delta_base_cache(void);
+
+/*
+ * Make the delta base cache safe to use from multiple threads.  This is
+ * done by enable_obj_read_lock(); there should be no need to call these
+ * directly.
+ */
+void enable_delta_base_cache_lock(void);
+void disable_delta_base_cache_lock(void);
+
 struct packed_git *add_packed_git(struct repository *r, const char *path,
 				  size_t path_len, int local);
 
@@ -10,6 +10,7 @@
 #include "hex.h"
 #include "list-objects.h"
 #include "object.h"
+#include "odb.h"
 #include "oid-array.h"
 #include "prio-queue.h"
 #include "repository.h"
@@ -17,6 +18,7 @@
 #include "string-list.h"
 #include "strmap.h"
 #include "tag.h"
+#include "thread-utils.h"
 #include "trace2.h"
 #include "tree.h"
 #include "tree-walk.h"
@@ -34,6 +36,36 @@ struct type_and_oid_list {
 	.oids = OID_ARRAY_INIT	 \
 }
 
+/*
+ * Worker threads reading the trees of the path being walked, so that
+ * inflating them overlaps with the main thread parsing the trees read
+ * before. At most TREE_PREFETCH_WINDOW trees per thread are read ahead
+ * of the main thread.
+ */
+#define TREE_PREFETCH_WINDOW 16
+
+struct tree_prefetch_slot {
+	void *buffer;
+	unsigned long size;
+	enum object_type type;
+	unsigned done:1;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	pthread_t *threads;
+	int nr_threads;
+
+	/* Everything below is guarded by 'mutex'. */
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	const struct object_id *oids;
+	struct tree_prefetch_slot *slots;
+	size_t nr, next, consumed;
+	int stop;
+};
+
 struct path_walk_context {
 	/**
 	 * Repeats of data in 'struct path_walk_info' for
@@ -62,8 +94,137 @@ struct path_walk_context {
 	 */
 	struct prio_queue path_stack;
 	struct strset path_stack_pushed;
+
+	/**
+	 * Worker threads reading trees ahead of the walk, if any.
+	 */
+	struct tree_prefetch *prefetch;
 };
 
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *tp = data;
+	size_t window = TREE_PREFETCH_WINDOW * tp->nr_threads;
+
+	pthread_mutex_lock(&tp->mutex);
+	while (!tp->stop) {
+		struct tree_prefetch_slot *slot;
+		const struct object_id *oid;
+		enum object_type type;
+		unsigned long size;
+		void *buffer;
+
+		if (tp->next >= tp->nr || tp->next >= tp->consumed + window) {
+			pthread_cond_wait(&tp->work_cond, &tp->mutex);
+			continue;
+		}
+		slot = &tp->slots[tp->next];
+		oid = &tp->oids[tp->next];
+		tp->next++;
+		pthread_mutex_unlock(&tp->mutex);
+
+		buffer = odb_read_object(tp->repo->objects, oid, &type, &size);
+
+		pthread_mutex_lock(&tp->mutex);
+		slot->buffer = buffer;
+		slot->size = size;
+		slot->type = type;
+		slot->done = 1;
+		pthread_cond_signal(&tp->done_cond);
+	}
+	pthread_mutex_unlock(&tp->mutex);
+	return NULL;
+}
+
+static struct tree_prefetch *tree_prefetch_start(struct repository *repo,
+						 int nr_threads)
+{
+	struct tree_prefetch *tp;
+
+	CALLOC_ARRAY(tp, 1);
+	tp->repo = repo;
+	tp->nr_threads = nr_threads;
+	pthread_mutex_init(&tp->mutex, NULL);
+	pthread_cond_init(&tp->work_cond, NULL);
+	pthread_cond_init(&tp->done_cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(tp->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&tp->threads[i], NULL,
+					 tree_prefetch_thread, tp);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+	return tp;
+}
+
+static void tree_prefetch_stop(struct tree_prefetch *tp)
+{
+	pthread_mutex_lock(&tp->mutex);
+	tp->stop = 1;
+	pthread_cond_broadcast(&tp->work_cond);
+	pthread_mutex_unlock(&tp->mutex);
+
+	for (int i = 0; i < tp->nr_threads; i++)
+		pthread_join(tp->threads[i], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&tp->done_cond);
+	pthread_cond_destroy(&tp->work_cond);
+	pthread_mutex_destroy(&tp->mutex);
+	free(tp->threads);
+	free(tp);
+}
+
+/* Have the workers read the trees in 'oids', in order. */
+static void tree_prefetch_batch(struct tree_prefetch *tp,
+				const struct object_id *oids, size_t nr)
+{
+	pthread_mutex_lock(&tp->mutex);
+	tp->oids = oids;
+	CALLOC_ARRAY(tp->slots, nr);
+	tp->nr = nr;
+	tp->next = tp->consumed = 0;
+	pthread_cond_broadcast(&tp->work_cond);
+	pthread_mutex_unlock(&tp->mutex);
+}
+
+/*
+ * Wait for the i-th tree of the current batch and attach its contents to
+ * the tree object. Trees that could not be read are left unparsed, so
+ * that add_tree_entries() reports the error.
+ */
+static void tree_prefetch_parse(struct tree_prefetch *tp, size_t i)
+{
+	struct tree_prefetch_slot *slot;
+	struct tree *tree;
+
+	pthread_mutex_lock(&tp->mutex);
+	slot = &tp->slots[i];
+	while (!slot->done)
+		pthread_cond_wait(&tp->done_cond, &tp->mutex);
+	tp->consumed = i + 1;
+	pthread_cond_broadcast(&tp->work_cond);
+	pthread_mutex_unlock(&tp->mutex);
+
+	tree = lookup_tree(tp->repo, &tp->oids[i]);
+	if (slot->buffer && slot->type == OBJ_TREE &&
+	    tree && !tree->object.parsed)
+		parse_tree_buffer(tree, slot->buffer, slot->size);
+	else
+		free(slot->buffer);
+}
+
+static void tree_prefetch_batch_end(struct tree_prefetch *tp)
+{
+	pthread_mutex_lock(&tp->mutex);
+	FREE_AND_NULL(tp->slots);
+	tp->oids = NULL;
+	tp->nr = tp->next = tp->consumed = 0;
+	pthread_mutex_unlock(&tp->mutex);
+}
+
 static int compare_by_type(const void *one, const void *two, void *cb_data)
 {
 	struct type_and_oid_list *list1, *list2;
@@ -267,17 +428,31 @@ static int walk_path(struct path_walk_context *ctx,
 	/* Evaluate function pointer on this data, if requested. */
 	if ((list->type == OBJ_TREE && ctx->info->trees) ||
 	    (list->type == OBJ_BLOB && ctx->info->blobs) ||
-	    (list->type == OBJ_TAG && ctx->info->tags))
+	    (list->type == OBJ_TAG && ctx->info->tags)) {
+		if (ctx->prefetch)
+			obj_read_lock();
 		ret = ctx->info->path_fn(path, &list->oids, list->type,
 					ctx->info->path_fn_data);
+		if (ctx->prefetch)
+			obj_read_unlock();
+	}
 
 	/* Expand data for children. */
 	if (list->type == OBJ_TREE) {
+		int prefetch = ctx->prefetch && list->oids.nr > 1;
+
+		if (prefetch)
+			tree_prefetch_batch(ctx->prefetch, list->oids.oid,
+					    list->oids.nr);
 		for (size_t i = 0; i < list->oids.nr; i++) {
+			if (prefetch)
+				tree_prefetch_parse(ctx->prefetch, i);
 			ret |= add_tree_entries(ctx,
 					    path,
 					    &list->oids.oid[i]);
 		}
+		if (prefetch)
+			tree_prefetch_batch_end(ctx->prefetch);
 	}
 
 	oid_array_clear(&list->oids);
@@ -561,6 +736,9 @@ int walk_objects_by_path(struct path_walk_info *info)
 	oid_array_clear(&commit_list->oids);
 	free(commit_list);
 
+	if (HAVE_THREADS && info->threads > 1)
+		ctx.prefetch = tree_prefetch_start(ctx.repo, info->threads);
+
 	trace2_region_enter("path-walk", "path-walk", info->revs->repo);
 	while (!ret && ctx.path_stack.nr) {
 		char *path = prio_queue_get(&ctx.path_stack);
@@ -592,6 +770,9 @@ int walk_objects_by_path(struct path_walk_info *info)
 	trace2_data_intmax("path-walk", ctx.repo, "paths", paths_nr);
 	trace2_region_leave("path-walk", "path-walk", info->revs->repo);
 
+	if (ctx.prefetch)
+		tree_prefetch_stop(ctx.prefetch);
+
 	clear_paths_to_lists(&ctx.paths_to_lists);
 	strset_clear(&ctx.path_stack_pushed);
 	clear_prio_queue(&ctx.path_stack);
@@ -66,6 +66,15 @@ struct path_walk_info {
 	 * the sparse-checkout patterns.
 	 */
 	struct pattern_list *pl;
+
+	/**
+	 * When 'threads' is larger than one, that many worker threads read
+	 * and inflate the tree objects of each path ahead of the walk. The
+	 * walk itself and the calls to path_fn stay on the calling thread,
+	 * so the results do not depend on the number of threads. While the
+	 * workers are running, path_fn is called under obj_read_lock().
+	 */
+	int threads;
 };
 
 #define PATH_WALK_INFO_INIT {   \
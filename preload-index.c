@@ -5,6 +5,7 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "git-compat-util.h"
+#include "compat/lstat-batch.h"
 #include "pathspec.h"
 #include "dir.h"
 #include "environment.h"
@@ -29,6 +30,12 @@
 #define MAX_PARALLEL (20)
 #define THREAD_COST (500)
 
+/*
+ * Number of lstat's each thread submits at once when they are batched
+ * with core.preloadIndexIoUring.
+ */
+#define LSTAT_BATCH_SIZE (256)
+
 struct progress_data {
 	unsigned long n;
 	struct progress *progress;
@@ -41,9 +48,43 @@ struct thread_data {
 	struct pathspec pathspec;
 	struct progress_data *progress;
 	int offset, nr;
+	int use_lstat_batch;
 	int t2_nr_lstat;
+	int t2_nr_lstat_batch;
 };
 
+static void preload_entry(struct index_state *index, struct cache_entry *ce,
+			  struct stat *st)
+{
+	if (ie_match_stat(index, ce, st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		return;
+	ce_mark_uptodate(ce);
+	mark_fsmonitor_valid(index, ce);
+}
+
+struct preload_batch {
+	struct lstat_batch *lstat_batch;
+	unsigned int nr;
+	struct cache_entry *ce[LSTAT_BATCH_SIZE];
+	const char *path[LSTAT_BATCH_SIZE];
+	struct stat st[LSTAT_BATCH_SIZE];
+	int err[LSTAT_BATCH_SIZE];
+};
+
+static void flush_preload_batch(struct index_state *index,
+				struct preload_batch *b)
+{
+	unsigned int i;
+
+	if (!b->nr)
+		return;
+	lstat_batch(b->lstat_batch, b->nr, b->path, b->st, b->err);
+	for (i = 0; i < b->nr; i++)
+		if (!b->err[i])
+			preload_entry(index, b->ce[i], &b->st[i]);
+	b->nr = 0;
+}
+
 static void *preload_thread(void *_data)
 {
 	int nr, last_nr;
@@ -51,6 +92,16 @@ static void *preload_thread(void *_data)
 	struct index_state *index = p->index;
 	struct cache_entry **cep = index->cache + p->offset;
 	struct cache_def cache = CACHE_DEF_INIT;
+	struct preload_batch *batch = NULL;
+
+	if (p->use_lstat_batch) {
+		struct lstat_batch *lstat_batch = lstat_batch_new(LSTAT_BATCH_SIZE);
+
+		if (lstat_batch) {
+			CALLOC_ARRAY(batch, 1);
+			batch->lstat_batch = lstat_batch;
+		}
+	}
 
 	nr = p->nr;
 	if (nr + p->offset > index->cache_nr)
@@ -85,13 +136,23 @@ static void *preload_thread(void *_data)
 		if (threaded_has_symlink_leading_path(&cache, ce->name, ce_namelen(ce)))
 			continue;
 		p->t2_nr_lstat++;
-		if (lstat(ce->name, &st))
+		if (batch) {
+			p->t2_nr_lstat_batch++;
+			batch->ce[batch->nr] = ce;
+			batch->path[batch->nr] = ce->name;
+			if (++batch->nr == LSTAT_BATCH_SIZE)
+				flush_preload_batch(index, batch);
 			continue;
-		if (ie_match_stat(index, ce, &st, CE_MATCH_RACY_IS_DIRTY|CE_MATCH_IGNORE_FSMONITOR))
+		}
+		if (lstat(ce->name, &st))
 			continue;
-		ce_mark_uptodate(ce);
-		mark_fsmonitor_valid(index, ce);
+		preload_entry(index, ce, &st);
 	} while (--nr > 0);
+	if (batch) {
+		flush_preload_batch(index, batch);
+		lstat_batch_free(batch->lstat_batch);
+		free(batch);
+	}
 	if (p->progress) {
 		struct progress_data *pd = p->progress;
 
@@ -110,10 +171,12 @@ void preload_index(struct index_state *index,
 	int threads, i, work, offset;
 	struct thread_data data[MAX_PARALLEL];
 	struct progress_data pd;
-	int t2_sum_lstat = 0;
+	int t2_sum_lstat = 0, t2_sum_lstat_batch = 0;
 	int core_preload_index = 1;
+	int use_lstat_batch = 0;
 
 	repo_config_get_bool(index->repo, "core.preloadindex", &core_preload_index);
+	repo_config_get_bool(index->repo, "core.preloadindexiouring", &use_lstat_batch);
 
 	if (!HAVE_THREADS || !core_preload_index)
 		return;
@@ -150,6 +213,7 @@ void preload_index(struct index_state *index,
 			copy_pathspec(&p->pathspec, pathspec);
 		p->offset = offset;
 		p->nr = work;
+		p->use_lstat_batch = use_lstat_batch;
 		if (pd.progress)
 			p->progress = &pd;
 		offset += work;
@@ -163,6 +227,7 @@ void preload_index(struct index_state *index,
 		if (pthread_join(p->pthread, NULL))
 			die("unable to join threaded lstat");
 		t2_sum_lstat += p->t2_nr_lstat;
+		t2_sum_lstat_batch += p->t2_nr_lstat_batch;
 	}
 	stop_progress(&pd.progress);
 
@@ -175,6 +240,9 @@ void preload_index(struct index_state *index,
 	trace_performance_leave("preload index");
 
 	trace2_data_intmax("index", NULL, "preload/sum_lstat", t2_sum_lstat);
+	if (use_lstat_batch)
+		trace2_data_intmax("index", NULL, "preload/sum_lstat_batch",
+				   t2_sum_lstat_batch);
 	trace2_region_leave("index", "preload", NULL);
 }
 
@@ -2632,9 +2632,10 @@ static void copy_cache_entry_to_ondisk(struct ondisk_cache_entry *ondisk,
 	}
 }
 
-static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
-			  struct strbuf *previous_name, struct ondisk_cache_entry *ondisk)
+static void ce_write_entry(struct strbuf *out, struct cache_entry *ce,
+			   struct strbuf *previous_name)
 {
+	struct ondisk_cache_entry ondisk;
 	int size;
 	unsigned int saved_namelen;
 	int stripped_name = 0;
@@ -2650,10 +2651,10 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 
 	if (!previous_name) {
 		int len = ce_namelen(ce);
-		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, ce->name, len);
-		hashwrite(f, padding, align_padding_size(size, len));
+		copy_cache_entry_to_ondisk(&ondisk, ce);
+		strbuf_add(out, &ondisk, size);
+		strbuf_add(out, ce->name, len);
+		strbuf_add(out, padding, align_padding_size(size, len));
 	} else {
 		int common, to_remove, prefix_size;
 		unsigned char to_remove_vi[16];
@@ -2666,11 +2667,11 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 		to_remove = previous_name->len - common;
 		prefix_size = encode_varint(to_remove, to_remove_vi);
 
-		copy_cache_entry_to_ondisk(ondisk, ce);
-		hashwrite(f, ondisk, size);
-		hashwrite(f, to_remove_vi, prefix_size);
-		hashwrite(f, ce->name + common, ce_namelen(ce) - common);
-		hashwrite(f, padding, 1);
+		copy_cache_entry_to_ondisk(&ondisk, ce);
+		strbuf_add(out, &ondisk, size);
+		strbuf_add(out, to_remove_vi, prefix_size);
+		strbuf_add(out, ce->name + common, ce_namelen(ce) - common);
+		strbuf_add(out, padding, 1);
 
 		strbuf_splice(previous_name, common, to_remove,
 			      ce->name + common, ce_namelen(ce) - common);
@@ -2679,8 +2680,6 @@ static int ce_write_entry(struct hashfile *f, struct cache_entry *ce,
 		ce->ce_namelen = saved_namelen;
 		ce->ce_flags &= ~CE_STRIP_NAME;
 	}
-
-	return 0;
 }
 
 /*
@@ -2791,6 +2790,135 @@ enum write_extensions {
 };
 #define WRITE_ALL_EXTENSIONS ((enum write_extensions)-1)
 
+struct write_cache_entries_thread_data
+{
+	pthread_t pthread;
+	struct index_state *istate;
+	int start, end;		/* range of istate->cache to serialize */
+	int nr;			/* return # of entries written */
+	int v4;
+	size_t previous_namelen;
+	struct strbuf out;
+};
+
+/*
+ * A thread proc to serialize one IEOT block of cache entries into a
+ * buffer of its own.
+ */
+static void *write_cache_entries_thread(void *_data)
+{
+	struct write_cache_entries_thread_data *p = _data;
+	struct strbuf previous_name = STRBUF_INIT;
+	int i;
+
+	/*
+	 * The first entry of a V4 block must not share a prefix with the
+	 * entry before it, but still strips all of its name, just like the
+	 * sequential writer does.
+	 */
+	strbuf_addchars(&previous_name, '\0', p->previous_namelen);
+
+	for (i = p->start; i < p->end; i++) {
+		struct cache_entry *ce = p->istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		ce_write_entry(&p->out, ce, p->v4 ? &previous_name : NULL);
+		p->nr++;
+	}
+
+	strbuf_release(&previous_name);
+	return NULL;
+}
+
+/*
+ * Serialize the cache entries on one thread per IEOT block and append
+ * the blocks to `f` in order, recording them in `ieot`. Appending (and
+ * hashing) a block overlaps with the serialization of the later ones.
+ */
+static void write_cache_entries_threaded(struct index_state *istate,
+					 struct hashfile *f, int v4,
+					 int ieot_entries,
+					 struct index_entry_offset_table *ieot)
+{
+	struct write_cache_entries_thread_data *data;
+	size_t previous_namelen = 0;
+	int i, nr_blocks = 0, next_block = 0, err;
+
+	/*
+	 * Blocks start at the first entry that is written at or after each
+	 * multiple of `ieot_entries`, which is where the reader expects them.
+	 */
+	CALLOC_ARRAY(data, DIV_ROUND_UP(istate->cache_nr, ieot_entries));
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+
+		if (ce->ce_flags & CE_REMOVE)
+			continue;
+		if (i >= next_block) {
+			if (nr_blocks)
+				data[nr_blocks - 1].end = i;
+			data[nr_blocks].start = i;
+			data[nr_blocks].previous_namelen = previous_namelen;
+			nr_blocks++;
+			next_block = (i / ieot_entries + 1) * ieot_entries;
+		}
+		previous_namelen = (ce->ce_flags & CE_STRIP_NAME) ? 0 : ce_namelen(ce);
+	}
+	if (nr_blocks)
+		data[nr_blocks - 1].end = istate->cache_nr;
+
+	for (i = 0; i < nr_blocks; i++) {
+		struct write_cache_entries_thread_data *p = &data[i];
+
+		p->istate = istate;
+		p->v4 = v4;
+		strbuf_init(&p->out, 0);
+		err = pthread_create(&p->pthread, NULL, write_cache_entries_thread, p);
+		if (err)
+			die(_("unable to create write_cache_entries thread: %s"), strerror(err));
+	}
+
+	for (i = 0; i < nr_blocks; i++) {
+		struct write_cache_entries_thread_data *p = &data[i];
+
+		err = pthread_join(p->pthread, NULL);
+		if (err)
+			die(_("unable to join write_cache_entries thread: %s"), strerror(err));
+
+		ieot->entries[ieot->nr].nr = p->nr;
+		ieot->entries[ieot->nr].offset = hashfile_total(f);
+		ieot->nr++;
+		hashwrite(f, p->out.buf, p->out.len);
+		strbuf_release(&p->out);
+	}
+
+	free(data);
+}
+
+struct write_extensions_thread_data
+{
+	pthread_t pthread;
+	struct index_state *istate;
+	int cache_tree, untracked;
+	struct strbuf cache_tree_sb, untracked_sb;
+};
+
+/*
+ * A thread proc to serialize the extensions that only depend on their
+ * own data structures while the cache entries are being written.
+ */
+static void *write_extensions_thread(void *_data)
+{
+	struct write_extensions_thread_data *p = _data;
+
+	if (p->cache_tree)
+		cache_tree_write(&p->cache_tree_sb, p->istate->cache_tree);
+	if (p->untracked)
+		write_untracked_extension(&p->untracked_sb, p->istate->untracked);
+	return NULL;
+}
+
 /*
  * On success, `tempfile` is closed. If it is the temporary file
  * of a `struct lock_file`, we will therefore effectively perform
@@ -2809,8 +2937,6 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	struct cache_entry **cache = istate->cache;
 	int entries = istate->cache_nr;
 	struct stat st;
-	struct ondisk_cache_entry ondisk;
-	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
 	int drop_cache_tree = istate->drop_cache_tree;
 	off_t offset;
 	int csum_fsync_flag;
@@ -2818,12 +2944,19 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	struct index_entry_offset_table *ieot = NULL;
 	struct repository *r = istate->repo;
 	struct strbuf sb = STRBUF_INIT;
-	int nr, nr_threads, ret;
+	struct write_extensions_thread_data ext = {
+		.cache_tree_sb = STRBUF_INIT,
+		.untracked_sb = STRBUF_INIT,
+	};
+	int ext_thread = 0;
+	int nr_threads, ret;
 
 	f = hashfd(the_repository->hash_algo, tempfile->fd, tempfile->filename.buf);
 
 	prepare_repo_settings(r);
 	f->skip_hash = r->settings.index_skip_hash;
+	if (r->settings.pipelined_hashing)
+		hashfile_enable_pipeline(f);
 
 	for (i = removed = extended = 0; i < entries; i++) {
 		if (cache[i]->ce_flags & CE_REMOVE)
@@ -2885,11 +3018,6 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 		}
 	}
 
-	offset = hashfile_total(f);
-
-	nr = 0;
-	previous_name = (hdr_version == 4) ? &previous_name_buf : NULL;
-
 	for (i = 0; i < entries; i++) {
 		struct cache_entry *ce = cache[i];
 		if (ce->ce_flags & CE_REMOVE)
@@ -2909,40 +3037,54 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 
 			drop_cache_tree = 1;
 		}
-		if (ieot && i && (i % ieot_entries == 0)) {
-			ieot->entries[ieot->nr].nr = nr;
-			ieot->entries[ieot->nr].offset = offset;
-			ieot->nr++;
-			/*
-			 * If we have a V4 index, set the first byte to an invalid
-			 * character to ensure there is nothing common with the previous
-			 * entry
-			 */
-			if (previous_name)
-				previous_name->buf[0] = 0;
-			nr = 0;
-
-			offset = hashfile_total(f);
-		}
-		if (ce_write_entry(f, ce, previous_name, (struct ondisk_cache_entry *)&ondisk) < 0)
-			err = -1;
-
 		if (err)
 			break;
-		nr++;
-	}
-	if (ieot && nr) {
-		ieot->entries[ieot->nr].nr = nr;
-		ieot->entries[ieot->nr].offset = offset;
-		ieot->nr++;
 	}
-	strbuf_release(&previous_name_buf);
 
 	if (err) {
 		ret = err;
 		goto out;
 	}
 
+	if (ieot) {
+		/*
+		 * The cache tree and the untracked cache can be serialized
+		 * while the entries are being written.
+		 */
+		ext.istate = istate;
+		ext.cache_tree = write_extensions & WRITE_CACHE_TREE_EXTENSION &&
+			!drop_cache_tree && istate->cache_tree;
+		ext.untracked = write_extensions & WRITE_UNTRACKED_CACHE_EXTENSION &&
+			istate->untracked;
+		if (ext.cache_tree || ext.untracked) {
+			err = pthread_create(&ext.pthread, NULL, write_extensions_thread, &ext);
+			if (err)
+				die(_("unable to create write_extensions thread: %s"), strerror(err));
+			ext_thread = 1;
+		}
+
+		write_cache_entries_threaded(istate, f, hdr_version == 4,
+					     ieot_entries, ieot);
+
+		if (ext_thread) {
+			err = pthread_join(ext.pthread, NULL);
+			if (err)
+				die(_("unable to join write_extensions thread: %s"), strerror(err));
+		}
+	} else {
+		struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+
+		previous_name = (hdr_version == 4) ? &previous_name_buf : NULL;
+		for (i = 0; i < entries; i++) {
+			if (cache[i]->ce_flags & CE_REMOVE)
+				continue;
+			strbuf_reset(&sb);
+			ce_write_entry(&sb, cache[i], previous_name);
+			hashwrite(f, sb.buf, sb.len);
+		}
+		strbuf_release(&previous_name_buf);
+	}
+
 	offset = hashfile_total(f);
 
 	/*
@@ -2993,7 +3135,10 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	    !drop_cache_tree && istate->cache_tree) {
 		strbuf_reset(&sb);
 
-		cache_tree_write(&sb, istate->cache_tree);
+		if (ext.cache_tree)
+			strbuf_swap(&sb, &ext.cache_tree_sb);
+		else
+			cache_tree_write(&sb, istate->cache_tree);
 		err = write_index_ext_header(f, eoie_c, CACHE_EXT_TREE, sb.len) < 0;
 		hashwrite(f, sb.buf, sb.len);
 		if (err) {
@@ -3018,7 +3163,10 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	    istate->untracked) {
 		strbuf_reset(&sb);
 
-		write_untracked_extension(&sb, istate->untracked);
+		if (ext.untracked)
+			strbuf_swap(&sb, &ext.untracked_sb);
+		else
+			write_untracked_extension(&sb, istate->untracked);
 		err = write_index_ext_header(f, eoie_c, CACHE_EXT_UNTRACKED,
 					     sb.len) < 0;
 		hashwrite(f, sb.buf, sb.len);
@@ -3099,6 +3247,8 @@ static int do_write_index(struct index_state *istate, struct tempfile *tempfile,
 	if (f)
 		free_hashfile(f);
 	strbuf_release(&sb);
+	strbuf_release(&ext.cache_tree_sb);
+	strbuf_release(&ext.untracked_sb);
 	free(eoie_c);
 	free(ieot);
 	return ret;
@@ -68,6 +68,13 @@
  */
 #define REF_DELETED_RMDIR (1 << 9)
 
+/*
+ * Used as a flag in ref_update::flags when the new value of a reference
+ * is written to the packed-refs file instead of a loose ref, see
+ * core.packedRefsThreshold.
+ */
+#define REF_WRITE_PACKED (1 << 13)
+
 struct ref_lock {
 	char *ref_name;
 	struct lock_file lk;
@@ -82,6 +89,7 @@ struct files_ref_store {
 	char *gitcommondir;
 	enum log_refs_config log_all_ref_updates;
 	int prefer_symlink_refs;
+	int packed_refs_threshold;
 
 	struct ref_cache *loose;
 
@@ -116,6 +124,7 @@ static struct ref_store *files_ref_store_init(struct repository *repo,
 		packed_ref_store_init(repo, refs->gitcommondir, flags);
 	refs->log_all_ref_updates = repo_settings_get_log_all_ref_updates(repo);
 	repo_config_get_bool(repo, "core.prefersymlinkrefs", &refs->prefer_symlink_refs);
+	repo_config_get_int(repo, "core.packedrefsthreshold", &refs->packed_refs_threshold);
 
 	chdir_notify_reparent("files-backend $GIT_DIR", &refs->base.gitdir);
 	chdir_notify_reparent("files-backend $GIT_COMMONDIR",
@@ -1531,6 +1540,7 @@ static enum ref_transaction_error write_ref_to_lockfile(struct files_ref_store *
 							struct ref_lock *lock,
 							const struct object_id *oid,
 							int skip_oid_verification,
+							int defer_fsync,
 							struct strbuf *err);
 static int commit_ref_update(struct files_ref_store *refs,
 			     struct ref_lock *lock,
@@ -1678,7 +1688,7 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 	}
 	oidcpy(&lock->old_oid, &orig_oid);
 
-	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, &err) ||
+	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, 0, &err) ||
 	    commit_ref_update(refs, lock, &orig_oid, logmsg, 0, &err)) {
 		error("unable to write current sha1 into %s: %s", newrefname, err.buf);
 		strbuf_release(&err);
@@ -1696,7 +1706,7 @@ static int files_copy_or_rename_ref(struct ref_store *ref_store,
 		goto rollbacklog;
 	}
 
-	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, &err) ||
+	if (write_ref_to_lockfile(refs, lock, &orig_oid, 0, 0, &err) ||
 	    commit_ref_update(refs, lock, &orig_oid, NULL, REF_SKIP_CREATE_REFLOG, &err)) {
 		error("unable to write current sha1 into %s: %s", oldrefname, err.buf);
 		strbuf_release(&err);
@@ -1933,43 +1943,76 @@ static int files_log_ref_write(struct files_ref_store *refs,
 	return 0;
 }
 
+/*
+ * Check that `oid` is an object that may be stored in the reference
+ * `refname`.
+ */
+static enum ref_transaction_error check_new_ref_value(struct files_ref_store *refs,
+						      const char *refname,
+						      const struct object_id *oid,
+						      struct strbuf *err)
+{
+	struct object *o = parse_object(refs->base.repo, oid);
+
+	if (!o) {
+		strbuf_addf(
+			err,
+			"trying to write ref '%s' with nonexistent object %s",
+			refname, oid_to_hex(oid));
+		return REF_TRANSACTION_ERROR_INVALID_NEW_VALUE;
+	}
+	if (o->type != OBJ_COMMIT && is_branch(refname)) {
+		strbuf_addf(
+			err,
+			"trying to write non-commit object %s to branch '%s'",
+			oid_to_hex(oid), refname);
+		return REF_TRANSACTION_ERROR_INVALID_NEW_VALUE;
+	}
+	return 0;
+}
+
+/*
+ * With core.fsyncMethod=batch, the lockfiles of a transaction are only
+ * handed to writeback here. files_transaction_prepare() then makes all of
+ * them durable with a single flush before any of them is renamed.
+ */
+static int fsync_ref_lockfile(int fd)
+{
+	if (batch_fsync_enabled(FSYNC_COMPONENT_REFERENCE) &&
+	    git_fsync(fd, FSYNC_WRITEOUT_ONLY) >= 0)
+		return 0;
+	return fsync_component(FSYNC_COMPONENT_REFERENCE, fd);
+}
+
 /*
  * Write oid into the open lockfile, then close the lockfile. On
- * errors, rollback the lockfile, fill in *err and return -1.
+ * errors, rollback the lockfile, fill in *err and return -1. If
+ * `defer_fsync` is set, the caller flushes the lockfile to disk later,
+ * see fsync_ref_lockfile().
  */
 static enum ref_transaction_error write_ref_to_lockfile(struct files_ref_store *refs,
 							struct ref_lock *lock,
 							const struct object_id *oid,
 							int skip_oid_verification,
+							int defer_fsync,
 							struct strbuf *err)
 {
 	static char term = '\n';
-	struct object *o;
 	int fd;
 
 	if (!skip_oid_verification) {
-		o = parse_object(refs->base.repo, oid);
-		if (!o) {
-			strbuf_addf(
-				err,
-				"trying to write ref '%s' with nonexistent object %s",
-				lock->ref_name, oid_to_hex(oid));
-			unlock_ref(lock);
-			return REF_TRANSACTION_ERROR_INVALID_NEW_VALUE;
-		}
-		if (o->type != OBJ_COMMIT && is_branch(lock->ref_name)) {
-			strbuf_addf(
-				err,
-				"trying to write non-commit object %s to branch '%s'",
-				oid_to_hex(oid), lock->ref_name);
+		enum ref_transaction_error ret =
+			check_new_ref_value(refs, lock->ref_name, oid, err);
+		if (ret) {
 			unlock_ref(lock);
-			return REF_TRANSACTION_ERROR_INVALID_NEW_VALUE;
+			return ret;
 		}
 	}
 	fd = get_lock_file_fd(&lock->lk);
 	if (write_in_full(fd, oid_to_hex(oid), refs->base.repo->hash_algo->hexsz) < 0 ||
 	    write_in_full(fd, &term, 1) < 0 ||
-	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_lock_file_fd(&lock->lk)) < 0 ||
+	    (defer_fsync ? fsync_ref_lockfile(fd) :
+	     fsync_component(FSYNC_COMPONENT_REFERENCE, fd)) < 0 ||
 	    close_ref_gently(lock) < 0) {
 		strbuf_addf(err,
 			    "couldn't write '%s'", get_lock_file_path(&lock->lk));
@@ -2535,9 +2578,25 @@ static enum ref_transaction_error check_old_oid(struct ref_update *update,
 struct files_transaction_backend_data {
 	struct ref_transaction *packed_transaction;
 	int packed_refs_locked;
+	/* Write new reference values to packed-refs, see REF_WRITE_PACKED. */
+	int write_packed;
 	struct strmap ref_locks;
 };
 
+/*
+ * Whether the new value of `update` may go to the packed-refs file
+ * instead of a loose ref when the transaction is large enough.
+ */
+static int can_write_packed(struct files_ref_store *refs,
+			    struct ref_update *update)
+{
+	return (refs->store_flags & REF_STORE_MAIN) &&
+		!(update->type & REF_ISSYMREF) &&
+		starts_with(update->refname, "refs/") &&
+		parse_worktree_ref(update->refname, NULL, NULL, NULL) ==
+			REF_WORKTREE_SHARED;
+}
+
 /*
  * Prepare for carrying out update:
  * - Lock the reference referred to by update.
@@ -2694,17 +2753,40 @@ static enum ref_transaction_error lock_ref_for_update(struct files_ref_store *re
 	} else if ((update->flags & REF_HAVE_NEW) &&
 		   !(update->flags & REF_DELETING) &&
 		   !(update->flags & REF_LOG_ONLY)) {
+		struct files_transaction_backend_data *backend_data =
+			transaction->backend_data;
+
 		if (!(update->type & REF_ISSYMREF) &&
 		    oideq(&lock->old_oid, &update->new_oid)) {
 			/*
 			 * The reference already has the desired
 			 * value, so we don't need to write it.
 			 */
+		} else if (backend_data->write_packed &&
+			   can_write_packed(refs, update)) {
+			/*
+			 * The caller adds the new value to the packed-refs
+			 * transaction. We keep holding the lock of the loose
+			 * ref so that nobody else writes it meanwhile.
+			 */
+			if (!(update->flags & REF_SKIP_OID_VERIFICATION)) {
+				ret = check_new_ref_value(refs, update->refname,
+							  &update->new_oid, err);
+				if (ret) {
+					char *write_err = strbuf_detach(err, NULL);
+					strbuf_addf(err,
+						    "cannot update ref '%s': %s",
+						    update->refname, write_err);
+					free(write_err);
+					goto out;
+				}
+			}
+			update->flags |= REF_WRITE_PACKED;
 		} else {
 			ret = write_ref_to_lockfile(
 				refs, lock, &update->new_oid,
 				update->flags & REF_SKIP_OID_VERIFICATION,
-				err);
+				1, err);
 			if (ret) {
 				char *write_err = strbuf_detach(err, NULL);
 
@@ -2784,6 +2866,55 @@ static void files_transaction_cleanup(struct files_ref_store *refs,
 	transaction->state = REF_TRANSACTION_CLOSED;
 }
 
+/*
+ * Mirror `update` into the packed-refs transaction, which is created on
+ * first use.
+ */
+static int add_packed_update(struct files_ref_store *refs,
+			     struct ref_transaction *transaction,
+			     struct ref_update *update,
+			     struct strbuf *err)
+{
+	struct files_transaction_backend_data *backend_data =
+		transaction->backend_data;
+
+	if (!backend_data->packed_transaction) {
+		backend_data->packed_transaction = ref_store_transaction_begin(
+				refs->packed_ref_store, transaction->flags, err);
+		if (!backend_data->packed_transaction)
+			return -1;
+	}
+
+	ref_transaction_add_update(backend_data->packed_transaction,
+				   update->refname, REF_HAVE_NEW | REF_NO_DEREF,
+				   &update->new_oid, NULL,
+				   NULL, NULL, NULL, NULL);
+	return 0;
+}
+
+/*
+ * Make the lockfiles written with core.fsyncMethod=batch durable by doing
+ * a full fsync of a dummy file, which flushes the disk's writeback cache.
+ */
+static int files_fsync_barrier(struct files_ref_store *refs, struct strbuf *err)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct tempfile *temp;
+	int ret = 0;
+
+	strbuf_addf(&path, "%s/bulk_fsync_XXXXXX", refs->base.gitdir);
+	temp = mks_tempfile(path.buf);
+	if (!temp ||
+	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(temp)) < 0) {
+		strbuf_addf(err, "couldn't flush references to disk: %s",
+			    strerror(errno));
+		ret = -1;
+	}
+	delete_tempfile(&temp);
+	strbuf_release(&path);
+	return ret;
+}
+
 static int files_transaction_prepare(struct ref_store *ref_store,
 				     struct ref_transaction *transaction,
 				     struct strbuf *err)
@@ -2798,6 +2929,7 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 	int head_type;
 	struct files_transaction_backend_data *backend_data;
 	struct ref_transaction *packed_transaction = NULL;
+	int needs_fsync_barrier = 0;
 
 	assert(err);
 
@@ -2809,6 +2941,8 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 	CALLOC_ARRAY(backend_data, 1);
 	strmap_init(&backend_data->ref_locks);
 	transaction->backend_data = backend_data;
+	backend_data->write_packed = refs->packed_refs_threshold > 0 &&
+		transaction->nr >= refs->packed_refs_threshold;
 
 	/*
 	 * Fail if any of the updates use REF_IS_PRUNING without REF_NO_DEREF.
@@ -2871,6 +3005,9 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 			goto cleanup;
 		}
 
+		if (update->flags & REF_NEEDS_COMMIT)
+			needs_fsync_barrier = 1;
+
 		if (update->flags & REF_DELETING &&
 		    !(update->flags & REF_LOG_ONLY) &&
 		    !(update->flags & REF_IS_PRUNING)) {
@@ -2878,24 +3015,10 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 			 * This reference has to be deleted from
 			 * packed-refs if it exists there.
 			 */
-			if (!packed_transaction) {
-				packed_transaction = ref_store_transaction_begin(
-						refs->packed_ref_store,
-						transaction->flags, err);
-				if (!packed_transaction) {
-					ret = REF_TRANSACTION_ERROR_GENERIC;
-					goto cleanup;
-				}
-
-				backend_data->packed_transaction =
-					packed_transaction;
+			if (add_packed_update(refs, transaction, update, err)) {
+				ret = REF_TRANSACTION_ERROR_GENERIC;
+				goto cleanup;
 			}
-
-			ref_transaction_add_update(
-					packed_transaction, update->refname,
-					REF_HAVE_NEW | REF_NO_DEREF,
-					&update->new_oid, NULL,
-					NULL, NULL, NULL, NULL);
 		}
 	}
 
@@ -2920,6 +3043,28 @@ static int files_transaction_prepare(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	/*
+	 * Queue the new values of references that go to packed-refs only
+	 * now, as the check above may have rejected some of them.
+	 */
+	for (i = 0; i < transaction->nr; i++) {
+		struct ref_update *update = transaction->updates[i];
+
+		if (!(update->flags & REF_WRITE_PACKED) || update->rejection_err)
+			continue;
+		if (add_packed_update(refs, transaction, update, err)) {
+			ret = REF_TRANSACTION_ERROR_GENERIC;
+			goto cleanup;
+		}
+	}
+	packed_transaction = backend_data->packed_transaction;
+
+	if (needs_fsync_barrier && batch_fsync_enabled(FSYNC_COMPONENT_REFERENCE) &&
+	    files_fsync_barrier(refs, err)) {
+		ret = REF_TRANSACTION_ERROR_GENERIC;
+		goto cleanup;
+	}
+
 	if (packed_transaction) {
 		if (packed_refs_lock(refs->packed_ref_store, 0, err)) {
 			ret = REF_TRANSACTION_ERROR_GENERIC;
@@ -3173,7 +3318,8 @@ static int files_transaction_finish(struct ref_store *ref_store,
 			continue;
 
 		if (update->flags & REF_NEEDS_COMMIT ||
-		    update->flags & REF_LOG_ONLY) {
+		    update->flags & REF_LOG_ONLY ||
+		    update->flags & REF_WRITE_PACKED) {
 			if (parse_and_write_reflog(refs, update, lock, err)) {
 				ret = REF_TRANSACTION_ERROR_GENERIC;
 				goto cleanup;
@@ -3229,7 +3375,8 @@ static int files_transaction_finish(struct ref_store *ref_store,
 	 * Perform deletes now that updates are safely completed.
 	 *
 	 * First delete any packed versions of the references, while
-	 * retaining the packed-refs lock:
+	 * retaining the packed-refs lock. This also writes the new values
+	 * of REF_WRITE_PACKED updates:
 	 */
 	if (packed_transaction) {
 		ret = ref_transaction_commit(packed_transaction, err);
@@ -3261,6 +3408,17 @@ static int files_transaction_finish(struct ref_store *ref_store,
 					goto cleanup;
 				}
 			}
+		} else if (update->flags & REF_WRITE_PACKED &&
+			   !is_null_oid(&lock->old_oid) &&
+			   !(update->type & REF_ISPACKED)) {
+			/* The stale loose ref would hide the packed one. */
+			update->flags |= REF_DELETED_RMDIR;
+			strbuf_reset(&sb);
+			files_ref_path(refs, &sb, lock->ref_name);
+			if (unlink_or_msg(sb.buf, err)) {
+				ret = REF_TRANSACTION_ERROR_GENERIC;
+				goto cleanup;
+			}
 		}
 	}
 
@@ -2,7 +2,9 @@
 #define DISABLE_SIGN_COMPARE_WARNINGS
 
 #include "../git-compat-util.h"
+#include "../chunk-format.h"
 #include "../config.h"
+#include "../csum-file.h"
 #include "../dir.h"
 #include "../fsck.h"
 #include "../gettext.h"
@@ -51,6 +53,52 @@ static enum mmap_strategy mmap_strategy = MMAP_OK;
 
 struct packed_ref_store;
 
+/*
+ * Version 2 of the `packed-refs` file is a binary file in the chunk
+ * format (see chunk-format.h). It starts with an 8-byte header:
+ *
+ *   4-byte signature "PREF", 1-byte version (2), 1-byte hash version
+ *   (see oid_version()), 1-byte number of chunks, 1 unused byte.
+ *
+ * The table of contents follows, then these chunks, and finally a
+ * checksum of everything before it:
+ *
+ *   "RFAN": A 4-byte length P of the prefix shared by all refnames,
+ *           followed by 256 4-byte entries. Entry `b` is the number of
+ *           references whose byte at offset P is at most `b`, where the
+ *           terminating NUL of a refname counts as byte 0.
+ *
+ *   "ROFF": For each reference, in refname order, the 4-byte offset of
+ *           its refname in the "RNAM" chunk.
+ *
+ *   "RNAM": The NUL-terminated refnames, padded with NULs to a multiple
+ *           of 4 bytes.
+ *
+ *   "ROID": For each reference, its raw object ID.
+ *
+ *   "RPEL": For each reference that can be peeled, its 4-byte position
+ *           followed by the raw peeled object ID, ordered by position.
+ *           References missing from this chunk cannot be peeled (i.e.,
+ *           the file is always "fully-peeled").
+ *
+ * All integers are in network byte order.
+ */
+#define PACKED_REFS_SIGNATURE 0x50524546 /* "PREF" */
+#define PACKED_REFS_HEADER_SIZE 8
+#define PACKED_REFS_BYTE_VERSION 4
+#define PACKED_REFS_BYTE_HASH_VERSION 5
+#define PACKED_REFS_BYTE_NUM_CHUNKS 6
+#define PACKED_REFS_CHUNK_ALIGNMENT 4
+
+#define PACKED_REFS_CHUNKID_FANOUT 0x5246414e /* "RFAN" */
+#define PACKED_REFS_CHUNKID_OFFSETS 0x524f4646 /* "ROFF" */
+#define PACKED_REFS_CHUNKID_NAMES 0x524e414d /* "RNAM" */
+#define PACKED_REFS_CHUNKID_OIDS 0x524f4944 /* "ROID" */
+#define PACKED_REFS_CHUNKID_PEELED 0x5250454c /* "RPEL" */
+
+#define PACKED_REFS_FANOUT_SIZE (4 + 256 * 4)
+#define PACKED_REFS_RECORD_SIZE 4
+
 /*
  * A `snapshot` represents one snapshot of a `packed-refs` file.
  *
@@ -105,6 +153,24 @@ struct snapshot {
 	 */
 	enum { PEELED_NONE, PEELED_TAGS, PEELED_FULLY } peeled;
 
+	/*
+	 * The version of the `packed-refs` file. For version 2, `start`
+	 * and `eof` delimit its "ROFF" chunk, so that record pointers
+	 * can be compared and searched just like for the text format,
+	 * and `v2` points at the other chunks.
+	 */
+	int version;
+	struct {
+		size_t size; /* of `buf` */
+		const char *names;
+		size_t names_len;
+		const unsigned char *oids;
+		const unsigned char *peeled;
+		uint32_t peeled_nr;
+		uint32_t prefix_len;
+		const unsigned char *fanout;
+	} v2;
+
 	/*
 	 * Count of references to this instance, including the pointer
 	 * from `packed_ref_store::snapshot`, if any. The instance
@@ -180,7 +246,10 @@ static void acquire_snapshot(struct snapshot *snapshot)
 static void clear_snapshot_buffer(struct snapshot *snapshot)
 {
 	if (snapshot->mmapped) {
-		if (munmap(snapshot->buf, snapshot->eof - snapshot->buf))
+		size_t size = snapshot->version == 2 ?
+			snapshot->v2.size : snapshot->eof - snapshot->buf;
+
+		if (munmap(snapshot->buf, size))
 			die_errno("error ummapping packed-refs file %s",
 				  snapshot->refs->path);
 		snapshot->mmapped = 0;
@@ -582,6 +651,272 @@ static int load_contents(struct snapshot *snapshot)
 	return ret;
 }
 
+static int is_packed_refs_v2(const char *buf, size_t size)
+{
+	return size >= 4 && get_be32(buf) == PACKED_REFS_SIGNATURE;
+}
+
+static uint32_t v2_record_nr(const struct snapshot *snapshot, const char *rec)
+{
+	return (rec - snapshot->start) / PACKED_REFS_RECORD_SIZE;
+}
+
+static const char *v2_record_at(const struct snapshot *snapshot, uint32_t nr)
+{
+	return snapshot->start + st_mult(nr, PACKED_REFS_RECORD_SIZE);
+}
+
+static uint32_t v2_fanout(const struct snapshot *snapshot, int byte)
+{
+	return get_be32(snapshot->v2.fanout + 4 + 4 * byte);
+}
+
+/*
+ * Return the refname of the record at `rec`, or NULL if its offset
+ * is out of bounds.
+ */
+static const char *v2_record_refname_gently(const struct snapshot *snapshot,
+					    const char *rec)
+{
+	uint32_t offset = get_be32(rec);
+
+	if (offset >= snapshot->v2.names_len)
+		return NULL;
+	return snapshot->v2.names + offset;
+}
+
+static const char *v2_record_refname(const struct snapshot *snapshot,
+				     const char *rec)
+{
+	const char *refname = v2_record_refname_gently(snapshot, rec);
+
+	if (!refname)
+		die("invalid refname offset in %s", snapshot->refs->path);
+	return refname;
+}
+
+static void v2_record_oid(const struct snapshot *snapshot, const char *rec,
+			  struct object_id *oid)
+{
+	const struct git_hash_algo *algop = snapshot->refs->base.repo->hash_algo;
+
+	oidread(oid, snapshot->v2.oids +
+		st_mult(v2_record_nr(snapshot, rec), algop->rawsz), algop);
+}
+
+/*
+ * Look up the peeled value of the record at `rec`. Return 0 and fill
+ * in `peeled` if there is one, -1 otherwise.
+ */
+static int v2_record_peeled(const struct snapshot *snapshot, const char *rec,
+			    struct object_id *peeled)
+{
+	const struct git_hash_algo *algop = snapshot->refs->base.repo->hash_algo;
+	size_t entry_size = 4 + algop->rawsz;
+	uint32_t nr = v2_record_nr(snapshot, rec);
+	uint32_t lo = 0, hi = snapshot->v2.peeled_nr;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const unsigned char *entry = snapshot->v2.peeled +
+			st_mult(mid, entry_size);
+		uint32_t mid_nr = get_be32(entry);
+
+		if (mid_nr < nr) {
+			lo = mid + 1;
+		} else if (mid_nr > nr) {
+			hi = mid;
+		} else {
+			oidread(peeled, entry + 4, algop);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Point `snapshot` at the chunks of the version 2 `packed-refs` file
+ * in `snapshot->buf`. On error, write a message to `err` and return -1.
+ */
+static int parse_snapshot_v2(struct snapshot *snapshot,
+			     const struct git_hash_algo *algop,
+			     struct strbuf *err)
+{
+	const unsigned char *data = (const unsigned char *)snapshot->buf;
+	size_t size = snapshot->eof - snapshot->buf;
+	const unsigned char *offsets, *names;
+	size_t offsets_len, oids_len, peeled_len, fanout_len;
+	struct chunkfile *cf = NULL;
+	uint32_t nr, prev = 0;
+	int ret = -1;
+
+	if (size < PACKED_REFS_HEADER_SIZE + algop->rawsz) {
+		strbuf_addstr(err, "file is too small");
+		goto out;
+	}
+	if (data[PACKED_REFS_BYTE_VERSION] != 2) {
+		strbuf_addf(err, "unsupported version %u",
+			    data[PACKED_REFS_BYTE_VERSION]);
+		goto out;
+	}
+	if (data[PACKED_REFS_BYTE_HASH_VERSION] != oid_version(algop)) {
+		strbuf_addf(err, "hash version %u does not match version %u",
+			    data[PACKED_REFS_BYTE_HASH_VERSION], oid_version(algop));
+		goto out;
+	}
+
+	cf = init_chunkfile(NULL);
+	if (read_table_of_contents(cf, data, size, PACKED_REFS_HEADER_SIZE,
+				   data[PACKED_REFS_BYTE_NUM_CHUNKS],
+				   PACKED_REFS_CHUNK_ALIGNMENT) ||
+	    pair_chunk(cf, PACKED_REFS_CHUNKID_FANOUT,
+		       &snapshot->v2.fanout, &fanout_len) ||
+	    pair_chunk(cf, PACKED_REFS_CHUNKID_OFFSETS, &offsets, &offsets_len) ||
+	    pair_chunk(cf, PACKED_REFS_CHUNKID_NAMES, &names,
+		       &snapshot->v2.names_len) ||
+	    pair_chunk(cf, PACKED_REFS_CHUNKID_OIDS, &snapshot->v2.oids, &oids_len) ||
+	    pair_chunk(cf, PACKED_REFS_CHUNKID_PEELED,
+		       &snapshot->v2.peeled, &peeled_len)) {
+		strbuf_addstr(err, "missing or corrupt chunks");
+		goto out;
+	}
+
+	nr = offsets_len / PACKED_REFS_RECORD_SIZE;
+	if (offsets_len % PACKED_REFS_RECORD_SIZE ||
+	    oids_len != st_mult(nr, algop->rawsz) ||
+	    peeled_len % (4 + algop->rawsz) ||
+	    peeled_len / (4 + algop->rawsz) > nr ||
+	    fanout_len != PACKED_REFS_FANOUT_SIZE ||
+	    (snapshot->v2.names_len && names[snapshot->v2.names_len - 1]) ||
+	    (nr && !snapshot->v2.names_len)) {
+		strbuf_addstr(err, "chunks have inconsistent sizes");
+		goto out;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		uint32_t cur = get_be32(snapshot->v2.fanout + 4 + 4 * i);
+		if (cur < prev || cur > nr) {
+			strbuf_addstr(err, "fanout is not monotonic");
+			goto out;
+		}
+		prev = cur;
+	}
+	if (prev != nr) {
+		strbuf_addstr(err, "fanout does not cover all references");
+		goto out;
+	}
+
+	snapshot->version = 2;
+	snapshot->peeled = PEELED_FULLY;
+	snapshot->v2.size = size;
+	snapshot->v2.names = (const char *)names;
+	snapshot->v2.peeled_nr = peeled_len / (4 + algop->rawsz);
+	snapshot->v2.prefix_len = get_be32(snapshot->v2.fanout);
+	snapshot->start = (char *)offsets;
+	snapshot->eof = (char *)offsets + offsets_len;
+
+	if (nr) {
+		const char *first = v2_record_refname_gently(snapshot,
+							     snapshot->start);
+		if (!first || strlen(first) < snapshot->v2.prefix_len) {
+			strbuf_addstr(err, "invalid common refname prefix");
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	free_chunkfile(cf);
+	return ret;
+}
+
+/*
+ * Like cmp_record_to_refname(), but for the NUL-terminated refnames
+ * of version 2.
+ */
+static int cmp_v2_refname(const char *r1, const char *r2, int start)
+{
+	while (1) {
+		if (!*r1)
+			return *r2 ? -1 : 0;
+		if (!*r2)
+			return start ? 1 : -1;
+		if (*r1 != *r2)
+			return (unsigned char)*r1 < (unsigned char)*r2 ? -1 : +1;
+		r1++;
+		r2++;
+	}
+}
+
+/*
+ * Narrow down the range of records [*lo, *hi) that may compare equal
+ * to `refname` via the fanout. Outside of the range, all records
+ * compare smaller before and greater after it.
+ */
+static void v2_fanout_range(const struct snapshot *snapshot,
+			    const char *refname, uint32_t *lo, uint32_t *hi)
+{
+	uint32_t nr = v2_record_nr(snapshot, snapshot->eof);
+	uint32_t prefix_len = snapshot->v2.prefix_len;
+	const char *common;
+	unsigned char byte;
+
+	*lo = 0;
+	*hi = nr;
+	if (!nr)
+		return;
+
+	common = v2_record_refname(snapshot, snapshot->start);
+	for (uint32_t i = 0; i < prefix_len; i++) {
+		if (!refname[i])
+			return;
+		if (refname[i] != common[i]) {
+			if ((unsigned char)refname[i] < (unsigned char)common[i])
+				*hi = 0;
+			else
+				*lo = nr;
+			return;
+		}
+	}
+
+	/*
+	 * Longer refnames compare greater or smaller than a refname
+	 * ending here depending on the kind of search, so don't narrow.
+	 */
+	byte = refname[prefix_len];
+	if (!byte)
+		return;
+	*lo = v2_fanout(snapshot, byte - 1);
+	*hi = v2_fanout(snapshot, byte);
+}
+
+static const char *find_reference_location_v2(struct snapshot *snapshot,
+					      const char *refname, int mustexist,
+					      int start)
+{
+	uint32_t lo, hi;
+
+	v2_fanout_range(snapshot, refname, &lo, &hi);
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		const char *rec = v2_record_at(snapshot, mid);
+		int cmp = cmp_v2_refname(v2_record_refname(snapshot, rec),
+					 refname, start);
+
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return rec;
+	}
+
+	if (mustexist)
+		return NULL;
+	return v2_record_at(snapshot, lo);
+}
+
 static const char *find_reference_location_1(struct snapshot *snapshot,
 					     const char *refname, int mustexist,
 					     int start)
@@ -608,6 +943,10 @@ static const char *find_reference_location_1(struct snapshot *snapshot,
 	 */
 	const char *hi = snapshot->eof;
 
+	if (snapshot->version == 2)
+		return find_reference_location_v2(snapshot, refname,
+						  mustexist, start);
+
 	while (lo != hi) {
 		const char *mid, *rec;
 		int cmp;
@@ -710,6 +1049,34 @@ static struct snapshot *create_snapshot(struct packed_ref_store *refs)
 	if (!load_contents(snapshot))
 		return snapshot;
 
+	if (is_packed_refs_v2(snapshot->buf, snapshot->eof - snapshot->buf)) {
+		struct strbuf err = STRBUF_INIT;
+
+		/*
+		 * Only the extension keeps older Git, which would take the
+		 * file for a corrupt text file, away from this repository.
+		 */
+		if (!refs->base.repo->repository_format_packed_refs_version)
+			die(_("packed-refs file %s uses version 2, but "
+			      "extensions.packedRefsVersion is not set"),
+			    refs->path);
+
+		if (mmap_strategy != MMAP_OK && snapshot->mmapped) {
+			size_t size = snapshot->eof - snapshot->buf;
+			char *buf_copy = xmalloc(size);
+
+			memcpy(buf_copy, snapshot->buf, size);
+			clear_snapshot_buffer(snapshot);
+			snapshot->buf = snapshot->start = buf_copy;
+			snapshot->eof = buf_copy + size;
+		}
+
+		if (parse_snapshot_v2(snapshot, refs->base.repo->hash_algo, &err))
+			die("packed-refs file %s is corrupt: %s",
+			    refs->path, err.buf);
+		return snapshot;
+	}
+
 	/* If the file has a header line, process it: */
 	if (snapshot->buf < snapshot->eof && *snapshot->buf == '#') {
 		char *tmp, *p, *eol;
@@ -827,7 +1194,9 @@ static int packed_read_raw_ref(struct ref_store *ref_store, const char *refname,
 		return -1;
 	}
 
-	if (get_oid_hex_algop(rec, oid, ref_store->repo->hash_algo))
+	if (snapshot->version == 2)
+		v2_record_oid(snapshot, rec, oid);
+	else if (get_oid_hex_algop(rec, oid, ref_store->repo->hash_algo))
 		die_invalid_line(refs->path, rec, snapshot->eof - rec);
 
 	*type = REF_ISPACKED;
@@ -873,6 +1242,38 @@ struct packed_ref_iterator {
 	unsigned int flags;
 };
 
+/*
+ * Read the record at `iter->pos` of a version 2 snapshot, which is
+ * not at its end, and advance to the next one. The refname points
+ * directly into the snapshot.
+ */
+static int next_record_v2(struct packed_ref_iterator *iter)
+{
+	struct snapshot *snapshot = iter->snapshot;
+
+	iter->base.flags = REF_ISPACKED | REF_KNOWS_PEELED;
+	iter->base.refname = v2_record_refname(snapshot, iter->pos);
+	v2_record_oid(snapshot, iter->pos, &iter->oid);
+
+	if (check_refname_format(iter->base.refname, REFNAME_ALLOW_ONELEVEL)) {
+		if (!refname_is_safe(iter->base.refname))
+			die("packed refname is dangerous: %s",
+			    iter->base.refname);
+		oidclr(&iter->oid, iter->repo->hash_algo);
+		iter->base.flags |= REF_BAD_NAME | REF_ISBROKEN;
+	}
+
+	if ((iter->base.flags & REF_ISBROKEN)) {
+		oidclr(&iter->peeled, iter->repo->hash_algo);
+		iter->base.flags &= ~REF_KNOWS_PEELED;
+	} else if (v2_record_peeled(snapshot, iter->pos, &iter->peeled)) {
+		oidclr(&iter->peeled, iter->repo->hash_algo);
+	}
+
+	iter->pos += PACKED_REFS_RECORD_SIZE;
+	return ITER_OK;
+}
+
 /*
  * Move the iterator to the next record in the snapshot. Adjust the fields in
  * `iter` and return `ITER_OK` or `ITER_DONE`. This function does not free the
@@ -908,6 +1309,9 @@ static int next_record(struct packed_ref_iterator *iter)
 	if (iter->pos == iter->eof)
 		return ITER_DONE;
 
+	if (iter->snapshot->version == 2)
+		return next_record_v2(iter);
+
 	iter->base.flags = REF_ISPACKED;
 	p = iter->pos;
 
@@ -1203,15 +1607,189 @@ static struct ref_iterator *packed_ref_iterator_begin(
 }
 
 /*
- * Write an entry to the packed-refs file for the specified refname.
- * If peeled is non-NULL, write it as the entry's peeled value. On
- * error, return a nonzero value and leave errno set at the value left
- * by the failing call to `fprintf()`.
+ * The references collected for writing a version 2 `packed-refs`
+ * file. Unlike the text format, it cannot be streamed because the
+ * sizes of all chunks have to be known up front.
  */
-static int write_packed_entry(FILE *fh, const char *refname,
+struct packed_refs_v2_writer {
+	const struct git_hash_algo *algop;
+	struct packed_refs_v2_entry {
+		char *refname;
+		struct object_id oid;
+		struct object_id peeled;
+		unsigned has_peeled : 1;
+	} *entries;
+	size_t nr, alloc;
+	size_t names_len;
+	uint32_t peeled_nr;
+	uint32_t prefix_len;
+};
+
+static void packed_refs_v2_writer_release(struct packed_refs_v2_writer *w)
+{
+	for (size_t i = 0; i < w->nr; i++)
+		free(w->entries[i].refname);
+	free(w->entries);
+}
+
+static int packed_refs_v2_add(struct packed_refs_v2_writer *w,
+			      const char *refname,
 			      const struct object_id *oid,
 			      const struct object_id *peeled)
 {
+	struct packed_refs_v2_entry *e;
+	size_t len = strlen(refname);
+
+	if (w->nr >= UINT32_MAX || w->names_len + len + 1 > UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	if (!w->nr) {
+		w->prefix_len = len;
+	} else {
+		const char *prev = w->entries[0].refname;
+		uint32_t i;
+
+		/*
+		 * The references come in sorted order, so it is enough
+		 * to shorten the prefix shared with the first one.
+		 */
+		for (i = 0; i < w->prefix_len && prev[i] == refname[i]; i++)
+			;
+		w->prefix_len = i;
+	}
+
+	ALLOC_GROW(w->entries, w->nr + 1, w->alloc);
+	e = &w->entries[w->nr++];
+	e->refname = xmemdupz(refname, len);
+	oidcpy(&e->oid, oid);
+	e->has_peeled = !!peeled;
+	if (peeled) {
+		oidcpy(&e->peeled, peeled);
+		w->peeled_nr++;
+	}
+	w->names_len += len + 1;
+	return 0;
+}
+
+static int write_packed_refs_v2_fanout(struct hashfile *f, void *data)
+{
+	struct packed_refs_v2_writer *w = data;
+	uint32_t fanout[256] = { 0 };
+
+	for (size_t i = 0; i < w->nr; i++)
+		fanout[(unsigned char)w->entries[i].refname[w->prefix_len]]++;
+
+	hashwrite_be32(f, w->prefix_len);
+	for (int i = 0; i < 256; i++) {
+		if (i)
+			fanout[i] += fanout[i - 1];
+		hashwrite_be32(f, fanout[i]);
+	}
+	return 0;
+}
+
+static int write_packed_refs_v2_offsets(struct hashfile *f, void *data)
+{
+	struct packed_refs_v2_writer *w = data;
+	uint32_t offset = 0;
+
+	for (size_t i = 0; i < w->nr; i++) {
+		hashwrite_be32(f, offset);
+		offset += strlen(w->entries[i].refname) + 1;
+	}
+	return 0;
+}
+
+static int write_packed_refs_v2_names(struct hashfile *f, void *data)
+{
+	struct packed_refs_v2_writer *w = data;
+	static const unsigned char padding[PACKED_REFS_CHUNK_ALIGNMENT];
+
+	for (size_t i = 0; i < w->nr; i++)
+		hashwrite(f, w->entries[i].refname,
+			  strlen(w->entries[i].refname) + 1);
+	if (w->names_len % PACKED_REFS_CHUNK_ALIGNMENT)
+		hashwrite(f, padding, PACKED_REFS_CHUNK_ALIGNMENT -
+			  w->names_len % PACKED_REFS_CHUNK_ALIGNMENT);
+	return 0;
+}
+
+static int write_packed_refs_v2_oids(struct hashfile *f, void *data)
+{
+	struct packed_refs_v2_writer *w = data;
+
+	for (size_t i = 0; i < w->nr; i++)
+		hashwrite(f, w->entries[i].oid.hash, w->algop->rawsz);
+	return 0;
+}
+
+static int write_packed_refs_v2_peeled(struct hashfile *f, void *data)
+{
+	struct packed_refs_v2_writer *w = data;
+
+	for (size_t i = 0; i < w->nr; i++) {
+		if (!w->entries[i].has_peeled)
+			continue;
+		hashwrite_be32(f, i);
+		hashwrite(f, w->entries[i].peeled.hash, w->algop->rawsz);
+	}
+	return 0;
+}
+
+/*
+ * Write the references collected in `w` to `fd` as a version 2
+ * `packed-refs` file and sync it to disk.
+ */
+static void write_packed_refs_v2(struct packed_refs_v2_writer *w,
+				 int fd, const char *path)
+{
+	struct hashfile *f = hashfd(w->algop, fd, path);
+	struct chunkfile *cf = init_chunkfile(f);
+
+	add_chunk(cf, PACKED_REFS_CHUNKID_FANOUT, PACKED_REFS_FANOUT_SIZE,
+		  write_packed_refs_v2_fanout);
+	add_chunk(cf, PACKED_REFS_CHUNKID_OFFSETS,
+		  st_mult(w->nr, PACKED_REFS_RECORD_SIZE),
+		  write_packed_refs_v2_offsets);
+	add_chunk(cf, PACKED_REFS_CHUNKID_NAMES,
+		  st_add(w->names_len, PACKED_REFS_CHUNK_ALIGNMENT - 1) &
+		  ~(size_t)(PACKED_REFS_CHUNK_ALIGNMENT - 1),
+		  write_packed_refs_v2_names);
+	add_chunk(cf, PACKED_REFS_CHUNKID_OIDS, st_mult(w->nr, w->algop->rawsz),
+		  write_packed_refs_v2_oids);
+	add_chunk(cf, PACKED_REFS_CHUNKID_PEELED,
+		  st_mult(w->peeled_nr, 4 + w->algop->rawsz),
+		  write_packed_refs_v2_peeled);
+
+	hashwrite_be32(f, PACKED_REFS_SIGNATURE);
+	hashwrite_u8(f, 2);
+	hashwrite_u8(f, oid_version(w->algop));
+	hashwrite_u8(f, get_num_chunks(cf));
+	hashwrite_u8(f, 0); /* unused */
+	write_chunkfile(cf, w);
+
+	finalize_hashfile(f, NULL, FSYNC_COMPONENT_REFERENCE,
+			  CSUM_HASH_IN_STREAM | CSUM_FSYNC);
+	free_chunkfile(cf);
+}
+
+/*
+ * Write an entry to the packed-refs file for the specified refname,
+ * or collect it in `v2` if that is non-NULL. If peeled is non-NULL,
+ * write it as the entry's peeled value. On error, return a nonzero
+ * value and leave errno set at the value left by the failing call to
+ * `fprintf()`.
+ */
+static int write_packed_entry(FILE *fh, struct packed_refs_v2_writer *v2,
+			      const char *refname,
+			      const struct object_id *oid,
+			      const struct object_id *peeled)
+{
+	if (v2)
+		return packed_refs_v2_add(v2, refname, oid, peeled);
+
 	if (fprintf(fh, "%s %s\n", oid_to_hex(oid), refname) < 0 ||
 	    (peeled && fprintf(fh, "^%s\n", oid_to_hex(peeled)) < 0))
 		return -1;
@@ -1369,7 +1947,11 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 	struct ref_iterator *iter = NULL;
 	size_t i;
 	int ok;
-	FILE *out;
+	FILE *out = NULL;
+	struct packed_refs_v2_writer v2_writer = {
+		.algop = refs->base.repo->hash_algo,
+	};
+	struct packed_refs_v2_writer *v2 = NULL;
 	struct strbuf sb = STRBUF_INIT;
 	char *packed_refs_path;
 
@@ -1393,15 +1975,19 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 	}
 	strbuf_release(&sb);
 
-	out = fdopen_tempfile(refs->tempfile, "w");
-	if (!out) {
-		strbuf_addf(err, "unable to fdopen packed-refs tempfile: %s",
-			    strerror(errno));
-		goto error;
-	}
+	if (refs->base.repo->repository_format_packed_refs_version == 2) {
+		v2 = &v2_writer;
+	} else {
+		out = fdopen_tempfile(refs->tempfile, "w");
+		if (!out) {
+			strbuf_addf(err, "unable to fdopen packed-refs tempfile: %s",
+				    strerror(errno));
+			goto error;
+		}
 
-	if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
-		goto write_error;
+		if (fprintf(out, "%s", PACKED_REFS_HEADER) < 0)
+			goto write_error;
+	}
 
 	/*
 	 * We iterate in parallel through the current list of refs and
@@ -1522,7 +2108,7 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 			struct object_id peeled;
 			int peel_error = ref_iterator_peel(iter, &peeled);
 
-			if (write_packed_entry(out, iter->refname,
+			if (write_packed_entry(out, v2, iter->refname,
 					       iter->oid,
 					       peel_error ? NULL : &peeled))
 				goto write_error;
@@ -1546,7 +2132,7 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 						     &update->new_oid,
 						     &peeled);
 
-			if (write_packed_entry(out, update->refname,
+			if (write_packed_entry(out, v2, update->refname,
 					       &update->new_oid,
 					       peel_error ? NULL : &peeled))
 				goto write_error;
@@ -1561,17 +2147,24 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 		goto error;
 	}
 
-	if (fflush(out) ||
-	    fsync_component(FSYNC_COMPONENT_REFERENCE, get_tempfile_fd(refs->tempfile)) ||
+	if (v2)
+		write_packed_refs_v2(v2, get_tempfile_fd(refs->tempfile),
+				     get_tempfile_path(refs->tempfile));
+
+	if ((out && fflush(out)) ||
+	    (out && fsync_component(FSYNC_COMPONENT_REFERENCE,
+				    get_tempfile_fd(refs->tempfile))) ||
 	    close_tempfile_gently(refs->tempfile)) {
 		strbuf_addf(err, "error closing file %s: %s",
 			    get_tempfile_path(refs->tempfile),
 			    strerror(errno));
 		strbuf_release(&sb);
 		delete_tempfile(&refs->tempfile);
+		packed_refs_v2_writer_release(&v2_writer);
 		return REF_TRANSACTION_ERROR_GENERIC;
 	}
 
+	packed_refs_v2_writer_release(&v2_writer);
 	return 0;
 
 write_error:
@@ -1582,6 +2175,7 @@ static enum ref_transaction_error write_with_updates(struct packed_ref_store *re
 error:
 	ref_iterator_free(iter);
 	delete_tempfile(&refs->tempfile);
+	packed_refs_v2_writer_release(&v2_writer);
 	return ret;
 }
 
@@ -2062,6 +2656,96 @@ static int packed_fsck_ref_content(struct fsck_options *o,
 	return ret;
 }
 
+static int packed_fsck_v2(struct fsck_options *o,
+			  struct ref_store *ref_store,
+			  struct snapshot *snapshot)
+{
+	const struct git_hash_algo *algop = ref_store->repo->hash_algo;
+	struct strbuf packed_entry = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	const char *common = NULL, *prev = NULL;
+	uint32_t nr, prev_peeled = 0;
+	int ret = 0;
+
+	if (!hashfile_checksum_valid(algop, (unsigned char *)snapshot->buf,
+				     snapshot->eof - snapshot->buf)) {
+		struct fsck_ref_report report = { .path = "packed-refs.header" };
+		ret = fsck_report_ref(o, &report, FSCK_MSG_BAD_PACKED_REF_HEADER,
+				      "checksum mismatch");
+		goto cleanup;
+	}
+
+	if (parse_snapshot_v2(snapshot, algop, &err)) {
+		struct fsck_ref_report report = { .path = "packed-refs.header" };
+		ret = fsck_report_ref(o, &report, FSCK_MSG_BAD_PACKED_REF_HEADER,
+				      "%s", err.buf);
+		goto cleanup;
+	}
+
+	nr = v2_record_nr(snapshot, snapshot->eof);
+	for (uint32_t i = 0; i < nr; i++) {
+		const char *rec = v2_record_at(snapshot, i);
+		const char *refname = v2_record_refname_gently(snapshot, rec);
+		struct fsck_ref_report report = { 0 };
+		unsigned char byte;
+
+		strbuf_reset(&packed_entry);
+		strbuf_addf(&packed_entry, "packed-refs entry %"PRIu32, i);
+		report.path = packed_entry.buf;
+
+		if (!refname) {
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_BAD_PACKED_REF_ENTRY,
+					       "refname offset out of bounds");
+			continue;
+		}
+
+		if (check_refname_format(refname, 0))
+			ret |= fsck_report_ref(o, &report, FSCK_MSG_BAD_REF_NAME,
+					       "has bad refname '%s'", refname);
+
+		if (prev && strcmp(prev, refname) >= 0)
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_PACKED_REF_UNSORTED,
+					       "refname '%s' is less than previous refname '%s'",
+					       refname, prev);
+		prev = refname;
+
+		if (!common)
+			common = refname;
+		byte = refname[snapshot->v2.prefix_len];
+		if (strncmp(common, refname, snapshot->v2.prefix_len) ||
+		    i < (byte ? v2_fanout(snapshot, byte - 1) : 0) ||
+		    i >= v2_fanout(snapshot, byte))
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_BAD_PACKED_REF_ENTRY,
+					       "refname '%s' does not match the fanout",
+					       refname);
+	}
+
+	for (uint32_t i = 0; i < snapshot->v2.peeled_nr; i++) {
+		uint32_t pos = get_be32(snapshot->v2.peeled +
+					st_mult(i, 4 + algop->rawsz));
+
+		if (pos >= nr || (i && pos <= prev_peeled)) {
+			struct fsck_ref_report report = { 0 };
+
+			strbuf_reset(&packed_entry);
+			strbuf_addf(&packed_entry, "packed-refs peeled entry %"PRIu32, i);
+			report.path = packed_entry.buf;
+			ret |= fsck_report_ref(o, &report,
+					       FSCK_MSG_BAD_PACKED_REF_ENTRY,
+					       "invalid position %"PRIu32, pos);
+		}
+		prev_peeled = pos;
+	}
+
+cleanup:
+	strbuf_release(&packed_entry);
+	strbuf_release(&err);
+	return ret;
+}
+
 static int packed_fsck(struct ref_store *ref_store,
 		       struct fsck_options *o,
 		       struct worktree *wt)
@@ -2121,6 +2805,19 @@ static int packed_fsck(struct ref_store *ref_store,
 		goto cleanup;
 	}
 
+	if (is_packed_refs_v2(snapshot.buf, snapshot.eof - snapshot.buf)) {
+		if (!ref_store->repo->repository_format_packed_refs_version) {
+			struct fsck_ref_report report = { .path = "packed-refs.header" };
+			ret = fsck_report_ref(o, &report,
+					      FSCK_MSG_BAD_PACKED_REF_HEADER,
+					      "version 2 file without extensions.packedRefsVersion");
+			goto cleanup;
+		}
+		snapshot.refs = refs;
+		ret = packed_fsck_v2(o, ref_store, &snapshot);
+		goto cleanup;
+	}
+
 	ret = packed_fsck_ref_content(o, ref_store, &sorted, snapshot.start,
 				      snapshot.eof);
 	if (!ret && sorted)
@@ -343,6 +343,8 @@ static int reftable_be_config(const char *var, const char *value,
 		if (lock_timeout < 0 && lock_timeout != -1)
 			die("reftable lock timeout does not support negative values other than -1");
 		opts->lock_timeout_ms = lock_timeout;
+	} else if (!strcmp(var, "reftable.blockcachesize")) {
+		opts->block_cache_size = git_config_ulong(var, value, ctx->kvi);
 	}
 
 	return 0;
@@ -384,6 +386,7 @@ static struct ref_store *reftable_be_init(struct repository *repo,
 	refs->write_options.disable_auto_compact =
 		!git_env_bool("GIT_TEST_REFTABLE_AUTOCOMPACTION", 1);
 	refs->write_options.lock_timeout_ms = 100;
+	refs->write_options.block_cache_size = 4 * 1024 * 1024;
 	refs->write_options.fsync = reftable_be_fsync;
 
 	git_config(reftable_be_config, &refs->write_options);
@@ -0,0 +1,257 @@
+/*
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file or at
+ * https://developers.google.com/open-source/licenses/bsd
+ */
+
+#include "blockcache.h"
+
+#include "basics.h"
+#include "block.h"
+#include "blocksource.h"
+#include "reftable-error.h"
+
+struct block_cache_entry {
+	const struct reftable_table *table;
+	uint64_t off;
+
+	struct block_cache_entry *bucket_next;
+	struct block_cache_entry *lru_prev, *lru_next;
+
+	/* One reference for the cache, one for each block using the entry. */
+	uint64_t refcount;
+
+	/* The decoded block, without its zlib state. */
+	uint32_t header_off;
+	uint32_t hash_size;
+	uint16_t restart_count;
+	uint32_t restart_off;
+	uint32_t full_block_size;
+	uint8_t block_type;
+	unsigned char *data;
+	size_t len;
+};
+
+static void entry_decref(struct block_cache_entry *e)
+{
+	if (--e->refcount)
+		return;
+	reftable_free(e->data);
+	reftable_free(e);
+}
+
+/*
+ * Blocks served from the cache point into the cache entry instead of the
+ * table's block source; releasing them drops their entry reference.
+ */
+static void entry_release_data(void *arg, struct reftable_block_data *data REFTABLE_UNUSED)
+{
+	entry_decref(arg);
+}
+
+static struct reftable_block_source_vtable entry_vtable = {
+	.release_data = &entry_release_data,
+};
+
+static size_t entry_bucket(const struct reftable_block_cache *cache,
+			   const struct reftable_table *t, uint64_t off)
+{
+	uint64_t h = (uint64_t)(uintptr_t)t * 0x9e3779b97f4a7c15ULL;
+	h ^= off * 0xff51afd7ed558ccdULL;
+	return (h ^ (h >> 32)) & (cache->buckets_nr - 1);
+}
+
+static void lru_unlink(struct reftable_block_cache *cache,
+		       struct block_cache_entry *e)
+{
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		cache->lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		cache->lru_tail = e->lru_prev;
+	e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push(struct reftable_block_cache *cache,
+		     struct block_cache_entry *e)
+{
+	e->lru_next = cache->lru_head;
+	if (cache->lru_head)
+		cache->lru_head->lru_prev = e;
+	else
+		cache->lru_tail = e;
+	cache->lru_head = e;
+}
+
+static void entry_remove(struct reftable_block_cache *cache,
+			 struct block_cache_entry *e)
+{
+	struct block_cache_entry **p;
+
+	for (p = &cache->buckets[entry_bucket(cache, e->table, e->off)];
+	     *p != e; p = &(*p)->bucket_next)
+		;
+	*p = e->bucket_next;
+	lru_unlink(cache, e);
+
+	cache->size -= e->len;
+	cache->entries_nr--;
+	entry_decref(e);
+}
+
+static int grow_buckets(struct reftable_block_cache *cache)
+{
+	struct block_cache_entry **old = cache->buckets;
+	size_t old_nr = cache->buckets_nr;
+
+	cache->buckets_nr = old_nr ? 2 * old_nr : 64;
+	cache->buckets = reftable_calloc(cache->buckets_nr,
+					 sizeof(*cache->buckets));
+	if (!cache->buckets) {
+		cache->buckets = old;
+		cache->buckets_nr = old_nr;
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	}
+
+	for (size_t i = 0; i < old_nr; i++) {
+		struct block_cache_entry *e = old[i], *next;
+		for (; e; e = next) {
+			size_t b = entry_bucket(cache, e->table, e->off);
+			next = e->bucket_next;
+			e->bucket_next = cache->buckets[b];
+			cache->buckets[b] = e;
+		}
+	}
+	reftable_free(old);
+	return 0;
+}
+
+int block_cache_new(struct reftable_block_cache **out, uint64_t max_size)
+{
+	struct reftable_block_cache *cache;
+
+	REFTABLE_CALLOC_ARRAY(cache, 1);
+	if (!cache)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	cache->max_size = max_size;
+	cache->refcount = 1;
+	if (grow_buckets(cache) < 0) {
+		reftable_free(cache);
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	}
+
+	*out = cache;
+	return 0;
+}
+
+void block_cache_incref(struct reftable_block_cache *cache)
+{
+	cache->refcount++;
+}
+
+void block_cache_decref(struct reftable_block_cache *cache)
+{
+	if (!cache || --cache->refcount)
+		return;
+	while (cache->lru_head)
+		entry_remove(cache, cache->lru_head);
+	reftable_free(cache->buckets);
+	reftable_free(cache);
+}
+
+int block_cache_get(struct reftable_block_cache *cache,
+		    const struct reftable_table *t, uint64_t off,
+		    struct reftable_block *block)
+{
+	struct block_cache_entry *e = cache->buckets[entry_bucket(cache, t, off)];
+
+	for (; e; e = e->bucket_next)
+		if (e->table == t && e->off == off)
+			break;
+
+	reftable_trace_block_cache_lookup(!!e);
+	if (!e) {
+		cache->misses++;
+		return 0;
+	}
+	cache->hits++;
+
+	lru_unlink(cache, e);
+	lru_push(cache, e);
+
+	block_source_release_data(&block->block_data);
+	block->block_data.data = e->data;
+	block->block_data.len = e->len;
+	block->block_data.source.ops = &entry_vtable;
+	block->block_data.source.arg = e;
+	e->refcount++;
+
+	block->header_off = e->header_off;
+	block->hash_size = e->hash_size;
+	block->restart_count = e->restart_count;
+	block->restart_off = e->restart_off;
+	block->full_block_size = e->full_block_size;
+	block->block_type = e->block_type;
+	return 1;
+}
+
+int block_cache_put(struct reftable_block_cache *cache,
+		    const struct reftable_table *t, uint64_t off,
+		    const struct reftable_block *block)
+{
+	struct block_cache_entry *e;
+	size_t b;
+
+	if (block->block_data.len > cache->max_size)
+		return 0;
+
+	if (cache->entries_nr >= cache->buckets_nr &&
+	    grow_buckets(cache) < 0)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+	REFTABLE_CALLOC_ARRAY(e, 1);
+	if (!e)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	REFTABLE_ALLOC_ARRAY(e->data, block->block_data.len);
+	if (!e->data) {
+		reftable_free(e);
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+	}
+	memcpy(e->data, block->block_data.data, block->block_data.len);
+	e->len = block->block_data.len;
+	e->table = t;
+	e->off = off;
+	e->refcount = 1;
+	e->header_off = block->header_off;
+	e->hash_size = block->hash_size;
+	e->restart_count = block->restart_count;
+	e->restart_off = block->restart_off;
+	e->full_block_size = block->full_block_size;
+	e->block_type = block->block_type;
+
+	while (cache->lru_tail && cache->size + e->len > cache->max_size)
+		entry_remove(cache, cache->lru_tail);
+
+	b = entry_bucket(cache, t, off);
+	e->bucket_next = cache->buckets[b];
+	cache->buckets[b] = e;
+	lru_push(cache, e);
+	cache->size += e->len;
+	cache->entries_nr++;
+	return 0;
+}
+
+void block_cache_drop_table(struct reftable_block_cache *cache,
+			    const struct reftable_table *t)
+{
+	struct block_cache_entry *e = cache->lru_head, *next;
+
+	for (; e; e = next) {
+		next = e->lru_next;
+		if (e->table == t)
+			entry_remove(cache, e);
+	}
+}
@@ -0,0 +1,64 @@
+/*
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file or at
+ * https://developers.google.com/open-source/licenses/bsd
+ */
+
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include "system.h"
+
+struct reftable_block;
+struct reftable_table;
+
+/*
+ * A cache of decoded blocks shared by the tables of a stack. Entries are
+ * keyed by table and offset and evicted in least-recently-used order once
+ * the cached data exceeds the size the cache was created with. Blocks
+ * handed out by the cache stay valid until they are released, even if
+ * their entry is evicted in the meantime.
+ */
+struct reftable_block_cache {
+	uint64_t max_size;
+	uint64_t size;
+	uint64_t refcount;
+
+	struct block_cache_entry **buckets;
+	size_t buckets_nr;
+	size_t entries_nr;
+
+	/* Most recently used entry first. */
+	struct block_cache_entry *lru_head, *lru_tail;
+
+	uint64_t hits, misses;
+};
+
+/* Create a cache holding at most `max_size` bytes of block data. */
+int block_cache_new(struct reftable_block_cache **out, uint64_t max_size);
+
+/* Manage the reference count of the cache. */
+void block_cache_incref(struct reftable_block_cache *cache);
+void block_cache_decref(struct reftable_block_cache *cache);
+
+/*
+ * Look up the block at `off` in table `t`. On a hit, `block` is
+ * initialized from the cache and 1 is returned. Returns 0 on a miss.
+ */
+int block_cache_get(struct reftable_block_cache *cache,
+		    const struct reftable_table *t, uint64_t off,
+		    struct reftable_block *block);
+
+/*
+ * Store a copy of the decoded block at `off` in table `t`. Returns 0 on
+ * success, a reftable error code on error.
+ */
+int block_cache_put(struct reftable_block_cache *cache,
+		    const struct reftable_table *t, uint64_t off,
+		    const struct reftable_block *block);
+
+/* Drop all entries belonging to table `t`. */
+void block_cache_drop_table(struct reftable_block_cache *cache,
+			    const struct reftable_table *t);
+
+#endif
@@ -92,9 +92,18 @@ void block_source_from_buf(struct reftable_block_source *bs,
 	bs->arg = buf;
 }
 
+/*
+ * Tables smaller than this are read into memory instead of being mapped.
+ * Auto-compaction leaves many small tables at the top of the stack, and
+ * for those a single read() is cheaper than setting up and tearing down
+ * a mapping.
+ */
+#define FILE_BLOCK_SOURCE_MMAP_MIN (16 * 1024)
+
 struct file_block_source {
 	uint64_t size;
 	unsigned char *data;
+	int mapped;
 };
 
 static uint64_t file_size(void *b)
@@ -109,7 +118,10 @@ static void file_release_data(void *b REFTABLE_UNUSED, struct reftable_block_dat
 static void file_close(void *v)
 {
 	struct file_block_source *b = v;
-	munmap(b->data, b->size);
+	if (b->mapped)
+		munmap(b->data, b->size);
+	else
+		reftable_free(b->data);
 	reftable_free(b);
 }
 
@@ -130,6 +142,32 @@ static struct reftable_block_source_vtable file_vtable = {
 	.close = &file_close,
 };
 
+static int file_read_all(int fd, struct file_block_source *p)
+{
+	if (!p->size)
+		return 0;
+
+	REFTABLE_ALLOC_ARRAY(p->data, p->size);
+	if (!p->data)
+		return REFTABLE_OUT_OF_MEMORY_ERROR;
+
+	for (uint64_t total_read = 0; total_read < p->size; ) {
+		ssize_t bytes_read = pread(fd, p->data + total_read,
+					   p->size - total_read, total_read);
+		if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if (bytes_read < 0 || !bytes_read) {
+			reftable_free(p->data);
+			p->data = NULL;
+			return REFTABLE_IO_ERROR;
+		}
+
+		total_read += bytes_read;
+	}
+
+	return 0;
+}
+
 int reftable_block_source_from_file(struct reftable_block_source *bs,
 				    const char *name)
 {
@@ -157,11 +195,18 @@ int reftable_block_source_from_file(struct reftable_block_source *bs,
 	}
 
 	p->size = st.st_size;
-	p->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (p->data == MAP_FAILED) {
-		err = REFTABLE_IO_ERROR;
-		p->data = NULL;
-		goto out;
+	if (p->size >= FILE_BLOCK_SOURCE_MMAP_MIN) {
+		p->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p->data != MAP_FAILED)
+			p->mapped = 1;
+		else
+			p->data = NULL;
+	}
+	if (!p->mapped) {
+		/* Small tables, and file systems that cannot map them. */
+		err = file_read_all(fd, p);
+		if (err < 0)
+			goto out;
 	}
 
 	assert(!bs->ops);
@@ -46,7 +46,10 @@ struct reftable_block_source_vtable {
 	void (*close)(void *source);
 };
 
-/* opens a file on the file system as a block_source */
+/*
+ * Opens a file on the file system as a block_source. Large tables are
+ * mapped into memory, small ones are read.
+ */
 int reftable_block_source_from_file(struct reftable_block_source *block_src,
 				    const char *name);
 
@@ -51,6 +51,12 @@ struct reftable_table {
 	struct reftable_table_offsets obj_offsets;
 	struct reftable_table_offsets log_offsets;
 
+	/*
+	 * Cache of decoded blocks shared with the other tables of the stack,
+	 * if any. The table holds a reference to it.
+	 */
+	struct reftable_block_cache *block_cache;
+
 	uint64_t refcount;
 };
 
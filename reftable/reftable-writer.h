@@ -77,6 +77,13 @@ struct reftable_write_options {
 	 */
 	void (*on_reload)(void *payload);
 	void *on_reload_payload;
+
+	/*
+	 * Maximum number of bytes of decoded blocks that the stack caches for
+	 * reuse by its iterators. The cache survives reloads for tables that
+	 * are still part of the stack. Passing 0 disables the cache.
+	 */
+	uint64_t block_cache_size;
 };
 
 /* reftable_block_stats holds statistics for a single block type */
@@ -9,6 +9,7 @@
 #include "stack.h"
 
 #include "system.h"
+#include "blockcache.h"
 #include "constants.h"
 #include "merged.h"
 #include "reftable-error.h"
@@ -119,6 +120,12 @@ int reftable_new_stack(struct reftable_stack **dest, const char *dir,
 		goto out;
 	}
 
+	if (opts.block_cache_size) {
+		err = block_cache_new(&p->block_cache, opts.block_cache_size);
+		if (err < 0)
+			goto out;
+	}
+
 	err = reftable_stack_reload_maybe_reuse(p, 1);
 	if (err < 0)
 		goto out;
@@ -278,6 +285,7 @@ void reftable_stack_destroy(struct reftable_stack *st)
 		st->list_fd = -1;
 	}
 
+	block_cache_decref(st->block_cache);
 	REFTABLE_FREE_AND_NULL(st->list_file);
 	REFTABLE_FREE_AND_NULL(st->reftable_dir);
 	reftable_free(st);
@@ -375,6 +383,11 @@ static int reftable_stack_reload_once(struct reftable_stack *st,
 			err = reftable_table_new(&table, &src, name);
 			if (err < 0)
 				goto done;
+
+			if (st->block_cache) {
+				table->block_cache = st->block_cache;
+				block_cache_incref(st->block_cache);
+			}
 		}
 
 		new_tables[new_tables_len] = table;
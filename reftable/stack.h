@@ -26,6 +26,7 @@ struct reftable_stack {
 	size_t tables_len;
 	struct reftable_merged_table *merged;
 	struct reftable_compaction_stats stats;
+	struct reftable_block_cache *block_cache;
 };
 
 int read_lines(const char *filename, char ***lines);
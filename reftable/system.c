@@ -5,6 +5,7 @@
 #include "reftable-error.h"
 #include "../lockfile.h"
 #include "../tempfile.h"
+#include "../trace2.h"
 
 uint32_t reftable_rand(void)
 {
@@ -131,3 +132,9 @@ int flock_commit(struct reftable_flock *l)
 
 	return 0;
 }
+
+void reftable_trace_block_cache_lookup(int hit)
+{
+	trace2_counter_add(hit ? TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HIT :
+			   TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISS, 1);
+}
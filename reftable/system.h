@@ -106,4 +106,10 @@ int flock_release(struct reftable_flock *l);
  */
 int flock_commit(struct reftable_flock *l);
 
+/*
+ * Report a lookup in the block cache of a stack to the tracing facility of
+ * the implementation. `hit` tells whether the block was found.
+ */
+void reftable_trace_block_cache_lookup(int hit);
+
 #endif
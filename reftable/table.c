@@ -10,6 +10,7 @@
 
 #include "system.h"
 #include "block.h"
+#include "blockcache.h"
 #include "blocksource.h"
 #include "constants.h"
 #include "iter.h"
@@ -179,6 +180,41 @@ int table_init_block(struct reftable_table *t, struct reftable_block *block,
 	return err;
 }
 
+/*
+ * Like table_init_block(), but serves the block from the block cache of
+ * the table if it has one. This is used when seeking, where the same index
+ * and ref blocks are decoded over and over again by exact lookups.
+ */
+static int table_init_block_cached(struct reftable_table *t,
+				   struct reftable_block *block,
+				   uint64_t off, uint8_t want_typ)
+{
+	int err;
+
+	if (!t->block_cache)
+		return table_init_block(t, block, off, want_typ);
+	if (off >= t->size)
+		return 1;
+
+	if (block_cache_get(t->block_cache, t, off, block)) {
+		if (want_typ != REFTABLE_BLOCK_TYPE_ANY &&
+		    block->block_type != want_typ) {
+			reftable_block_release(block);
+			return 1;
+		}
+		return 0;
+	}
+
+	err = table_init_block(t, block, off, want_typ);
+	if (err)
+		return err;
+
+	err = block_cache_put(t->block_cache, t, off, block);
+	if (err < 0)
+		reftable_block_release(block);
+	return err;
+}
+
 static void table_iter_close(struct table_iter *ti)
 {
 	table_iter_block_done(ti);
@@ -241,7 +277,7 @@ static int table_iter_seek_to(struct table_iter *ti, uint64_t off, uint8_t typ)
 {
 	int err;
 
-	err = table_init_block(ti->table, &ti->block, off, typ);
+	err = table_init_block_cached(ti->table, &ti->block, off, typ);
 	if (err != 0)
 		return err;
 
@@ -606,6 +642,10 @@ void reftable_table_decref(struct reftable_table *t)
 		return;
 	if (--t->refcount)
 		return;
+	if (t->block_cache) {
+		block_cache_drop_table(t->block_cache, t);
+		block_cache_decref(t->block_cache);
+	}
 	block_source_close(&t->source);
 	REFTABLE_FREE_AND_NULL(t->name);
 	reftable_free(t);
@@ -70,6 +70,8 @@ void prepare_repo_settings(struct repository *r)
 	repo_cfg_int(r, "commitgraph.changedpathsversion",
 		     &r->settings.commit_graph_changed_paths_version,
 		     read_changed_paths ? -1 : 0);
+	repo_cfg_bool(r, "commitgraph.reachabilitylabels",
+		      &r->settings.commit_graph_reachability_labels, 0);
 	repo_cfg_bool(r, "gc.writecommitgraph", &r->settings.gc_write_commit_graph, 1);
 	repo_cfg_bool(r, "fetch.writecommitgraph", &r->settings.fetch_write_commit_graph, 0);
 
@@ -84,6 +86,7 @@ void prepare_repo_settings(struct repository *r)
 		      &r->settings.pack_use_bitmap_boundary_traversal,
 		      r->settings.pack_use_bitmap_boundary_traversal);
 	repo_cfg_bool(r, "core.usereplacerefs", &r->settings.read_replace_refs, 1);
+	repo_cfg_bool(r, "core.pipelinedhashing", &r->settings.pipelined_hashing, 0);
 
 	/*
 	 * The GIT_TEST_MULTI_PACK_INDEX variable is special in that
@@ -100,6 +103,8 @@ void prepare_repo_settings(struct repository *r)
 	 */
 	if (!repo_config_get_int(r, "index.version", &value))
 		r->settings.index_version = value;
+	repo_cfg_int(r, "core.untrackedscanthreads",
+		     &r->settings.untracked_scan_threads, 1);
 
 	if (!repo_config_get_string_tmp(r, "core.untrackedcache", &strval)) {
 		int v = git_parse_maybe_bool(strval);
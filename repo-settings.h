@@ -29,6 +29,7 @@ struct repo_settings {
 	int core_commit_graph;
 	int commit_graph_generation_version;
 	int commit_graph_changed_paths_version;
+	int commit_graph_reachability_labels;
 	int gc_write_commit_graph;
 	int fetch_write_commit_graph;
 	int command_requires_full_index;
@@ -53,7 +54,9 @@ struct repo_settings {
 
 	int index_version;
 	int index_skip_hash;
+	int pipelined_hashing;
 	enum untracked_cache_setting core_untracked_cache;
+	int untracked_scan_threads;
 
 	int pack_use_sparse;
 	int pack_use_path_walk;
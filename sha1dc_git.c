@@ -2,6 +2,15 @@
 #include "sha1dc_git.h"
 #include "hex.h"
 
+#ifdef SHA1DC_SIMD
+#include "sha1dc_simd.h"
+#define sha1dc_update sha1dc_simd_update
+#define sha1dc_final sha1dc_simd_final
+#else
+#define sha1dc_update SHA1DCUpdate
+#define sha1dc_final SHA1DCFinal
+#endif
+
 #ifdef DC_SHA1_EXTERNAL
 /*
  * Same as SHA1DCInit, but with default save_hash=0
@@ -18,7 +27,7 @@ void git_SHA1DCInit(SHA1_CTX *ctx)
  */
 void git_SHA1DCFinal(unsigned char hash[20], SHA1_CTX *ctx)
 {
-	if (!SHA1DCFinal(hash, ctx))
+	if (!sha1dc_final(hash, ctx))
 		return;
 	die("SHA-1 appears to be part of a collision attack: %s",
 	    hash_to_hex_algop(hash, &hash_algos[GIT_HASH_SHA1]));
@@ -32,9 +41,9 @@ void git_SHA1DCUpdate(SHA1_CTX *ctx, const void *vdata, unsigned long len)
 	const char *data = vdata;
 	/* We expect an unsigned long, but sha1dc only takes an int */
 	while (len > INT_MAX) {
-		SHA1DCUpdate(ctx, data, INT_MAX);
+		sha1dc_update(ctx, data, INT_MAX);
 		data += INT_MAX;
 		len -= INT_MAX;
 	}
-	SHA1DCUpdate(ctx, data, len);
+	sha1dc_update(ctx, data, len);
 }
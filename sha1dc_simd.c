@@ -0,0 +1,375 @@
+/*
+ * SIMD variant of the collision-detecting SHA-1 block processing; see
+ * sha1dc_simd.h.
+ */
+#include "git-compat-util.h"
+#include "sha1dc_git.h"
+#include "sha1dc_simd.h"
+
+#ifdef DC_SHA1_EXTERNAL
+#include <sha1dc/ubc_check.h>
+#elif defined(DC_SHA1_SUBMODULE)
+#include "sha1collisiondetection/lib/ubc_check.h"
+#else
+#include "sha1dc/ubc_check.h"
+#endif
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SHA1DC_SIMD_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && \
+	(defined(__linux__) || defined(__APPLE__))
+#define SHA1DC_SIMD_ARM64 1
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+static inline uint32_t rol(uint32_t x, unsigned n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+/*
+ * Message expansion: W[0..15] are the big-endian words of the block and
+ * W[i] = rol(W[i-3] ^ W[i-8] ^ W[i-14] ^ W[i-16], 1) for the rest. Four
+ * words are computed at a time; the last of them depends on the first,
+ * which is patched up afterwards as rol() distributes over xor.
+ */
+#if defined(SHA1DC_SIMD_X86)
+
+static void expand(const unsigned char *block, uint32_t W[80])
+{
+	const __m128i *in = (const __m128i *)block;
+
+	for (int i = 0; i < 4; i++) {
+		__m128i x = _mm_loadu_si128(in + i);
+		/* byte-swap each word with SSE2 only */
+		x = _mm_or_si128(_mm_srli_epi16(x, 8), _mm_slli_epi16(x, 8));
+		x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xb1), 0xb1);
+		_mm_storeu_si128((__m128i *)&W[4 * i], x);
+	}
+
+	for (int i = 16; i < 80; i += 4) {
+		__m128i x, r;
+
+		x = _mm_srli_si128(_mm_loadu_si128((const __m128i *)&W[i - 4]), 4);
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)&W[i - 8]));
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)&W[i - 14]));
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)&W[i - 16]));
+		r = _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+		/* W[i+3] needs rol(W[i], 1) xored in */
+		x = _mm_slli_si128(r, 12);
+		r = _mm_xor_si128(r, _mm_or_si128(_mm_slli_epi32(x, 1),
+						  _mm_srli_epi32(x, 31)));
+		_mm_storeu_si128((__m128i *)&W[i], r);
+	}
+}
+
+#elif defined(SHA1DC_SIMD_ARM64)
+
+static void expand(const unsigned char *block, uint32_t W[80])
+{
+	for (int i = 0; i < 4; i++)
+		vst1q_u32(&W[4 * i], vreinterpretq_u32_u8(
+				  vrev32q_u8(vld1q_u8(block + 16 * i))));
+
+	for (int i = 16; i < 80; i += 4) {
+		uint32x4_t x, r, fix;
+
+		x = vextq_u32(vld1q_u32(&W[i - 4]), vdupq_n_u32(0), 1);
+		x = veorq_u32(x, vld1q_u32(&W[i - 8]));
+		x = veorq_u32(x, vld1q_u32(&W[i - 14]));
+		x = veorq_u32(x, vld1q_u32(&W[i - 16]));
+		r = vsriq_n_u32(vshlq_n_u32(x, 1), x, 31);
+		/* W[i+3] needs rol(W[i], 1) xored in */
+		fix = vextq_u32(vdupq_n_u32(0), r, 1);
+		r = veorq_u32(r, vsriq_n_u32(vshlq_n_u32(fix, 1), fix, 31));
+		vst1q_u32(&W[i], r);
+	}
+}
+
+#else
+
+static void expand(const unsigned char *block, uint32_t W[80])
+{
+	for (int i = 0; i < 16; i++)
+		W[i] = get_be32(block + 4 * i);
+	for (int i = 16; i < 80; i++)
+		W[i] = rol(W[i - 3] ^ W[i - 8] ^ W[i - 14] ^ W[i - 16], 1);
+}
+
+#endif
+
+static void compress_portable(uint32_t ihv[5], const uint32_t W[80])
+{
+	uint32_t a = ihv[0], b = ihv[1], c = ihv[2], d = ihv[3], e = ihv[4];
+
+	for (int i = 0; i < 80; i++) {
+		uint32_t f, k, t;
+
+		if (i < 20) {
+			f = d ^ (b & (c ^ d));
+			k = 0x5a827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		} else if (i < 60) {
+			f = (b & c) | (d & (b | c));
+			k = 0x8f1bbcdc;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+		t = rol(a, 5) + f + e + k + W[i];
+		e = d;
+		d = c;
+		c = rol(b, 30);
+		b = a;
+		a = t;
+	}
+
+	ihv[0] += a;
+	ihv[1] += b;
+	ihv[2] += c;
+	ihv[3] += d;
+	ihv[4] += e;
+}
+
+#if defined(SHA1DC_SIMD_X86)
+
+static int shani_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	/* SSSE3 and SSE4.1 */
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return !!(ebx & (1 << 29));
+}
+
+/*
+ * The SHA instructions want the four message words of a group with the
+ * first one in the highest lane.
+ */
+#define MSG(g) _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&W[4 * (g)]), 0x1b)
+
+/* four steps; `e` is the E of the previous group, updated with `msg` */
+#define ROUNDS4(g, f) do { \
+	e_next = abcd; \
+	e = _mm_sha1nexte_epu32(e, MSG(g)); \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, (f)); \
+	e = e_next; \
+} while (0)
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compress_shani(uint32_t ihv[5], const uint32_t W[80])
+{
+	__m128i abcd, abcd_save, e, e_save, e_next;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)ihv), 0x1b);
+	abcd_save = abcd;
+	e_save = _mm_set_epi32(ihv[4], 0, 0, 0);
+
+	/* the first group adds E directly; later ones via sha1nexte */
+	e_next = abcd;
+	abcd = _mm_sha1rnds4_epu32(abcd, _mm_add_epi32(e_save, MSG(0)), 0);
+	e = e_next;
+
+	ROUNDS4(1, 0); ROUNDS4(2, 0); ROUNDS4(3, 0); ROUNDS4(4, 0);
+	ROUNDS4(5, 1); ROUNDS4(6, 1); ROUNDS4(7, 1); ROUNDS4(8, 1); ROUNDS4(9, 1);
+	ROUNDS4(10, 2); ROUNDS4(11, 2); ROUNDS4(12, 2); ROUNDS4(13, 2); ROUNDS4(14, 2);
+	ROUNDS4(15, 3); ROUNDS4(16, 3); ROUNDS4(17, 3); ROUNDS4(18, 3); ROUNDS4(19, 3);
+
+	e = _mm_sha1nexte_epu32(e, e_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+
+	_mm_storeu_si128((__m128i *)ihv, _mm_shuffle_epi32(abcd, 0x1b));
+	ihv[4] = _mm_extract_epi32(e, 3);
+}
+
+#elif defined(SHA1DC_SIMD_ARM64)
+
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define SHA_TARGET
+#elif defined(__clang__)
+#define SHA_TARGET __attribute__((target("sha2")))
+#else
+#define SHA_TARGET __attribute__((target("+crypto")))
+#endif
+
+static int arm64_sha1_supported(void)
+{
+#ifdef __APPLE__
+	return 1;
+#else
+	return !!(getauxval(AT_HWCAP) & HWCAP_SHA1);
+#endif
+}
+
+/* four steps with the choose, parity or majority function */
+#define ROUNDS4(g, op, k) do { \
+	e_next = vsha1h_u32(vgetq_lane_u32(abcd, 0)); \
+	abcd = op(abcd, e, vaddq_u32(vld1q_u32(&W[4 * (g)]), vdupq_n_u32(k))); \
+	e = e_next; \
+} while (0)
+
+SHA_TARGET
+static void compress_arm64(uint32_t ihv[5], const uint32_t W[80])
+{
+	uint32x4_t abcd = vld1q_u32(ihv), abcd_save = abcd;
+	uint32_t e = ihv[4], e_next;
+
+	ROUNDS4(0, vsha1cq_u32, 0x5a827999);
+	ROUNDS4(1, vsha1cq_u32, 0x5a827999);
+	ROUNDS4(2, vsha1cq_u32, 0x5a827999);
+	ROUNDS4(3, vsha1cq_u32, 0x5a827999);
+	ROUNDS4(4, vsha1cq_u32, 0x5a827999);
+	ROUNDS4(5, vsha1pq_u32, 0x6ed9eba1);
+	ROUNDS4(6, vsha1pq_u32, 0x6ed9eba1);
+	ROUNDS4(7, vsha1pq_u32, 0x6ed9eba1);
+	ROUNDS4(8, vsha1pq_u32, 0x6ed9eba1);
+	ROUNDS4(9, vsha1pq_u32, 0x6ed9eba1);
+	ROUNDS4(10, vsha1mq_u32, 0x8f1bbcdc);
+	ROUNDS4(11, vsha1mq_u32, 0x8f1bbcdc);
+	ROUNDS4(12, vsha1mq_u32, 0x8f1bbcdc);
+	ROUNDS4(13, vsha1mq_u32, 0x8f1bbcdc);
+	ROUNDS4(14, vsha1mq_u32, 0x8f1bbcdc);
+	ROUNDS4(15, vsha1pq_u32, 0xca62c1d6);
+	ROUNDS4(16, vsha1pq_u32, 0xca62c1d6);
+	ROUNDS4(17, vsha1pq_u32, 0xca62c1d6);
+	ROUNDS4(18, vsha1pq_u32, 0xca62c1d6);
+	ROUNDS4(19, vsha1pq_u32, 0xca62c1d6);
+
+	vst1q_u32(ihv, vaddq_u32(abcd, abcd_save));
+	ihv[4] += e;
+}
+
+#endif
+
+struct compress_impl {
+	const char *name;
+	int (*supported)(void);
+	void (*fn)(uint32_t ihv[5], const uint32_t W[80]);
+};
+
+/* In order of preference. */
+static const struct compress_impl compress_impls[] = {
+#if defined(SHA1DC_SIMD_X86)
+	{ "shani", shani_supported, compress_shani },
+#elif defined(SHA1DC_SIMD_ARM64)
+	{ "arm64", arm64_sha1_supported, compress_arm64 },
+#endif
+	{ "portable", NULL, compress_portable },
+};
+
+static const struct compress_impl *compress_impl;
+
+static const struct compress_impl *get_compress_impl(void)
+{
+	if (!compress_impl) {
+		/* racing threads all pick the same one */
+		for (size_t i = 0; i < ARRAY_SIZE(compress_impls); i++) {
+			if (!compress_impls[i].supported ||
+			    compress_impls[i].supported()) {
+				compress_impl = &compress_impls[i];
+				break;
+			}
+		}
+	}
+	return compress_impl;
+}
+
+const char *sha1dc_simd_impl(void)
+{
+	return get_compress_impl()->name;
+}
+
+static void process(SHA1_CTX *ctx, const unsigned char *block)
+{
+	if (ctx->detect_coll) {
+		uint32_t dvmask[DVMASKSIZE] = { 0xffffffff };
+
+		expand(block, ctx->m1);
+		if (ctx->ubc_check)
+			ubc_check(ctx->m1, dvmask);
+
+		if (CHECK_DVMASK(dvmask)) {
+			/*
+			 * This block may be part of a collision attack. Let
+			 * the scalar code do the full check (and record any
+			 * collision) by feeding it just this block.
+			 */
+			unsigned char copy[64];
+			uint64_t total = ctx->total;
+
+			memcpy(copy, block, sizeof(copy));
+			ctx->total = 0;
+			SHA1DCUpdate(ctx, (const char *)copy, sizeof(copy));
+			ctx->total = total;
+			return;
+		}
+	} else {
+		expand(block, ctx->m1);
+	}
+
+	get_compress_impl()->fn(ctx->ihv, ctx->m1);
+}
+
+/* This mirrors SHA1DCUpdate(), but with our process(). */
+void sha1dc_simd_update(SHA1_CTX *ctx, const char *buf, size_t len)
+{
+	unsigned left, fill;
+
+	if (!len)
+		return;
+
+	left = ctx->total & 63;
+	fill = 64 - left;
+
+	if (left && len >= fill) {
+		ctx->total += fill;
+		memcpy(ctx->buffer + left, buf, fill);
+		process(ctx, ctx->buffer);
+		buf += fill;
+		len -= fill;
+		left = 0;
+	}
+	while (len >= 64) {
+		ctx->total += 64;
+		process(ctx, (const unsigned char *)buf);
+		buf += 64;
+		len -= 64;
+	}
+	if (len) {
+		ctx->total += len;
+		memcpy(ctx->buffer + left, buf, len);
+	}
+}
+
+/* This mirrors SHA1DCFinal(), but with our process(). */
+int sha1dc_simd_final(unsigned char output[20], SHA1_CTX *ctx)
+{
+	static const unsigned char padding[64] = { 0x80 };
+	uint32_t last = ctx->total & 63;
+	uint32_t padn = (last < 56) ? (56 - last) : (120 - last);
+	uint64_t total;
+
+	sha1dc_simd_update(ctx, (const char *)padding, padn);
+
+	total = (ctx->total - padn) << 3;
+	put_be32(ctx->buffer + 56, (uint32_t)(total >> 32));
+	put_be32(ctx->buffer + 60, (uint32_t)total);
+	process(ctx, ctx->buffer);
+
+	for (int i = 0; i < 5; i++)
+		put_be32(output + 4 * i, ctx->ihv[i]);
+	return ctx->found_collision;
+}
@@ -0,0 +1,23 @@
+#ifndef SHA1DC_SIMD_H
+#define SHA1DC_SIMD_H
+
+#include "sha1dc_git.h"
+
+/*
+ * Drop-in replacements for SHA1DCUpdate() and SHA1DCFinal() that expand
+ * the message schedule with SIMD instructions and, where the CPU has
+ * them, run the compression function with the SHA-1 instructions of
+ * x86-64 or AArch64.
+ *
+ * Collision detection is unchanged: the unavoidable bit conditions are
+ * checked on every block, and the (rare) blocks that pass them are
+ * handed to the scalar sha1collisiondetection code, so the results,
+ * including collision reports, are identical to the scalar version.
+ */
+void sha1dc_simd_update(SHA1_CTX *ctx, const char *buf, size_t len);
+int sha1dc_simd_final(unsigned char output[20], SHA1_CTX *ctx);
+
+/* The compression function in use, for tests and benchmarks. */
+const char *sha1dc_simd_impl(void);
+
+#endif
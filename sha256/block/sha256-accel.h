@@ -0,0 +1,38 @@
+#ifndef SHA256_BLOCK_SHA256_ACCEL_H
+#define SHA256_BLOCK_SHA256_ACCEL_H
+
+/*
+ * Hardware-accelerated block functions for the built-in SHA-256
+ * implementation. These are only compiled in when the compiler can
+ * target the instructions they need; whether the CPU we run on actually
+ * has them is checked at runtime by the *_supported() functions.
+ */
+
+#if !defined(NO_SHA256_BLK_ACCEL) && defined(__GNUC__) && defined(__x86_64__)
+#define SHA256_BLK_X86 1
+#endif
+
+#if !defined(NO_SHA256_BLK_ACCEL) && defined(__GNUC__) && defined(__aarch64__) && \
+	(defined(__linux__) || defined(__APPLE__))
+#define SHA256_BLK_ARM64 1
+#endif
+
+extern const uint32_t sha256_blk_K[64];
+
+/* Process `nr` consecutive 64-byte blocks into `state`. */
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const unsigned char *data,
+				 size_t nr);
+
+#ifdef SHA256_BLK_X86
+int sha256_x86_shani_supported(void);
+void sha256_blocks_x86_shani(uint32_t state[8], const unsigned char *data,
+			     size_t nr);
+#endif
+
+#ifdef SHA256_BLK_ARM64
+int sha256_arm64_supported(void);
+void sha256_blocks_arm64(uint32_t state[8], const unsigned char *data,
+			 size_t nr);
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * SHA-256 block function using the ARMv8 SHA2 instructions.
+ */
+#include "git-compat-util.h"
+#include "./sha256-accel.h"
+
+#ifdef SHA256_BLK_ARM64
+
+#include <arm_neon.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define SHA2_TARGET
+#elif defined(__clang__)
+#define SHA2_TARGET __attribute__((target("sha2")))
+#else
+#define SHA2_TARGET __attribute__((target("+crypto")))
+#endif
+
+int sha256_arm64_supported(void)
+{
+#ifdef __APPLE__
+	/* every Apple arm64 CPU has the SHA2 instructions */
+	return 1;
+#else
+	return !!(getauxval(AT_HWCAP) & HWCAP_SHA2);
+#endif
+}
+
+/* four rounds, and optionally the schedule for four rounds later */
+#define QROUND(w0, w1, w2, w3, i, sched) do { \
+	tmp = vaddq_u32((w0), vld1q_u32(&sha256_blk_K[(i)])); \
+	if (sched) { \
+		(w0) = vsha256su0q_u32((w0), (w1)); \
+		(w0) = vsha256su1q_u32((w0), (w2), (w3)); \
+	} \
+	abcd = state0; \
+	state0 = vsha256hq_u32(state0, state1, tmp); \
+	state1 = vsha256h2q_u32(state1, abcd, tmp); \
+} while (0)
+
+SHA2_TARGET
+void sha256_blocks_arm64(uint32_t state[8], const unsigned char *data,
+			 size_t nr)
+{
+	uint32x4_t state0 = vld1q_u32(&state[0]);
+	uint32x4_t state1 = vld1q_u32(&state[4]);
+	uint32x4_t w0, w1, w2, w3, tmp, abcd, abcd_save, efgh_save;
+
+	while (nr--) {
+		abcd_save = state0;
+		efgh_save = state1;
+
+		w0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+		w1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		w2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		w3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		QROUND(w0, w1, w2, w3, 0, 1);
+		QROUND(w1, w2, w3, w0, 4, 1);
+		QROUND(w2, w3, w0, w1, 8, 1);
+		QROUND(w3, w0, w1, w2, 12, 1);
+		QROUND(w0, w1, w2, w3, 16, 1);
+		QROUND(w1, w2, w3, w0, 20, 1);
+		QROUND(w2, w3, w0, w1, 24, 1);
+		QROUND(w3, w0, w1, w2, 28, 1);
+		QROUND(w0, w1, w2, w3, 32, 1);
+		QROUND(w1, w2, w3, w0, 36, 1);
+		QROUND(w2, w3, w0, w1, 40, 1);
+		QROUND(w3, w0, w1, w2, 44, 1);
+		QROUND(w0, w1, w2, w3, 48, 0);
+		QROUND(w1, w2, w3, w0, 52, 0);
+		QROUND(w2, w3, w0, w1, 56, 0);
+		QROUND(w3, w0, w1, w2, 60, 0);
+
+		state0 = vaddq_u32(state0, abcd_save);
+		state1 = vaddq_u32(state1, efgh_save);
+		data += 64;
+	}
+
+	vst1q_u32(&state[0], state0);
+	vst1q_u32(&state[4], state1);
+}
+
+#endif
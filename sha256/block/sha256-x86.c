@@ -0,0 +1,99 @@
+/*
+ * SHA-256 block functions using the x86-64 SHA extensions.
+ */
+#include "git-compat-util.h"
+#include "./sha256-accel.h"
+
+#ifdef SHA256_BLK_X86
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+int sha256_x86_shani_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+	/* SSSE3 and SSE4.1 */
+	if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+		return 0;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return 0;
+	return !!(ebx & (1 << 29));
+}
+
+#define K(i) _mm_loadu_si128((const __m128i *)&sha256_blk_K[(i)])
+
+/* four rounds using the message words in `msg` */
+#define QROUND(msg, i) do { \
+	tmp = _mm_add_epi32((msg), K(i)); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, tmp); \
+	tmp = _mm_shuffle_epi32(tmp, 0x0e); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, tmp); \
+} while (0)
+
+/* message schedule: finish `next` from the two groups before it */
+#define SCHED2(next, cur, prev) \
+	(next) = _mm_sha256msg2_epu32(_mm_add_epi32((next), \
+			_mm_alignr_epi8((cur), (prev), 4)), (cur))
+#define SCHED1(prev, cur) \
+	(prev) = _mm_sha256msg1_epu32((prev), (cur))
+
+__attribute__((target("sha,sse4.1,ssse3")))
+void sha256_blocks_x86_shani(uint32_t state[8], const unsigned char *data,
+			     size_t nr)
+{
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+					     0x0405060700010203ULL);
+	__m128i state0, state1, tmp, w0, w1, w2, w3, abef, cdgh;
+
+	/* reorder the state into the ABEF/CDGH layout of the instructions */
+	tmp = _mm_loadu_si128((const __m128i *)&state[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&state[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	state1 = _mm_shuffle_epi32(state1, 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	while (nr--) {
+		abef = state0;
+		cdgh = state1;
+
+		w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), bswap);
+		w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+		w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+		w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+
+		QROUND(w0, 0);
+		QROUND(w1, 4);  SCHED1(w0, w1);
+		QROUND(w2, 8);  SCHED1(w1, w2);
+		QROUND(w3, 12); SCHED2(w0, w3, w2); SCHED1(w2, w3);
+		QROUND(w0, 16); SCHED2(w1, w0, w3); SCHED1(w3, w0);
+		QROUND(w1, 20); SCHED2(w2, w1, w0); SCHED1(w0, w1);
+		QROUND(w2, 24); SCHED2(w3, w2, w1); SCHED1(w1, w2);
+		QROUND(w3, 28); SCHED2(w0, w3, w2); SCHED1(w2, w3);
+		QROUND(w0, 32); SCHED2(w1, w0, w3); SCHED1(w3, w0);
+		QROUND(w1, 36); SCHED2(w2, w1, w0); SCHED1(w0, w1);
+		QROUND(w2, 40); SCHED2(w3, w2, w1); SCHED1(w1, w2);
+		QROUND(w3, 44); SCHED2(w0, w3, w2); SCHED1(w2, w3);
+		QROUND(w0, 48); SCHED2(w1, w0, w3); SCHED1(w3, w0);
+		QROUND(w1, 52); SCHED2(w2, w1, w0);
+		QROUND(w2, 56); SCHED2(w3, w2, w1);
+		QROUND(w3, 60);
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+		data += 64;
+	}
+
+	/* and back to ABCD/EFGH */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&state[0], state0);
+	_mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+#endif
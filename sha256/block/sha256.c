@@ -1,5 +1,6 @@
 #include "git-compat-util.h"
 #include "./sha256.h"
+#include "./sha256-accel.h"
 
 #undef RND
 #undef BLKSIZE
@@ -55,7 +56,26 @@ static inline uint32_t gamma1(uint32_t x)
 	return ror(x, 17) ^ ror(x, 19) ^ (x >> 10);
 }
 
-static void blk_SHA256_Transform(blk_SHA256_CTX *ctx, const unsigned char *buf)
+const uint32_t sha256_blk_K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256_transform_portable(uint32_t *state, const unsigned char *buf)
 {
 
 	uint32_t S[8], W[64], t0, t1;
@@ -63,7 +83,7 @@ static void blk_SHA256_Transform(blk_SHA256_CTX *ctx, const unsigned char *buf)
 
 	/* copy state into S */
 	for (i = 0; i < 8; i++)
-		S[i] = ctx->state[i];
+		S[i] = state[i];
 
 	/* copy the state into 512-bits into W[0..15] */
 	for (i = 0; i < 16; i++, buf += sizeof(uint32_t))
@@ -145,7 +165,86 @@ static void blk_SHA256_Transform(blk_SHA256_CTX *ctx, const unsigned char *buf)
 	RND(S[1],S[2],S[3],S[4],S[5],S[6],S[7],S[0],63,0xc67178f2);
 
 	for (i = 0; i < 8; i++)
-		ctx->state[i] += S[i];
+		state[i] += S[i];
+}
+
+static void sha256_blocks_portable(uint32_t state[8], const unsigned char *data,
+				   size_t nr)
+{
+	while (nr--) {
+		sha256_transform_portable(state, data);
+		data += BLKSIZE;
+	}
+}
+
+struct sha256_block_impl {
+	const char *name;
+	int (*supported)(void);
+	sha256_blocks_fn blocks;
+};
+
+/* In order of preference. */
+static const struct sha256_block_impl sha256_impls[] = {
+#ifdef SHA256_BLK_X86
+	{
+		.name = "shani",
+		.supported = sha256_x86_shani_supported,
+		.blocks = sha256_blocks_x86_shani,
+	},
+#endif
+#ifdef SHA256_BLK_ARM64
+	{
+		.name = "arm64",
+		.supported = sha256_arm64_supported,
+		.blocks = sha256_blocks_arm64,
+	},
+#endif
+	{
+		.name = "portable",
+		.blocks = sha256_blocks_portable,
+	},
+};
+
+static const struct sha256_block_impl *sha256_impl;
+
+static const struct sha256_block_impl *get_impl(void)
+{
+	if (!sha256_impl) {
+		/*
+		 * Racing threads all pick the same implementation, so it
+		 * does not matter which of them wins.
+		 */
+		for (size_t i = 0; i < ARRAY_SIZE(sha256_impls); i++) {
+			if (!sha256_impls[i].supported ||
+			    sha256_impls[i].supported()) {
+				sha256_impl = &sha256_impls[i];
+				break;
+			}
+		}
+	}
+	return sha256_impl;
+}
+
+const char *blk_SHA256_impl(void)
+{
+	return get_impl()->name;
+}
+
+int blk_SHA256_set_impl(const char *name)
+{
+	if (!name) {
+		sha256_impl = NULL;
+		return 0;
+	}
+	for (size_t i = 0; i < ARRAY_SIZE(sha256_impls); i++) {
+		if (strcmp(sha256_impls[i].name, name))
+			continue;
+		if (sha256_impls[i].supported && !sha256_impls[i].supported())
+			return -1;
+		sha256_impl = &sha256_impls[i];
+		return 0;
+	}
+	return -1;
 }
 
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
@@ -165,12 +264,12 @@ void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len)
 		data = ((const char *)data + left);
 		if (len_buf)
 			return;
-		blk_SHA256_Transform(ctx, ctx->buf);
+		get_impl()->blocks(ctx->state, ctx->buf, 1);
 	}
-	while (len >= 64) {
-		blk_SHA256_Transform(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		get_impl()->blocks(ctx->state, data, len / 64);
+		data = ((const char *)data + (len & ~(size_t)63));
+		len &= 63;
 	}
 	if (len)
 		memcpy(ctx->buf, data, len);
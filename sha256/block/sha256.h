@@ -16,6 +16,16 @@ void blk_SHA256_Init(blk_SHA256_CTX *ctx);
 void blk_SHA256_Update(blk_SHA256_CTX *ctx, const void *data, size_t len);
 void blk_SHA256_Final(unsigned char *digest, blk_SHA256_CTX *ctx);
 
+/*
+ * The block functions are picked at runtime depending on what the CPU
+ * supports. These return the name of the implementation in use, and
+ * force a specific one for testing and benchmarking (returning -1 if
+ * it is unknown or not supported on this CPU). Passing NULL to the
+ * latter restores the default choice.
+ */
+const char *blk_SHA256_impl(void);
+int blk_SHA256_set_impl(const char *name);
+
 #define platform_SHA256_CTX blk_SHA256_CTX
 #define platform_SHA256_Init blk_SHA256_Init
 #define platform_SHA256_Update blk_SHA256_Update
@@ -255,31 +255,46 @@ int demultiplex_sideband(const char *me, int status,
 	return 1;
 }
 
+/*
+ * Number of packets send_sideband() hands to a single writev(); each
+ * takes one iovec for its header and one for its payload.
+ */
+#define SIDEBAND_WRITEV_PACKETS 32
+
 /*
  * fd is connected to the remote side; send the sideband data
  * over multiplexed packet stream.
  */
 void send_sideband(int fd, int band, const char *data, ssize_t sz, int packet_max)
 {
+	char hdr[SIDEBAND_WRITEV_PACKETS][5];
+	struct iovec iov[2 * SIDEBAND_WRITEV_PACKETS];
 	const char *p = data;
 
 	while (sz) {
-		unsigned n;
-		char hdr[5];
-
-		n = sz;
-		if (packet_max - 5 < n)
-			n = packet_max - 5;
-		if (0 <= band) {
-			xsnprintf(hdr, sizeof(hdr), "%04x", n + 5);
-			hdr[4] = band;
-			write_or_die(fd, hdr, 5);
-		} else {
-			xsnprintf(hdr, sizeof(hdr), "%04x", n + 4);
-			write_or_die(fd, hdr, 4);
+		int nr = 0;
+
+		while (sz && nr < SIDEBAND_WRITEV_PACKETS) {
+			unsigned n;
+
+			n = sz;
+			if (packet_max - 5 < n)
+				n = packet_max - 5;
+			if (0 <= band) {
+				xsnprintf(hdr[nr], sizeof(hdr[nr]), "%04x", n + 5);
+				hdr[nr][4] = band;
+				iov[2 * nr].iov_len = 5;
+			} else {
+				xsnprintf(hdr[nr], sizeof(hdr[nr]), "%04x", n + 4);
+				iov[2 * nr].iov_len = 4;
+			}
+			iov[2 * nr].iov_base = hdr[nr];
+			iov[2 * nr + 1].iov_base = (char *)p;
+			iov[2 * nr + 1].iov_len = n;
+			p += n;
+			sz -= n;
+			nr++;
 		}
-		write_or_die(fd, p, n);
-		p += n;
-		sz -= n;
+		writev_or_die(fd, iov, 2 * nr);
 	}
 }
@@ -1,5 +1,6 @@
 #include "test-tool.h"
 #include "hash.h"
+#include "parse-options.h"
 
 #define NUM_SECONDS 3
 
@@ -18,22 +19,45 @@ int cmd__hash_speed(int ac, const char **av)
 	unsigned bufsizes[] = { 64, 256, 1024, 8192, 16384 };
 	void *p;
 	const struct git_hash_algo *algo = NULL;
+	const char *impl = NULL;
+	const char * const usage[] = {
+		"test-tool hash-speed [--impl=<name>] <algo-name>",
+		NULL
+	};
+	struct option options[] = {
+		OPT_STRING(0, "impl", &impl, N_("name"),
+			   N_("use this implementation of the built-in SHA-256")),
+		OPT_END()
+	};
 
-	if (ac == 2) {
+	ac = parse_options(ac, av, NULL, options, usage, 0);
+	if (ac == 1) {
 		for (size_t i = 1; i < GIT_HASH_NALGOS; i++) {
-			if (!strcmp(av[1], hash_algos[i].name)) {
+			if (!strcmp(av[0], hash_algos[i].name)) {
 				algo = &hash_algos[i];
 				break;
 			}
 		}
 	}
 	if (!algo)
-		die("usage: test-tool hash-speed algo_name");
+		usage_with_options(usage, options);
+
+#ifdef SHA256_BLK
+	if (impl && blk_SHA256_set_impl(impl))
+		die("unsupported SHA-256 implementation: %s", impl);
+#else
+	if (impl)
+		die("--impl requires the built-in SHA-256 implementation");
+#endif
 
 	/* Use this as an offset to make overflow less likely. */
 	initial = clock();
 
 	printf("algo: %s\n", algo->name);
+#ifdef SHA256_BLK
+	if (hash_algo_by_ptr(algo) == GIT_HASH_SHA256)
+		printf("impl: %s\n", blk_SHA256_impl());
+#endif
 
 	for (size_t i = 0; i < ARRAY_SIZE(bufsizes); i++) {
 		unsigned long j, kb;
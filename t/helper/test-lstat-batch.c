@@ -0,0 +1,43 @@
+#include "test-tool.h"
+#include "git-compat-util.h"
+#include "compat/lstat-batch.h"
+
+/*
+ * Usage: test-tool lstat-batch <path>...
+ *
+ * lstat() all paths in one batch and print the mode and size of each,
+ * or the error. Exits with 1 if batched lstat() is not available.
+ */
+int cmd__lstat_batch(int argc, const char **argv)
+{
+	struct lstat_batch *b;
+	struct stat *st;
+	int *err;
+	int i, nr = argc - 1;
+
+	if (nr < 1)
+		die("usage: test-tool lstat-batch <path>...");
+
+	b = lstat_batch_new(nr);
+	if (!b) {
+		fprintf(stderr, "batched lstat() is not available\n");
+		return 1;
+	}
+
+	CALLOC_ARRAY(st, nr);
+	CALLOC_ARRAY(err, nr);
+	lstat_batch(b, nr, argv + 1, st, err);
+	for (i = 0; i < nr; i++) {
+		if (err[i])
+			printf("%s: %s\n", argv[i + 1], strerror(err[i]));
+		else
+			printf("%s: %06o %"PRIuMAX"\n", argv[i + 1],
+			       (unsigned int)st[i].st_mode,
+			       (uintmax_t)st[i].st_size);
+	}
+
+	lstat_batch_free(b);
+	free(st);
+	free(err);
+	return 0;
+}
@@ -86,6 +86,8 @@ int cmd__path_walk(int argc, const char **argv)
 			 N_("toggle aggressive edge walk")),
 		OPT_BOOL(0, "stdin-pl", &stdin_pl,
 			 N_("read a pattern list over stdin")),
+		OPT_INTEGER(0, "threads", &info.threads,
+			    N_("read trees with <n> threads")),
 		OPT_END(),
 	};
 
@@ -30,6 +30,8 @@ static void dump_graph_info(struct commit_graph *graph)
 		printf(" generation_data_overflow");
 	if (graph->chunk_extra_edges)
 		printf(" extra_edges");
+	if (graph->chunk_reach_labels)
+		printf(" reach_labels");
 	if (graph->chunk_bloom_indexes)
 		printf(" bloom_indexes");
 	if (graph->chunk_bloom_data)
@@ -46,4 +46,22 @@ test_perf "read-tree status br_ballast ($nr_files)" '
 	git status
 '
 
+test_perf "read-tree status br_ballast, core.preloadIndexIoUring ($nr_files)" '
+	git read-tree HEAD &&
+	git -c core.preloadIndexIoUring=true status
+'
+
+test_perf "read-tree status --porcelain=v2 --stream br_ballast ($nr_files)" '
+	git read-tree HEAD &&
+	git status --porcelain=v2 --stream >/dev/null
+'
+
+test_perf "status -uall ($nr_files)" '
+	git status -uall
+'
+
+test_perf "status -uall, core.untrackedScanThreads=0 ($nr_files)" '
+	git -c core.untrackedScanThreads=0 status -uall
+'
+
 test_done
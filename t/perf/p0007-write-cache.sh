@@ -26,4 +26,16 @@ test_perf "write_locked_index $count times ($nr_files files)" "
 	test-tool write-cache $count
 "
 
+for threads in 1 2 4 true
+do
+	test_expect_success "setup index.threads=$threads" "
+		git config index.threads $threads &&
+		git config index.recordOffsetTable true
+	"
+
+	test_perf "write_locked_index $count times (index.threads=$threads)" "
+		test-tool write-cache $count
+	"
+done
+
 test_done
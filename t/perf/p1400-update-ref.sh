@@ -14,7 +14,15 @@ test_expect_success "setup" '
 		printf "start\ncreate refs/heads/%d PRE\ncommit\n" $i &&
 		printf "start\nupdate refs/heads/%d POST PRE\ncommit\n" $i &&
 		printf "start\ndelete refs/heads/%d POST\ncommit\n" $i || return 1
-	done >instructions
+	done >instructions &&
+	for i in $(test_seq 5000)
+	do
+		printf "create refs/heads/bulk-%d PRE\n" $i || return 1
+	done >bulk-create &&
+	for i in $(test_seq 5000)
+	do
+		printf "delete refs/heads/bulk-%d PRE\n" $i || return 1
+	done >bulk-delete
 '
 
 test_perf "update-ref" '
@@ -30,4 +38,20 @@ test_perf "update-ref --stdin" '
 	git update-ref --stdin <instructions >/dev/null
 '
 
+test_perf "update-ref --stdin, single transaction" '
+	git update-ref --stdin <bulk-create &&
+	git update-ref --stdin <bulk-delete
+'
+
+test_perf "update-ref --stdin, single transaction, batch fsync" '
+	git -c core.fsync=reference -c core.fsyncMethod=batch \
+		update-ref --stdin <bulk-create &&
+	git update-ref --stdin <bulk-delete
+'
+
+test_perf "update-ref --stdin, single transaction, packed-refs threshold" '
+	git -c core.packedRefsThreshold=100 update-ref --stdin <bulk-create &&
+	git update-ref --stdin <bulk-delete
+'
+
 test_done
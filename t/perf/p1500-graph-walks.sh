@@ -78,4 +78,41 @@ test_perf 'is-base check: git for-each-ref (disjoint-base)' '
 	git for-each-ref --format="%(is-base:refs/heads/disjoint-base)" --stdin <refs
 '
 
+for labels in false true
+do
+	test_expect_success "write commit-graph (reachabilityLabels=$labels)" '
+		git -c commitGraph.reachabilityLabels=$labels \
+			commit-graph write --reachable
+	'
+
+	test_perf "ancestry checks: git merge-base --is-ancestor (labels=$labels)" '
+		for ref in $(cat refs)
+		do
+			test_might_fail git merge-base --is-ancestor HEAD $ref &&
+			test_might_fail git merge-base --is-ancestor $ref HEAD ||
+			return 1
+		done
+	'
+
+	test_perf "contains: git branch --contains (labels=$labels)" '
+		xargs git branch --contains=HEAD <branches
+	'
+
+	test_perf "contains: git tag --contains (labels=$labels)" '
+		xargs git tag --contains=HEAD <tags
+	'
+done
+
+test_expect_success 'write reachability bitmaps' '
+	git repack -adb
+'
+
+test_perf 'ahead-behind counts: git for-each-ref (bitmaps)' '
+	git for-each-ref --format="%(ahead-behind:HEAD)" --stdin <refs
+'
+
+test_perf 'ahead-behind counts: git branch (bitmaps)' '
+	xargs git branch -l --format="%(ahead-behind:HEAD)" <branches
+'
+
 test_done
@@ -47,4 +47,10 @@ test_perf 'index-pack default number of threads' \
 	GIT_DIR=repo.git git index-pack --stdin < $PACK
 '
 
+test_perf 'index-pack with pack.indexStreamDeltas' \
+	--setup 'rm -rf repo.git && git init --bare repo.git' '
+	GIT_DIR=repo.git git -c pack.indexStreamDeltas=true \
+		index-pack --stdin < $PACK
+'
+
 test_done
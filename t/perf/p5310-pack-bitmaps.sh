@@ -34,7 +34,18 @@ test_lookup_pack_bitmap () {
 	test_pack_bitmap
 }
 
+test_bitmap_threads () {
+	for threads in 1 0
+	do
+		test_perf "write bitmaps (threads=$threads)" "
+			rm -f .git/objects/pack/pack-*.bitmap &&
+			git -c pack.writeBitmapThreads=$threads repack -adb
+		"
+	done
+}
+
 test_lookup_pack_bitmap false
 test_lookup_pack_bitmap true
+test_bitmap_threads
 
 test_done
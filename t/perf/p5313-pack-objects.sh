@@ -71,4 +71,44 @@ done
 
 test_all_with_args --path-walk
 
+# Trees are read on "--threads" threads during a path-walk; compare the
+# default against a single thread.
+test_all_with_args "--path-walk --threads=1"
+
+# "git repack" has no --delta-sketches; use the config instead.
+test_perf 'big pack with --delta-sketches' '
+	git pack-objects --stdout --revs --sparse --delta-sketches \
+		<in-big >out
+'
+
+test_size 'big pack size with --delta-sketches' '
+	test_file_size out
+'
+
+test_perf 'repack with pack.deltaSketches' '
+	git -c pack.deltaSketches=true repack -adf
+'
+
+test_size 'repack size with pack.deltaSketches' '
+	gitdir=$(git rev-parse --git-dir) &&
+	pack=$(ls $gitdir/objects/pack/pack-*.pack) &&
+	test_file_size "$pack"
+'
+
+# The first repack writes a .dhints file; the timed ones seed their
+# delta search from the one written before them.
+test_expect_success 'write delta hints' '
+	git -c pack.deltaHints=true repack -adf
+'
+
+test_perf 'repack with pack.deltaHints' '
+	git -c pack.deltaHints=true repack -adf
+'
+
+test_size 'repack size with pack.deltaHints' '
+	gitdir=$(git rev-parse --git-dir) &&
+	pack=$(ls $gitdir/objects/pack/pack-*.pack) &&
+	test_file_size "$pack"
+'
+
 test_done
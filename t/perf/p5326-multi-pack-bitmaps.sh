@@ -31,6 +31,14 @@ test_bitmap () {
 		git multi-pack-index write --bitmap
 	'
 
+	for threads in 1 0
+	do
+		test_perf "rewrite multi-pack bitmap (lookup=$enabled, threads=$threads)" "
+			rm -f .git/objects/pack/multi-pack-index*.bitmap &&
+			git -c pack.writeBitmapThreads=$threads multi-pack-index write --bitmap
+		"
+	done
+
 	test_expect_success "drop pack bitmap (lookup=$enabled)" '
 		rm -f .git/objects/pack/pack-*.bitmap
 	'
@@ -84,4 +84,11 @@ test_expect_success 'pack refs' '
 '
 run_tests "packed"
 
+test_expect_success 'pack refs with packed-refs version 2' '
+	git config core.repositoryFormatVersion 1 &&
+	git config extensions.packedRefsVersion 2 &&
+	git pack-refs --all
+'
+run_tests "packed v2"
+
 test_done
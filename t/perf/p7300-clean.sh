@@ -32,4 +32,12 @@ test_perf 'ls-files -o' '
 	git ls-files -o
 '
 
+test_perf 'ls-files -o (core.untrackedScanThreads=0)' '
+	git -c core.untrackedScanThreads=0 ls-files -o
+'
+
+test_perf 'clean many untracked sub dirs (core.untrackedScanThreads=0)' '
+	git -c core.untrackedScanThreads=0 clean -n -q -f -f -d 100000_sub_dirs/
+'
+
 test_done
@@ -20,4 +20,13 @@ test_perf 'grep --cached, expensive regex' '
 	git grep --cached "^.* *some_nonexistent_string$" || :
 '
 
+# "grep --cached" reads blobs from several threads at once, which
+# exercises the delta base cache under contention.
+for threads in 1 2 4 8
+do
+	test_perf "grep --cached, cheap regex, $threads threads" "
+		git -c grep.threads=$threads grep --cached some_nonexistent_string || :
+	"
+done
+
 test_done
@@ -0,0 +1,154 @@
+#!/bin/sh
+
+test_description='packed-refs file format version 2'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+GIT_TEST_DEFAULT_REF_FORMAT=files
+export GIT_TEST_DEFAULT_REF_FORMAT
+
+. ./test-lib.sh
+
+# Print the first four bytes of the packed-refs file in "$1".
+packed_refs_magic () {
+	test_copy_bytes 4 <"$1/.git/packed-refs"
+}
+
+test_expect_success 'setup' '
+	git init repo &&
+	(
+		cd repo &&
+		git config core.repositoryFormatVersion 1 &&
+		git config extensions.packedRefsVersion 2 &&
+		for i in 1 2 3 4 5
+		do
+			test_commit --annotate c$i &&
+			git branch branch-$i &&
+			git update-ref refs/pull/$i/head HEAD &&
+			git update-ref refs/pull/$i/merge c1 || return 1
+		done &&
+		git tag lightweight &&
+		git for-each-ref >../refs.expect &&
+		git show-ref -d >../show-ref.expect &&
+		git for-each-ref refs/pull/ >../pull.expect
+	)
+'
+
+test_expect_success 'pack-refs writes version 2' '
+	git -C repo pack-refs --all &&
+	echo PREF >expect &&
+	packed_refs_magic repo >actual &&
+	echo >>actual &&
+	test_cmp expect actual &&
+	find repo/.git/refs -type f >loose &&
+	test_must_be_empty loose
+'
+
+test_expect_success 'references are read from version 2' '
+	git -C repo for-each-ref >actual &&
+	test_cmp refs.expect actual &&
+	git -C repo show-ref -d >actual &&
+	test_cmp show-ref.expect actual &&
+	git -C repo rev-parse c3 >actual &&
+	git -C repo rev-parse refs/tags/c3 >expect &&
+	test_cmp expect actual &&
+	test_must_fail git -C repo rev-parse --verify -q refs/heads/missing
+'
+
+test_expect_success 'prefix iteration and exclusion' '
+	git -C repo for-each-ref refs/pull/ >actual &&
+	test_cmp pull.expect actual &&
+	git -C repo for-each-ref refs/pull/3/ >actual &&
+	grep "refs/pull/3/" pull.expect >expect &&
+	test_cmp expect actual &&
+	git -C repo for-each-ref refs/nothing/ refs/pul >actual &&
+	test_must_be_empty actual &&
+	git -C repo for-each-ref --exclude=refs/pull/ --exclude=refs/tags/ >actual &&
+	grep "refs/heads/" refs.expect >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'updates and deletions keep version 2' '
+	git -C repo update-ref -d refs/heads/branch-2 &&
+	git -C repo update-ref refs/heads/branch-3 c1^{commit} &&
+	git -C repo pack-refs --all &&
+	echo PREF >expect &&
+	packed_refs_magic repo >actual &&
+	echo >>actual &&
+	test_cmp expect actual &&
+	test_must_fail git -C repo rev-parse --verify -q branch-2 &&
+	git -C repo rev-parse c1^{commit} >expect &&
+	git -C repo rev-parse branch-3 >actual &&
+	test_cmp expect actual &&
+	git -C repo refs verify
+'
+
+test_expect_success 'packed-refs file is converted when rewritten' '
+	test_when_finished "rm -rf convert" &&
+	git clone --no-local repo convert &&
+	git -C convert pack-refs --all &&
+	head -n 1 convert/.git/packed-refs >header &&
+	test_grep "^# pack-refs with:" header &&
+	git -C convert for-each-ref >expect &&
+
+	git -C convert config core.repositoryFormatVersion 1 &&
+	git -C convert config extensions.packedRefsVersion 2 &&
+	git -C convert pack-refs --all &&
+	echo PREF >magic-expect &&
+	packed_refs_magic convert >magic &&
+	echo >>magic &&
+	test_cmp magic-expect magic &&
+	git -C convert for-each-ref >actual &&
+	test_cmp expect actual &&
+
+	git -C convert config extensions.packedRefsVersion 1 &&
+	git -C convert for-each-ref >actual &&
+	test_cmp expect actual &&
+	git -C convert pack-refs --all &&
+	head -n 1 convert/.git/packed-refs >header &&
+	test_grep "^# pack-refs with:" header &&
+
+	git -C convert config unset extensions.packedRefsVersion &&
+	git -C convert for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'version 2 is not read without the extension' '
+	test_when_finished "rm -rf unprotected" &&
+	cp -R repo unprotected &&
+	git -C unprotected config unset extensions.packedRefsVersion &&
+	test_must_fail git -C unprotected for-each-ref 2>err &&
+	test_grep "uses version 2, but extensions.packedRefsVersion is not set" err &&
+	test_must_fail git -C unprotected refs verify 2>err &&
+	test_grep "badPackedRefHeader: version 2 file without extensions.packedRefsVersion" err
+'
+
+test_expect_success 'invalid extension value is rejected' '
+	test_when_finished "rm -rf invalid" &&
+	git init invalid &&
+	git -C invalid config core.repositoryFormatVersion 1 &&
+	git -C invalid config extensions.packedRefsVersion 3 &&
+	test_must_fail git -C invalid rev-parse HEAD 2>err &&
+	test_grep "invalid value for .extensions.packedrefsversion." err
+'
+
+test_expect_success 'refs verify detects a corrupt version 2 file' '
+	test_when_finished "rm -rf corrupt" &&
+	cp -R repo corrupt &&
+	size=$(test-tool path-utils file-size corrupt/.git/packed-refs) &&
+	printf "\377\377\377\377" |
+	dd of=corrupt/.git/packed-refs bs=1 seek=$(($size - 4)) conv=notrunc &&
+	test_must_fail git -C corrupt refs verify 2>err &&
+	test_grep "badPackedRefHeader: checksum mismatch" err
+'
+
+test_expect_success 'migrating a version 2 file to reftable' '
+	test_when_finished "rm -rf migrate" &&
+	cp -R repo migrate &&
+	git -C migrate for-each-ref >expect &&
+	git -C migrate refs migrate --ref-format=reftable &&
+	git -C migrate for-each-ref >actual &&
+	test_cmp expect actual
+'
+
+test_done
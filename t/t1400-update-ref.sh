@@ -2368,4 +2368,72 @@ test_expect_success REFFILES 'empty directories are pruned when not committing'
 	test_path_is_missing .git/refs/heads/nested
 '
 
+test_expect_success REFFILES 'core.packedRefsThreshold writes large transactions to packed-refs' '
+	test_when_finished "git update-ref -d refs/heads/loose-before" &&
+	git update-ref refs/heads/loose-before HEAD~ &&
+	test_path_is_file .git/refs/heads/loose-before &&
+	cat >input <<-EOF &&
+	update refs/heads/loose-before HEAD
+	create refs/heads/packed-1 HEAD
+	create refs/heads/packed-2 HEAD
+	EOF
+	git -c core.packedRefsThreshold=3 update-ref -m bulk --stdin <input &&
+	test_path_is_missing .git/refs/heads/loose-before &&
+	test_path_is_missing .git/refs/heads/packed-1 &&
+	test_path_is_missing .git/refs/heads/packed-2 &&
+	git rev-parse HEAD >expect &&
+	for ref in loose-before packed-1 packed-2
+	do
+		grep "$(cat expect) refs/heads/$ref\$" .git/packed-refs &&
+		git rev-parse $ref >actual &&
+		test_cmp expect actual &&
+		git reflog show --format=%gs refs/heads/$ref -1 >msg &&
+		echo bulk >expect-msg &&
+		test_cmp expect-msg msg || return 1
+	done &&
+	git update-ref -d refs/heads/packed-1 &&
+	git update-ref -d refs/heads/packed-2
+'
+
+test_expect_success REFFILES 'core.packedRefsThreshold ignores small transactions' '
+	test_when_finished "git update-ref -d refs/heads/small" &&
+	git -c core.packedRefsThreshold=3 update-ref refs/heads/small HEAD &&
+	test_path_is_file .git/refs/heads/small
+'
+
+test_expect_success REFFILES 'core.packedRefsThreshold keeps symrefs and verifies objects' '
+	test_when_finished "git update-ref -d refs/heads/threshold" &&
+	cat >input <<-EOF &&
+	symref-create refs/heads/sym refs/heads/main
+	create refs/heads/threshold HEAD
+	EOF
+	git -c core.packedRefsThreshold=2 update-ref --stdin <input &&
+	test_path_is_file .git/refs/heads/sym &&
+	test_path_is_missing .git/refs/heads/threshold &&
+	git update-ref --no-deref -d refs/heads/sym &&
+
+	cat >input <<-EOF &&
+	create refs/heads/missing-1 $(test_oid deadbeef)
+	create refs/heads/missing-2 HEAD
+	EOF
+	test_must_fail git -c core.packedRefsThreshold=2 \
+		update-ref --stdin <input 2>err &&
+	test_grep "cannot update ref .refs/heads/missing-1." err &&
+	test_must_fail git rev-parse --verify -q refs/heads/missing-2
+'
+
+test_expect_success 'update-ref with core.fsyncMethod=batch' '
+	cat >input <<-EOF &&
+	create refs/heads/batch-1 HEAD
+	create refs/heads/batch-2 HEAD
+	EOF
+	git -c core.fsync=reference -c core.fsyncMethod=batch \
+		update-ref --stdin <input &&
+	git rev-parse HEAD >expect &&
+	git rev-parse batch-1 >actual &&
+	test_cmp expect actual &&
+	find .git -name "bulk_fsync_*" >files &&
+	test_must_be_empty files
+'
+
 test_done
@@ -814,6 +814,30 @@ test_expect_success 'fsck fails on corrupt packfile' '
 	test_grep "checksum mismatch" out
 '
 
+test_expect_success 'fsck.threads reports the same problems' '
+	test_when_finished "rm -rf threaded" &&
+	git init threaded &&
+	(
+		cd threaded &&
+		test_commit_bulk 1000 &&
+		git cat-file commit HEAD >basis &&
+		sed "s/</one/" basis >bad &&
+		bad=$(git hash-object --literally -t commit -w bad) &&
+		{
+			git rev-list --objects --all &&
+			echo $bad
+		} | git pack-objects .git/objects/pack/pack &&
+		git prune-packed &&
+
+		test_must_fail git -c fsck.threads=1 fsck 2>err.1 &&
+		test_must_fail git -c fsck.threads=4 fsck 2>err.4 &&
+		test_grep "error in commit $bad.* - bad name" err.4 &&
+		sort err.1 >expect &&
+		sort err.4 >actual &&
+		test_cmp expect actual
+	)
+'
+
 test_expect_success 'fsck finds problems in duplicate loose objects' '
 	rm -rf broken-duplicate &&
 	git init broken-duplicate &&
@@ -0,0 +1,65 @@
+#!/bin/sh
+
+test_description='writing the index with multiple threads'
+
+. ./test-lib.sh
+
+# Show everything we know about the index of "repo", reading it both
+# with one and with several threads.
+dump_index () {
+	git -C repo -c index.threads=1 ls-files -s &&
+	git -C repo -c index.threads=4 ls-files -s &&
+	test-tool -C repo dump-cache-tree &&
+	test-tool -C repo dump-untracked-cache
+}
+
+test_expect_success 'setup' '
+	git init -q repo &&
+	(
+		cd repo &&
+		for d in a a/b a/b/c d e/f/g long-directory-name
+		do
+			mkdir -p $d &&
+			for i in 1 2 3 4 5 6 7 8
+			do
+				echo $d$i >$d/file$i || return 1
+			done || return 1
+		done &&
+		echo "*.o" >.gitignore &&
+		git add . &&
+		git commit -q -m initial &&
+		mkdir -p untracked/sub &&
+		echo untracked >untracked/sub/file &&
+		echo untracked >a/b/untracked &&
+		echo object >d/file.o &&
+
+		# Keep racily clean entries from being smudged differently
+		# by different writes.
+		test-tool chmtime =-60 $(git ls-files) &&
+		git update-index --untracked-cache &&
+		git -c core.untrackedCache=true status >/dev/null &&
+		git write-tree >/dev/null
+	)
+'
+
+for version in 2 4
+do
+	test_expect_success "threaded write of index version $version" '
+		git -C repo -c index.threads=1 \
+			update-index --index-version $version --force-write-index &&
+		cp repo/.git/index index.serial &&
+		! grep IEOT index.serial &&
+		dump_index >expect &&
+
+		git -C repo -c index.threads=4 -c index.recordOffsetTable=true \
+			update-index --force-write-index &&
+		grep IEOT repo/.git/index &&
+		dump_index >actual &&
+		test_cmp expect actual &&
+
+		git -C repo -c index.threads=1 update-index --force-write-index &&
+		test_cmp_bin index.serial repo/.git/index
+	'
+done
+
+test_done
@@ -430,6 +430,41 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+test_expect_success '--threads does not change the Bloom filters' '
+	git init threads &&
+	test_when_finished "rm -fr threads" &&
+	(
+		cd threads &&
+		for i in $(test_seq 1 20)
+		do
+			mkdir -p dir$((i % 3))/sub &&
+			test_commit $i dir$((i % 3))/sub/file$i || return 1
+		done &&
+		git commit --allow-empty -m empty &&
+		for i in $(test_seq 1 12)
+		do
+			echo $i >large$i || return 1
+		done &&
+		git add large* &&
+		git commit -m large &&
+
+		for threads in 1 4
+		do
+			rm -f .git/objects/info/commit-graph &&
+			rm -f trace.event &&
+			GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+			GIT_TRACE2_EVENT="$(pwd)/trace.event" \
+				git commit-graph write --reachable \
+					--changed-paths --threads=$threads &&
+			test_filter_computed 22 trace.event &&
+			test_filter_trunc_empty 1 trace.event &&
+			test_filter_trunc_large 1 trace.event &&
+			cp .git/objects/info/commit-graph graph.$threads || return 1
+		done &&
+		test_cmp_bin graph.1 graph.4
+	)
+'
+
 graph=.git/objects/info/commit-graph
 graphdir=.git/objects/info/commit-graphs
 chain=$graphdir/commit-graph-chain
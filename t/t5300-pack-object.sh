@@ -742,4 +742,98 @@ test_expect_success '--path-walk thin pack' '
 	git -C server index-pack --fix-thin --stdin <out.pack
 '
 
+test_expect_success '--path-walk with threads writes identical packs' '
+	git -C server rev-parse HEAD >in &&
+	git -C server pack-objects --stdout --revs --path-walk \
+		--threads=1 --window=0 <in >one.pack &&
+	git -C server pack-objects --stdout --revs --path-walk \
+		--threads=4 --window=0 <in >four.pack &&
+	test_cmp_bin one.pack four.pack
+'
+
+test_expect_success '--delta-sketches finds bases outside the window' '
+	test-tool genrandom sketch-a 8192 >sketch-a &&
+	{ cat sketch-a && echo tail; } >sketch-b &&
+	test-tool genrandom sketch-c 8192 >sketch-c &&
+	cat >sketch-list <<-EOF &&
+	$(git -C server hash-object -w --stdin <sketch-a) aaaa
+	$(git -C server hash-object -w --stdin <sketch-c) mmmm
+	$(git -C server hash-object -w --stdin <sketch-b) zzzz
+	EOF
+	git -C server pack-objects --window=1 --no-reuse-delta \
+		../no-sketch <sketch-list >hash &&
+	git verify-pack -v no-sketch-$(cat hash).idx >out &&
+	! grep " 1 $(git hash-object sketch-b)\$" out &&
+
+	git -C server pack-objects --window=1 --no-reuse-delta \
+		--delta-sketches ../sketch <sketch-list >hash &&
+	git verify-pack -v sketch-$(cat hash).idx >out &&
+	grep " 1 $(git hash-object sketch-b)\$" out &&
+
+	git -C server -c pack.deltaSketches=true pack-objects --window=1 \
+		--no-reuse-delta ../sketch-config <sketch-list >hash &&
+	git verify-pack -v sketch-config-$(cat hash).idx >out &&
+	grep " 1 $(git hash-object sketch-b)\$" out
+'
+
+test_expect_success '--delta-sketches packs everything' '
+	git -C server rev-parse HEAD >in &&
+	GIT_PROGRESS_DELAY=0 git -C server pack-objects --stdout --revs \
+		--no-reuse-delta --delta-sketches --progress <in >out.pack 2>err &&
+	grep "Compressing objects by similarity" err &&
+	git -C server index-pack --stdin <out.pack
+'
+
+test_expect_success '--delta-sketches respects --depth' '
+	# Each revision shares content only with its neighbours, so that
+	# several bases are needed and chains could form across bands.
+	for i in $(test_seq 40)
+	do
+		test_seq $((i * 50)) $((i * 50 + 1000)) >depth-file &&
+		git -C server hash-object -w --stdin <depth-file || return 1
+	done >depth-list &&
+	git -C server pack-objects --window=10 --depth=1 --no-reuse-delta \
+		--delta-sketches ../depth <depth-list >hash &&
+	git verify-pack -s depth-$(cat hash).idx >stat &&
+	grep "chain length = 1:" stat &&
+	awk "/chain length = / { if (\$4 + 0 > 1) exit 1 }" stat
+'
+
+test_expect_success 'core.pipelinedHashing writes identical packs' '
+	test-tool genrandom pipelined 2097152 >pipelined.bin &&
+	git -C server hash-object -w --stdin <pipelined.bin >obj-list &&
+	git -C server rev-list --objects --all >>obj-list &&
+	git -C server -c core.pipelinedHashing=false \
+		pack-objects --stdout <obj-list >inline.pack &&
+	git -C server -c core.pipelinedHashing=true \
+		pack-objects --stdout <obj-list >pipelined.pack &&
+	test_cmp_bin inline.pack pipelined.pack &&
+
+	inline=$(git -C server -c core.pipelinedHashing=false \
+		pack-objects ../pipelined-inline <obj-list) &&
+	pipelined=$(git -C server -c core.pipelinedHashing=true \
+		pack-objects ../pipelined-threaded <obj-list) &&
+	test "$inline" = "$pipelined" &&
+	test_cmp_bin pipelined-inline-$inline.pack \
+		pipelined-threaded-$pipelined.pack &&
+	git verify-pack pipelined-threaded-$pipelined.idx
+'
+
+test_expect_success 'core.pipelinedHashing with index-pack --fix-thin' '
+	cat >in <<-EOF &&
+	$(git -C server rev-parse HEAD)
+	^$(git -C server rev-parse HEAD~2)
+	EOF
+	git -C server pack-objects --thin --stdout --revs <in >thin.pack &&
+	git -C server -c core.pipelinedHashing=true \
+		index-pack --fix-thin --stdin <thin.pack >out &&
+	git -C server verify-pack ".git/objects/pack/pack-$(sed -n "s/^pack.//p" out).idx"
+'
+
+test_expect_success 'pack.indexStreamDeltas with index-pack --fix-thin' '
+	git -C server -c pack.indexStreamDeltas=true \
+		index-pack --fix-thin --stdin <thin.pack >out &&
+	git -C server verify-pack ".git/objects/pack/pack-$(sed -n "s/^pack.//p" out).idx"
+'
+
 test_done
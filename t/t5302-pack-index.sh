@@ -285,6 +285,29 @@ test_expect_success 'index-pack -v --stdin produces progress for both phases' '
 	test_grep "Resolving deltas" err
 '
 
+test_expect_success 'index-pack with pack.indexStreamDeltas' '
+	ofs=$(git pack-objects --delta-base-offset test-ofs <obj-list) &&
+	for pack in test-2-$pack2 test-ofs-$ofs
+	do
+		for threads in 1 4
+		do
+			rm -f stream.pack stream.idx &&
+			git -c pack.indexStreamDeltas=true index-pack \
+				--threads=$threads --stdin -o stream.idx stream.pack \
+				<$pack.pack &&
+			test_cmp_bin $pack.idx stream.idx || return 1
+		done
+	done &&
+	rm -f stream.pack stream.idx &&
+	git -c pack.indexStreamDeltas=true -c core.deltaBaseCacheLimit=1 \
+		index-pack --stdin -o stream.idx stream.pack <test-ofs-$ofs.pack &&
+	test_cmp_bin test-ofs-$ofs.idx stream.idx &&
+	git index-pack --verify-stat test-ofs-$ofs.pack >expect &&
+	git -c pack.indexStreamDeltas=true \
+		index-pack --verify-stat test-ofs-$ofs.pack >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'too-large packs report the breach' '
 	pack=$(git pack-objects --all pack </dev/null) &&
 	sz="$(test_file_size pack-$pack.pack)" &&
@@ -607,4 +607,12 @@ test_expect_success 'truncated bitmap fails gracefully (lookup table)' '
 	test_grep corrupted.bitmap.index stderr
 '
 
+test_expect_success 'pack.writeBitmapThreads does not change the bitmap' '
+	git -c pack.writeBitmapThreads=1 repack -adb &&
+	cp .git/objects/pack/pack-*.bitmap expect.bitmap &&
+	rm -f .git/objects/pack/pack-*.bitmap &&
+	git -c pack.writeBitmapThreads=4 repack -adb &&
+	test_cmp_bin expect.bitmap .git/objects/pack/pack-*.bitmap
+'
+
 test_done
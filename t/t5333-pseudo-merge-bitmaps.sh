@@ -77,6 +77,21 @@ test_expect_success 'pseudo-merges accurately represent their objects' '
 	done
 '
 
+test_expect_success 'pseudo-merge bitmaps are the same when threaded' '
+	test_config bitmapPseudoMerge.test.pattern "refs/tags/" &&
+	test_config bitmapPseudoMerge.test.maxMerges 8 &&
+	test_config bitmapPseudoMerge.test.stableThreshold never &&
+
+	git -c pack.writeBitmapThreads=1 repack -adb &&
+	cp .git/objects/pack/pack-*.bitmap expect.bitmap &&
+	rm -f .git/objects/pack/pack-*.bitmap &&
+	git -c pack.writeBitmapThreads=4 repack -adb &&
+	test_cmp_bin expect.bitmap .git/objects/pack/pack-*.bitmap &&
+
+	test_pseudo_merges >merges &&
+	test_line_count = 8 merges
+'
+
 test_expect_success 'bitmap traversal with pseudo-merges' '
 	: >trace2.txt &&
 	GIT_TRACE2_EVENT=$PWD/trace2.txt \
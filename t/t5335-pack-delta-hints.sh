@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='pack-objects delta hints'
+
+. ./test-lib.sh
+
+packdir=.git/objects/pack
+
+# Print "<object> <base>" for each delta in the pack with index "$1".
+delta_pairs () {
+	git verify-pack -v "$1" >verify &&
+	awk "NF == 7 { print \$1, \$7 }" <verify | sort
+}
+
+test_expect_success 'setup' '
+	test_seq 1000 >file &&
+	git add file &&
+	git commit -m base &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		echo $i >>file &&
+		cp file copy-$i &&
+		git add file copy-$i &&
+		git commit -m $i || return 1
+	done
+'
+
+test_expect_success 'pack-objects --delta-hints writes .dhints' '
+	pack=$(git pack-objects --all $packdir/pack </dev/null) &&
+	test_path_is_missing $packdir/pack-$pack.dhints &&
+
+	pack=$(git pack-objects --all --delta-hints $packdir/pack </dev/null) &&
+	test_path_is_file $packdir/pack-$pack.dhints &&
+
+	pack=$(git -c pack.deltaHints=true pack-objects --all \
+		$packdir/pack </dev/null) &&
+	test_path_is_file $packdir/pack-$pack.dhints
+'
+
+test_expect_success 'repack with pack.deltaHints keeps the same deltas' '
+	git -c pack.deltaHints=true repack -adf &&
+	ls $packdir/pack-*.dhints >dhints &&
+	test_line_count = 1 dhints &&
+	idx=$(ls $packdir/pack-*.idx) &&
+	delta_pairs $idx >before &&
+	test_file_not_empty before &&
+
+	git -c pack.deltaHints=true repack -adf &&
+	git fsck &&
+	ls $packdir/pack-*.dhints >dhints &&
+	test_line_count = 1 dhints &&
+	idx=$(ls $packdir/pack-*.idx) &&
+	delta_pairs $idx >after &&
+	test_cmp before after
+'
+
+test_expect_success 'hinted deltas do not need the window' '
+	git pack-objects --all --no-reuse-delta --window=1 --delta-hints \
+		hints </dev/null >hash &&
+	git index-pack --stdin <hints-$(cat hash).pack &&
+	delta_pairs hints-$(cat hash).idx >hints &&
+	test_cmp after hints
+'
+
+test_expect_success 'hints respect --depth' '
+	git pack-objects --all --no-reuse-delta --depth=2 --delta-hints \
+		shallow </dev/null >hash &&
+	git verify-pack -s shallow-$(cat hash).idx >stat &&
+	awk "/chain length = / { if (\$4 + 0 > 2) exit 1 }" stat
+'
+
+test_expect_success 'corrupt .dhints files are ignored' '
+	dhints=$(ls $packdir/pack-*.dhints) &&
+	test_when_finished "rm -f $dhints" &&
+	chmod u+w $dhints &&
+	printf "DHNT" >$dhints &&
+	git pack-objects --all --no-reuse-delta --delta-hints \
+		corrupt </dev/null >hash 2>err &&
+	test_grep "delta hints file .* is too small" err &&
+	git index-pack --stdin <corrupt-$(cat hash).pack
+'
+
+test_expect_success 'repack removes .dhints of old packs' '
+	git -c pack.deltaHints=true repack -adf &&
+	test_commit more &&
+	git repack -ad &&
+	find $packdir -name "*.dhints" >dhints &&
+	test_line_count = 0 dhints &&
+	git count-objects -v >count &&
+	grep "^garbage: 0" count
+'
+
+test_done
@@ -1079,6 +1079,26 @@ test_expect_success 'fetch with --filter=blob:limit=0' '
 	fetch_filter_blob_limit_zero server server
 '
 
+test_expect_success 'upload-pack without side-band sends the raw pack' '
+	test_when_finished "rm -rf raw raw.pack raw.idx" &&
+	git init raw &&
+	test_seq 100000 >raw/file &&
+	test-tool genrandom raw 1000000 >raw/random &&
+	git -C raw add . &&
+	git -C raw commit -m raw &&
+	head=$(git -C raw rev-parse HEAD) &&
+	printf "%04xwant %s\n00000009done\n0000" \
+		$(($(test_oid hexsz) + 10)) $head >input &&
+	git upload-pack --stateless-rpc raw <input >output &&
+	test_copy_bytes 8 <output >nak &&
+	printf "0008NAK\n" >expect &&
+	test_cmp expect nak &&
+	tail -c +9 output >raw.pack &&
+	git -C raw index-pack "$(pwd)/raw.pack" &&
+	git -C raw verify-pack -v "$(pwd)/raw.idx" >objects &&
+	grep $head objects
+'
+
 . "$TEST_DIRECTORY"/lib-httpd.sh
 start_httpd
 
@@ -0,0 +1,102 @@
+#!/bin/sh
+
+test_description='upload-pack pack cache'
+
+. ./test-lib.sh
+
+cache=.git/upload-pack-cache
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git config uploadpack.packCacheSize 10m
+'
+
+# Clone into "$1" with trace2 output in "$1.trace"; the other arguments
+# are passed to "git clone".
+clone_traced () {
+	dst=$1 &&
+	shift &&
+	rm -rf "$dst" "$dst.trace" &&
+	GIT_TRACE2_EVENT="$(pwd)/$dst.trace" \
+		git clone "$@" "file://$(pwd)" "$dst" &&
+	git -C "$dst" fsck
+}
+
+# Print the total size of the cached packs.
+cache_size () {
+	find $cache -name "*.pack" >packs &&
+	test-tool path-utils file-size $(cat packs) >sizes &&
+	awk "{ total += \$1 } END { print total }" <sizes
+}
+
+test_expect_success 'first clone fills the cache' '
+	clone_traced dst.git &&
+	grep "\"name\":\"pack-cache-miss\",\"count\":1" dst.git.trace &&
+	find $cache -name "*.pack" >packs &&
+	test_line_count = 1 packs &&
+	git index-pack --stdin <$(cat packs)
+'
+
+test_expect_success 'second clone is served from the cache' '
+	clone_traced dst2.git &&
+	grep "\"name\":\"pack-cache-hit\",\"count\":1" dst2.git.trace &&
+	git -C dst.git rev-parse HEAD >expect &&
+	git -C dst2.git rev-parse HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'protocol v0 clone uses the same cache entry' '
+	test_config protocol.version 0 &&
+	clone_traced dst-v0.git &&
+	grep "\"name\":\"pack-cache-hit\"" dst-v0.git.trace
+'
+
+test_expect_success 'ref updates invalidate the cache' '
+	git tag -m tag annotated one &&
+	clone_traced dst3.git &&
+	grep "\"name\":\"pack-cache-miss\"" dst3.git.trace &&
+	git -C dst3.git rev-parse annotated
+'
+
+test_expect_success 'fetches with haves get their own entries' '
+	git -C dst.git fetch origin &&
+	test_commit three &&
+	GIT_TRACE2_EVENT="$(pwd)/fetch.trace" git -C dst.git fetch origin &&
+	grep "\"name\":\"pack-cache-miss\"" fetch.trace &&
+	git -C dst.git fsck &&
+	git -C dst.git cat-file -e $(git rev-parse HEAD)
+'
+
+test_expect_success 'cache is kept under uploadpack.packCacheSize' '
+	test_commit four &&
+	clone_traced dst4.git &&
+	find $cache -name "*.pack" >packs &&
+	test_line_count -gt 2 packs &&
+	cp packs packs-before &&
+	size=$(test-tool path-utils file-size $(ls -t $(cat packs) | head -n 1)) &&
+	test_config uploadpack.packCacheSize $size &&
+
+	clone_traced dst5.git --depth=1 &&
+	grep "\"name\":\"pack-cache-miss\"" dst5.git.trace &&
+	test $(cache_size) -le $size &&
+	test_line_count -lt $(wc -l <packs-before) packs
+'
+
+test_expect_success 'packs over uploadpack.packCacheSize are not cached' '
+	rm -rf $cache &&
+	test_config uploadpack.packCacheSize 1 &&
+	clone_traced dst6.git &&
+	find $cache -name "*" -type f >files &&
+	test_must_be_empty files
+'
+
+test_expect_success 'no caching without uploadpack.packCacheSize' '
+	rm -rf $cache &&
+	test_unconfig uploadpack.packCacheSize &&
+	clone_traced dst7.git &&
+	test_path_is_missing $cache &&
+	! grep "\"name\":\"pack-cache-" dst7.git.trace
+'
+
+test_done
@@ -58,6 +58,12 @@ test_expect_success 'setup' '
 	git -c commitGraph.generationVersion=1 commit-graph write --reachable &&
 	mv .git/objects/info/commit-graph commit-graph-no-gdat &&
 	chmod u+w commit-graph-no-gdat &&
+	git -c commitGraph.reachabilityLabels=true commit-graph write --reachable &&
+	test-tool read-graph >graph-info &&
+	grep "^chunks:.* reach_labels" graph-info &&
+	git commit-graph verify &&
+	mv .git/objects/info/commit-graph commit-graph-labels &&
+	chmod u+w commit-graph-labels &&
 	git config core.commitGraph true
 '
 
@@ -73,6 +79,9 @@ run_all_modes () {
 	test_cmp expect actual &&
 	cp commit-graph-no-gdat .git/objects/info/commit-graph &&
 	"$@" <input >actual &&
+	test_cmp expect actual &&
+	cp commit-graph-labels .git/objects/info/commit-graph &&
+	"$@" <input >actual &&
 	test_cmp expect actual
 }
 
@@ -529,6 +538,43 @@ test_expect_success 'for-each-ref ahead-behind:none' '
 		--format="%(refname) %(ahead-behind:commit-8-4)" --stdin
 '
 
+test_expect_success 'for-each-ref ahead-behind: bitmaps' '
+	test_when_finished "rm -f .git/objects/pack/pack-*.bitmap" &&
+	test_when_finished "git update-ref -d refs/tmp/loose" &&
+	cat >input <<-\EOF &&
+	refs/heads/commit-1-1
+	refs/heads/commit-5-3
+	refs/heads/commit-7-8
+	refs/heads/commit-4-8
+	refs/heads/commit-9-9
+	refs/tmp/loose
+	EOF
+	cat >expect <<-\EOF &&
+	refs/heads/commit-1-1 0 53 0 53
+	refs/heads/commit-4-8 8 30 0 22
+	refs/heads/commit-5-3 0 39 0 39
+	refs/heads/commit-7-8 14 12 8 6
+	refs/heads/commit-9-9 27 0 27 0
+	refs/tmp/loose 28 0 28 0
+	EOF
+	git repack -adb &&
+	loose=$(git commit-tree -p commit-9-9 -m loose commit-9-9^{tree}) &&
+	git update-ref refs/tmp/loose $loose &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-bitmap.txt" git for-each-ref \
+		--format="%(refname) %(ahead-behind:commit-9-6) %(ahead-behind:commit-6-9)" \
+		--stdin <input >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"strategy\",\"value\":\"bitmap\"" trace-bitmap.txt &&
+
+	rm -f .git/objects/pack/pack-*.bitmap &&
+	GIT_TRACE2_EVENT="$(pwd)/trace-walk.txt" git for-each-ref \
+		--format="%(refname) %(ahead-behind:commit-9-6) %(ahead-behind:commit-6-9)" \
+		--stdin <input >actual &&
+	test_cmp expect actual &&
+	grep "\"key\":\"strategy\",\"value\":\"walk\"" trace-walk.txt
+'
+
 test_expect_success 'for-each-ref merged:linear' '
 	cat >input <<-\EOF &&
 	refs/heads/commit-1-1
@@ -415,4 +415,14 @@ test_expect_success 'trees are reported exactly once' '
 	test_line_count = 1 out-filtered
 '
 
+test_expect_success 'reading trees on threads does not change the walk' '
+	test-tool path-walk -- --all >expect &&
+	test-tool path-walk --threads=4 -- --all >out &&
+	test_cmp expect out &&
+
+	test-tool path-walk --prune -- topic --not base >expect &&
+	test-tool path-walk --prune --threads=4 -- topic --not base >out &&
+	test_cmp expect out
+'
+
 test_done
@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='scanning for untracked files with directory read-ahead'
+
+. ./test-lib.sh
+
+# Run "$@" in "repo" once without and once with directory read-ahead
+# and compare the outputs.
+test_scan_threads () {
+	git -C repo -c core.untrackedScanThreads=1 "$@" >expect &&
+	git -C repo -c core.untrackedScanThreads=4 "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	git init -q repo &&
+	(
+		cd repo &&
+		cat >.gitignore <<-\EOF &&
+		*.o
+		/build/
+		!keep.o
+		EOF
+		for d in a a/b a/b/c d e/f/g
+		do
+			mkdir -p $d &&
+			echo tracked >$d/tracked &&
+			echo untracked >$d/untracked &&
+			echo object >$d/file.o || return 1
+		done &&
+		echo keep >a/keep.o &&
+		git add .gitignore $(find . -name tracked) &&
+		git commit -q -m initial &&
+
+		mkdir -p build/sub untracked-dir/x/y empty-dir &&
+		echo build >build/sub/file &&
+		echo deep >untracked-dir/x/y/file &&
+		git init -q nested &&
+		test_commit -C nested nested
+	)
+'
+
+test_expect_success 'status output is the same' '
+	test_scan_threads status --porcelain -uall &&
+	test_scan_threads status --porcelain -unormal &&
+	test_scan_threads status --porcelain -uall --ignored &&
+	test_scan_threads status --porcelain --ignored=matching
+'
+
+test_expect_success 'ls-files output is the same' '
+	test_scan_threads ls-files -o &&
+	test_scan_threads ls-files -o --exclude-standard &&
+	test_scan_threads ls-files -o --directory --exclude-standard &&
+	test_scan_threads ls-files -o -i --exclude-standard
+'
+
+test_expect_success 'clean and add output is the same' '
+	test_scan_threads clean -n -d &&
+	test_scan_threads clean -n -d -x &&
+	test_scan_threads add -A --dry-run
+'
+
+test_expect_success 'pathspecs limit the scan' '
+	test_scan_threads status --porcelain -uall a/b &&
+	test_scan_threads ls-files -o "*/untracked" &&
+	git -C repo/a -c core.untrackedScanThreads=1 status --porcelain -uall . >expect &&
+	git -C repo/a -c core.untrackedScanThreads=4 status --porcelain -uall . >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'untracked cache is not affected' '
+	test_when_finished "git -C repo update-index --no-untracked-cache" &&
+	git -C repo update-index --untracked-cache &&
+	git -C repo -c core.untrackedScanThreads=1 status --porcelain -uall >expect &&
+	test-tool -C repo dump-untracked-cache >uc.expect &&
+	git -C repo update-index --no-untracked-cache &&
+	git -C repo update-index --untracked-cache &&
+	git -C repo -c core.untrackedScanThreads=4 status --porcelain -uall >actual &&
+	test-tool -C repo dump-untracked-cache >uc.actual &&
+	test_cmp expect actual &&
+	test_cmp uc.expect uc.actual
+'
+
+test_expect_success POSIXPERM,SANITY 'unreadable directories are reported' '
+	mkdir repo/unreadable &&
+	test_when_finished "chmod u+rx repo/unreadable && rm -rf repo/unreadable" &&
+	>repo/unreadable/file &&
+	chmod a-rx repo/unreadable &&
+	git -C repo -c core.untrackedScanThreads=4 status --porcelain -uall 2>err &&
+	test_grep "could not open directory .unreadable/." err
+'
+
+test_done
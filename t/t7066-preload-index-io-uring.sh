@@ -0,0 +1,61 @@
+#!/bin/sh
+
+test_description='preloading the index with batched lstat calls'
+
+. ./test-lib.sh
+
+GIT_TEST_PRELOAD_INDEX=true
+export GIT_TEST_PRELOAD_INDEX
+
+test_lazy_prereq LSTAT_BATCH '
+	test-tool lstat-batch .
+'
+
+test_expect_success 'setup' '
+	for d in a b c d
+	do
+		mkdir $d &&
+		for i in 1 2 3 4 5 6 7 8
+		do
+			echo $d$i >$d/file$i || return 1
+		done || return 1
+	done &&
+	test_ln_s_add a link &&
+	git add . &&
+	git commit -q -m initial
+'
+
+test_expect_success 'batched lstat finds the same changes' '
+	echo changed >a/file1 &&
+	rm b/file2 &&
+	rm c/file3 &&
+	mkdir c/file3 &&
+	echo more >>d/file4 &&
+	git -c core.preloadIndexIoUring=false status --porcelain -uno >expect &&
+	git -c core.preloadIndexIoUring=false diff --stat >>expect &&
+	git -c core.preloadIndexIoUring=true status --porcelain -uno >actual &&
+	git -c core.preloadIndexIoUring=true diff --stat >>actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'batched lstat keeps clean entries up to date' '
+	rmdir c/file3 &&
+	git reset -q --hard &&
+	git -c core.preloadIndexIoUring=true update-index --refresh &&
+	git -c core.preloadIndexIoUring=true diff --quiet
+'
+
+test_expect_success LSTAT_BATCH 'batched lstat reports files, links and errors' '
+	test-tool lstat-batch a/file1 link missing >actual &&
+	grep "^a/file1: 100[0-7]* 3\$" actual &&
+	grep "^link: 120777 1\$" actual &&
+	grep "^missing: No such file or directory\$" actual
+'
+
+test_expect_success LSTAT_BATCH 'preloading goes through batched lstat' '
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -c core.preloadIndexIoUring=true diff --quiet &&
+	grep "\"key\":\"preload/sum_lstat_batch\",\"value\":\"[1-9]" trace
+'
+
+test_done
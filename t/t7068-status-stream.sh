@@ -0,0 +1,124 @@
+#!/bin/sh
+
+test_description='streaming porcelain v2 status output'
+
+. ./test-lib.sh
+
+# Run "git status --porcelain=v2 $@" in "repo" once without and once
+# with --stream and compare the outputs.
+test_stream () {
+	git -C repo status --porcelain=v2 "$@" >expect &&
+	git -C repo status --porcelain=v2 --stream "$@" >actual &&
+	test_cmp expect actual
+}
+
+# Print the order in which "git status $@" in "repo" entered its index
+# and worktrees regions.
+status_regions () {
+	rm -f trace &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git -C repo status "$@" >/dev/null &&
+	grep "\"event\":\"region_enter\".*\"category\":\"status\"" trace |
+	sed -n -e "s/.*\"label\":\"index\".*/index/p" \
+	       -e "s/.*\"label\":\"worktrees\".*/worktrees/p"
+}
+
+test_expect_success 'setup' '
+	git init -q repo &&
+	(
+		cd repo &&
+		for f in a b c d/e d/f g/h/i z
+		do
+			mkdir -p $(dirname $f) &&
+			echo $f >$f || return 1
+		done &&
+		test_seq 1 20 >renamed-from &&
+		git add . &&
+		git commit -q -m initial &&
+
+		echo staged >a &&
+		git add a &&
+		echo both >b &&
+		git add b &&
+		echo worktree >b &&
+		echo worktree >d/e &&
+		rm d/f &&
+		git rm -q --cached z &&
+		echo new >d/new &&
+		git add d/new &&
+		git mv renamed-from renamed-to &&
+		rm g/h/i &&
+		ln -s a g/h/i &&
+		echo untracked >untracked
+	)
+'
+
+test_expect_success 'streamed output is the same' '
+	test_stream &&
+	test_stream -z &&
+	test_stream --branch --show-stash &&
+	test_stream -uall --ignored &&
+	test_stream --no-renames &&
+	test_stream d g
+'
+
+test_expect_success 'the index is compared with HEAD first when streaming' '
+	printf "%s\n" worktrees index >expect &&
+	status_regions --porcelain=v2 >actual &&
+	test_cmp expect actual &&
+	printf "%s\n" index worktrees >expect &&
+	status_regions --porcelain=v2 --stream >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'streamed output is the same in subdirectories' '
+	git -C repo/d status --porcelain=v2 >expect &&
+	git -C repo/d status --porcelain=v2 --stream >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'streamed output is the same with unmerged entries' '
+	test_when_finished "git -C repo merge --abort" &&
+	git -C repo stash -q &&
+	git -C repo checkout -q -b side HEAD &&
+	echo side >repo/c &&
+	git -C repo commit -q -m side c &&
+	git -C repo checkout -q - &&
+	echo main >repo/c &&
+	git -C repo commit -q -m main c &&
+	test_must_fail git -C repo merge side &&
+	echo dirty >repo/a &&
+	test_stream --branch &&
+	git -C repo checkout -q a
+'
+
+test_expect_success 'intent-to-add entries disable streaming' '
+	test_when_finished "git -C repo rm -q --cached ita" &&
+	echo ita >repo/ita &&
+	git -C repo add -N ita &&
+	rm repo/a &&
+	test_stream &&
+	printf "%s\n" worktrees index >expect &&
+	status_regions --porcelain=v2 --stream >actual &&
+	test_cmp expect actual &&
+	git -C repo checkout -q a
+'
+
+test_expect_success 'initial commit' '
+	git init -q initial &&
+	echo one >initial/staged &&
+	echo two >initial/modified &&
+	git -C initial add staged modified &&
+	echo three >initial/modified &&
+	git -C initial status --porcelain=v2 --branch >expect &&
+	git -C initial status --porcelain=v2 --branch --stream >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--stream requires --porcelain=v2' '
+	test_must_fail git -C repo status --stream 2>err &&
+	test_grep "requires .--porcelain=v2." err &&
+	test_must_fail git -C repo status --porcelain --stream 2>err &&
+	test_grep "requires .--porcelain=v2." err
+'
+
+test_done
@@ -12,6 +12,7 @@ license that can be found in the LICENSE file or at
 #include "reftable/constants.h"
 #include "reftable/reftable-error.h"
 #include "strbuf.h"
+#include "tempfile.h"
 
 static void t_ref_block_read_write(void)
 {
@@ -454,6 +455,49 @@ static void t_block_iterator(void)
 	reftable_buf_release(&data);
 }
 
+static void check_file_block_source(size_t size)
+{
+	const char *tmpdir = getenv("TMPDIR");
+	struct reftable_block_source source = { 0 };
+	struct reftable_block_data data = { 0 };
+	uint64_t offs[] = { 0, size / 2, size - 10 };
+	struct tempfile *tmp;
+	char template[1024];
+	unsigned char *buf;
+	int err;
+
+	snprintf(template, sizeof(template), "%s/block_test-XXXXXX",
+		 tmpdir ? tmpdir : "/tmp");
+	tmp = mks_tempfile(template);
+	REFTABLE_ALLOC_ARRAY(buf, size);
+
+	for (size_t i = 0; i < size; i++)
+		buf[i] = i * 7;
+	check_int(write_in_full(get_tempfile_fd(tmp), buf, size), ==, size);
+	check(!close_tempfile_gently(tmp));
+
+	err = reftable_block_source_from_file(&source, get_tempfile_path(tmp));
+	check(!err);
+	check_int(block_source_size(&source), ==, size);
+
+	for (size_t i = 0; i < ARRAY_SIZE(offs); i++) {
+		check_int(block_source_read_data(&source, &data, offs[i], 10), ==, 10);
+		check(!memcmp(data.data, buf + offs[i], 10));
+		block_source_release_data(&data);
+	}
+
+	block_source_close(&source);
+	delete_tempfile(&tmp);
+	reftable_free(buf);
+}
+
+static void t_file_block_source(void)
+{
+	/* Small tables are read, larger ones are mapped. */
+	check_file_block_source(100);
+	check_file_block_source(100 * 1024);
+}
+
 int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 {
 	TEST(t_index_block_read_write(), "read-write operations on index blocks work");
@@ -461,6 +505,7 @@ int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 	TEST(t_obj_block_read_write(), "read-write operations on obj blocks work");
 	TEST(t_ref_block_read_write(), "read-write operations on ref blocks work");
 	TEST(t_block_iterator(), "block iterator works");
+	TEST(t_file_block_source(), "file block sources work");
 
 	return test_done();
 }
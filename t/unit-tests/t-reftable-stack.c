@@ -11,6 +11,7 @@ license that can be found in the LICENSE file or at
 #include "test-lib.h"
 #include "lib-reftable.h"
 #include "dir.h"
+#include "reftable/blockcache.h"
 #include "reftable/merged.h"
 #include "reftable/reftable-error.h"
 #include "reftable/stack.h"
@@ -1311,6 +1312,53 @@ static void t_reftable_stack_read_across_reload(void)
 	clear_dir(dir);
 }
 
+static void t_reftable_stack_block_cache(void)
+{
+	struct reftable_write_options opts = {
+		.block_cache_size = 1024 * 1024,
+	};
+	struct reftable_stack *st = NULL;
+	struct reftable_ref_record rec = { 0 };
+	char *dir = get_tmp_dir(__LINE__);
+	struct reftable_block_cache *cache;
+	int err;
+
+	err = reftable_new_stack(&st, dir, &opts);
+	check(!err);
+	write_n_ref_tables(st, 2);
+	cache = st->block_cache;
+
+	err = reftable_stack_read_ref(st, "refs/heads/branch-0000", &rec);
+	check(!err);
+	check_int(cache->hits, ==, 0);
+	check_int(cache->misses, ==, 2);
+
+	err = reftable_stack_read_ref(st, "refs/heads/branch-0000", &rec);
+	check(!err);
+	check_int(cache->hits, ==, 2);
+	check_int(cache->misses, ==, 2);
+
+	/* Blocks of tables that survive a reload stay cached. */
+	write_n_ref_tables(st, 1);
+	check_int(st->merged->tables_len, ==, 3);
+	err = reftable_stack_read_ref(st, "refs/heads/branch-0000", &rec);
+	check(!err);
+	check_int(cache->hits, ==, 4);
+	check_int(cache->misses, ==, 3);
+
+	/* Compaction drops the blocks of the old tables. */
+	err = reftable_stack_compact_all(st, NULL);
+	check(!err);
+	check_int(cache->entries_nr, ==, 0);
+	err = reftable_stack_read_ref(st, "refs/heads/branch-0001", &rec);
+	check(!err);
+	check_int(cache->misses, ==, 4);
+
+	reftable_ref_record_release(&rec);
+	reftable_stack_destroy(st);
+	clear_dir(dir);
+}
+
 static void t_reftable_stack_reload_with_missing_table(void)
 {
 	struct reftable_write_options opts = { 0 };
@@ -1429,6 +1477,7 @@ int cmd_main(int argc UNUSED, const char *argv[] UNUSED)
 	TEST(t_reftable_stack_auto_compaction_factor(), "auto-compaction with non-default geometric factor");
 	TEST(t_reftable_stack_auto_compaction_fails_gracefully(), "failure on auto-compaction");
 	TEST(t_reftable_stack_auto_compaction_with_locked_tables(), "auto compaction with locked tables");
+	TEST(t_reftable_stack_block_cache(), "block cache is shared across reloads");
 	TEST(t_reftable_stack_compaction_concurrent(), "compaction with concurrent stack");
 	TEST(t_reftable_stack_compaction_concurrent_clean(), "compaction with unclean stack shutdown");
 	TEST(t_reftable_stack_compaction_with_locked_tables(), "compaction with locked tables");
@@ -1,6 +1,9 @@
 #include "unit-test.h"
 #include "hex.h"
 #include "strbuf.h"
+#ifdef SHA1DC_SIMD
+#include "sha1dc_simd.h"
+#endif
 
 static void check_hash_data(const void *data, size_t data_length,
 			    const char *expected_hashes[])
@@ -107,3 +110,148 @@ void test_hash__zero_tree_literal(void)
 		"4b825dc642cb6eb9a060e54bf8d69288fbee4904",
 		"6ef19b41225c5369f1c104d45d8d85efa9b057b53b14b4b9b939dd74decc5321");
 }
+
+/* Fill `buf` with bytes that do not repeat with any small period. */
+static MAYBE_UNUSED void fill_pattern(unsigned char *buf, size_t len)
+{
+	uint32_t x = 2463534242u;
+
+	for (size_t i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = x;
+	}
+}
+
+void test_hash__sha256_implementations(void)
+{
+#ifdef SHA256_BLK
+	static const char *impls[] = { "shani", "arm64" };
+	const struct git_hash_algo *algop = &hash_algos[GIT_HASH_SHA256];
+	size_t lens[] = { 0, 1, 55, 56, 63, 64, 65, 1000, 4096 };
+	unsigned char data[4096];
+	unsigned char expect[ARRAY_SIZE(lens)][GIT_MAX_RAWSZ];
+
+	fill_pattern(data, sizeof(data));
+
+	cl_assert(!blk_SHA256_set_impl("portable"));
+	for (size_t i = 0; i < ARRAY_SIZE(lens); i++) {
+		struct git_hash_ctx ctx;
+		algop->init_fn(&ctx);
+		git_hash_update(&ctx, data, lens[i]);
+		git_hash_final(expect[i], &ctx);
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(impls); i++) {
+		if (blk_SHA256_set_impl(impls[i]))
+			continue;
+
+		for (size_t j = 0; j < ARRAY_SIZE(lens); j++) {
+			struct git_hash_ctx ctx;
+			unsigned char got[GIT_MAX_RAWSZ];
+
+			algop->init_fn(&ctx);
+			git_hash_update(&ctx, data, lens[j]);
+			git_hash_final(got, &ctx);
+			cl_assert_equal_s(hash_to_hex_algop(expect[j], algop),
+					  hash_to_hex_algop(got, algop));
+		}
+	}
+
+	blk_SHA256_set_impl(NULL);
+#else
+	cl_skip();
+#endif
+}
+
+void test_hash__sha1dc_simd_matches_scalar(void)
+{
+#ifdef SHA1DC_SIMD
+	unsigned char data[4096];
+
+	fill_pattern(data, sizeof(data));
+
+	for (size_t len = 0; len <= sizeof(data); len += len < 200 ? 1 : 97) {
+		SHA1_CTX scalar, simd;
+		unsigned char expect[GIT_SHA1_RAWSZ], got[GIT_SHA1_RAWSZ];
+		size_t split = len / 3;
+
+		SHA1DCInit(&scalar);
+		SHA1DCUpdate(&scalar, (const char *)data, len);
+		cl_assert_equal_i(SHA1DCFinal(expect, &scalar), 0);
+
+		/* feed it in two pieces to exercise the partial-block path */
+		SHA1DCInit(&simd);
+		sha1dc_simd_update(&simd, (const char *)data, split);
+		sha1dc_simd_update(&simd, (const char *)data + split, len - split);
+		cl_assert_equal_i(sha1dc_simd_final(got, &simd), 0);
+
+		cl_assert_equal_s(hash_to_hex_algop(expect, &hash_algos[GIT_HASH_SHA1]),
+				  hash_to_hex_algop(got, &hash_algos[GIT_HASH_SHA1]));
+	}
+#else
+	cl_skip();
+#endif
+}
+
+#ifdef SHA1DC_SIMD
+/*
+ * The identical prefix and the two near-collision blocks of the first
+ * SHAttered PDF (t/t0013/shattered-1.pdf), which is enough for the
+ * collision to be detected.
+ */
+static const unsigned char shattered_1[320] = {
+	0x25, 0x50, 0x44, 0x46, 0x2d, 0x31, 0x2e, 0x33, 0x0a, 0x25, 0xe2, 0xe3,
+	0xcf, 0xd3, 0x0a, 0x0a, 0x0a, 0x31, 0x20, 0x30, 0x20, 0x6f, 0x62, 0x6a,
+	0x0a, 0x3c, 0x3c, 0x2f, 0x57, 0x69, 0x64, 0x74, 0x68, 0x20, 0x32, 0x20,
+	0x30, 0x20, 0x52, 0x2f, 0x48, 0x65, 0x69, 0x67, 0x68, 0x74, 0x20, 0x33,
+	0x20, 0x30, 0x20, 0x52, 0x2f, 0x54, 0x79, 0x70, 0x65, 0x20, 0x34, 0x20,
+	0x30, 0x20, 0x52, 0x2f, 0x53, 0x75, 0x62, 0x74, 0x79, 0x70, 0x65, 0x20,
+	0x35, 0x20, 0x30, 0x20, 0x52, 0x2f, 0x46, 0x69, 0x6c, 0x74, 0x65, 0x72,
+	0x20, 0x36, 0x20, 0x30, 0x20, 0x52, 0x2f, 0x43, 0x6f, 0x6c, 0x6f, 0x72,
+	0x53, 0x70, 0x61, 0x63, 0x65, 0x20, 0x37, 0x20, 0x30, 0x20, 0x52, 0x2f,
+	0x4c, 0x65, 0x6e, 0x67, 0x74, 0x68, 0x20, 0x38, 0x20, 0x30, 0x20, 0x52,
+	0x2f, 0x42, 0x69, 0x74, 0x73, 0x50, 0x65, 0x72, 0x43, 0x6f, 0x6d, 0x70,
+	0x6f, 0x6e, 0x65, 0x6e, 0x74, 0x20, 0x38, 0x3e, 0x3e, 0x0a, 0x73, 0x74,
+	0x72, 0x65, 0x61, 0x6d, 0x0a, 0xff, 0xd8, 0xff, 0xfe, 0x00, 0x24, 0x53,
+	0x48, 0x41, 0x2d, 0x31, 0x20, 0x69, 0x73, 0x20, 0x64, 0x65, 0x61, 0x64,
+	0x21, 0x21, 0x21, 0x21, 0x21, 0x85, 0x2f, 0xec, 0x09, 0x23, 0x39, 0x75,
+	0x9c, 0x39, 0xb1, 0xa1, 0xc6, 0x3c, 0x4c, 0x97, 0xe1, 0xff, 0xfe, 0x01,
+	0x73, 0x46, 0xdc, 0x91, 0x66, 0xb6, 0x7e, 0x11, 0x8f, 0x02, 0x9a, 0xb6,
+	0x21, 0xb2, 0x56, 0x0f, 0xf9, 0xca, 0x67, 0xcc, 0xa8, 0xc7, 0xf8, 0x5b,
+	0xa8, 0x4c, 0x79, 0x03, 0x0c, 0x2b, 0x3d, 0xe2, 0x18, 0xf8, 0x6d, 0xb3,
+	0xa9, 0x09, 0x01, 0xd5, 0xdf, 0x45, 0xc1, 0x4f, 0x26, 0xfe, 0xdf, 0xb3,
+	0xdc, 0x38, 0xe9, 0x6a, 0xc2, 0x2f, 0xe7, 0xbd, 0x72, 0x8f, 0x0e, 0x45,
+	0xbc, 0xe0, 0x46, 0xd2, 0x3c, 0x57, 0x0f, 0xeb, 0x14, 0x13, 0x98, 0xbb,
+	0x55, 0x2e, 0xf5, 0xa0, 0xa8, 0x2b, 0xe3, 0x31, 0xfe, 0xa4, 0x80, 0x37,
+	0xb8, 0xb5, 0xd7, 0x1f, 0x0e, 0x33, 0x2e, 0xdf, 0x93, 0xac, 0x35, 0x00,
+	0xeb, 0x4d, 0xdc, 0x0d, 0xec, 0xc1, 0xa8, 0x64, 0x79, 0x0c, 0x78, 0x2c,
+	0x76, 0x21, 0x56, 0x60, 0xdd, 0x30, 0x97, 0x91, 0xd0, 0x6b, 0xd0, 0xaf,
+	0x3f, 0x98, 0xcd, 0xa4, 0xbc, 0x46, 0x29, 0xb1,
+};
+#endif
+
+void test_hash__sha1dc_simd_detects_shattered(void)
+{
+#ifdef SHA1DC_SIMD
+	SHA1_CTX scalar, simd;
+	unsigned char expect[GIT_SHA1_RAWSZ], got[GIT_SHA1_RAWSZ];
+
+	SHA1DCInit(&scalar);
+	SHA1DCUpdate(&scalar, (const char *)shattered_1, sizeof(shattered_1));
+	cl_assert(SHA1DCFinal(expect, &scalar));
+
+	/* an unaligned split, so the collision blocks go through the buffer */
+	SHA1DCInit(&simd);
+	sha1dc_simd_update(&simd, (const char *)shattered_1, 100);
+	sha1dc_simd_update(&simd, (const char *)shattered_1 + 100,
+			   sizeof(shattered_1) - 100);
+	cl_assert(sha1dc_simd_final(got, &simd));
+
+	cl_assert_equal_s(hash_to_hex_algop(expect, &hash_algos[GIT_HASH_SHA1]),
+			  hash_to_hex_algop(got, &hash_algos[GIT_HASH_SHA1]));
+#else
+	cl_skip();
+#endif
+}
@@ -560,6 +560,14 @@ enum trace2_counter_id {
 	TRACE2_COUNTER_ID_FSYNC_WRITEOUT_ONLY,
 	TRACE2_COUNTER_ID_FSYNC_HARDWARE_FLUSH,
 
+	/* upload-pack pack cache lookups */
+	TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_HIT,
+	TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_MISS,
+
+	/* reftable block cache lookups */
+	TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HIT,
+	TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISS,
+
 	/* Add additional counter definitions before here. */
 	TRACE2_NUMBER_OF_COUNTERS
 };
@@ -46,6 +46,26 @@ static struct tr2_counter_metadata tr2_counter_metadata[TRACE2_NUMBER_OF_COUNTER
 		.name = "hardware-flush",
 		.want_per_thread_events = 0,
 	},
+	[TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_HIT] = {
+		.category = "upload-pack",
+		.name = "pack-cache-hit",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_MISS] = {
+		.category = "upload-pack",
+		.name = "pack-cache-miss",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_HIT] = {
+		.category = "reftable",
+		.name = "block-cache-hit",
+		.want_per_thread_events = 0,
+	},
+	[TRACE2_COUNTER_ID_REFTABLE_BLOCK_CACHE_MISS] = {
+		.category = "reftable",
+		.name = "block-cache-miss",
+		.want_per_thread_events = 0,
+	},
 
 	/* Add additional metadata before here. */
 };
@@ -33,6 +33,8 @@
 #include "json-writer.h"
 #include "strmap.h"
 #include "promisor-remote.h"
+#include "tempfile.h"
+#include "path.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -99,6 +101,7 @@ struct upload_pack_data {
 	struct packet_writer writer;
 
 	char *pack_objects_hook;
+	unsigned long pack_cache_size;
 
 	unsigned stateless_rpc : 1;				/* v0 only */
 	unsigned no_done : 1;					/* v0 only */
@@ -213,10 +216,53 @@ struct output_state {
 	 */
 	char buffer[(LARGE_PACKET_DATA_MAX - 1) + 1];
 	int used;
+
+	/*
+	 * Copy of the pack for the pack cache, if we are filling it, and
+	 * the size above which we give up on it.
+	 */
+	struct tempfile *cache;
+	size_t cache_size;
+	size_t cache_limit;
 	unsigned packfile_uris_started : 1;
 	unsigned packfile_started : 1;
+	unsigned no_splice : 1;
 };
 
+#ifdef HAVE_SPLICE
+/*
+ * Without a sideband the pack data goes to the client as-is, so once
+ * the pack has started we can move it from the pack-objects pipe to
+ * our output with splice() and never copy it through os->buffer. Like
+ * relay_pack_data(), we keep the last byte back by never taking the
+ * final byte that is queued in the pipe.
+ *
+ * Returns the number of bytes moved, or 0 if the caller should read
+ * the data instead.
+ */
+static ssize_t splice_pack_data(int pack_objects_out, struct output_state *os)
+{
+	ssize_t moved;
+	int queued;
+
+	if (ioctl(pack_objects_out, FIONREAD, &queued) < 0 || queued < 2)
+		return 0;
+
+	if (os->used) {
+		write_or_die(1, os->buffer, os->used);
+		os->used = 0;
+	}
+
+	moved = splice(pack_objects_out, NULL, 1, NULL, queued - 1, 0);
+	if (moved < 0) {
+		if (errno != EINTR && errno != EAGAIN)
+			os->no_splice = 1;
+		return 0;
+	}
+	return moved;
+}
+#endif
+
 static int relay_pack_data(int pack_objects_out, struct output_state *os,
 			   int use_sideband, int write_packfile_line)
 {
@@ -232,11 +278,28 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	 */
 	ssize_t readsz;
 
+#ifdef HAVE_SPLICE
+	if (!use_sideband && os->packfile_started && !os->cache &&
+	    !os->no_splice) {
+		readsz = splice_pack_data(pack_objects_out, os);
+		if (readsz > 0)
+			return readsz;
+	}
+#endif
+
 	readsz = xread(pack_objects_out, os->buffer + os->used,
 		       sizeof(os->buffer) - os->used);
 	if (readsz < 0) {
 		return readsz;
 	}
+	if (os->cache && readsz > 0) {
+		if (os->cache_size + readsz > os->cache_limit ||
+		    write_in_full(get_tempfile_fd(os->cache),
+				  os->buffer + os->used, readsz) < 0)
+			delete_tempfile(&os->cache);
+		else
+			os->cache_size += readsz;
+	}
 	os->used += readsz;
 
 	while (!os->packfile_started) {
@@ -282,6 +345,196 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	return readsz;
 }
 
+/*
+ * The pack cache (uploadpack.packCacheSize) keeps the packs we send in
+ * "$GIT_DIR/upload-pack-cache", named after a hash of everything that
+ * decides their contents: the pack-objects arguments, the sorted
+ * shallows, wants and haves, and the refs of the repository. A pack is
+ * written to a temporary file and only renamed into place once
+ * pack-objects succeeded, so readers never see a partial one. When the
+ * cache grows over its size, the least recently sent packs are removed;
+ * a reader that already opened one keeps reading it.
+ */
+static void pack_cache_hash_oids(struct git_hash_ctx *ctx, const char *label,
+				 struct oid_array *oids)
+{
+	git_hash_update(ctx, label, strlen(label) + 1);
+	oid_array_sort(oids);
+	for (size_t i = 0; i < oids->nr; i++)
+		git_hash_update(ctx, oids->oid[i].hash, the_hash_algo->rawsz);
+}
+
+static void pack_cache_hash_objects(struct git_hash_ctx *ctx, const char *label,
+				    struct object_array *objects)
+{
+	struct oid_array oids = OID_ARRAY_INIT;
+
+	for (unsigned int i = 0; i < objects->nr; i++)
+		oid_array_append(&oids, &objects->objects[i].item->oid);
+	pack_cache_hash_oids(ctx, label, &oids);
+	oid_array_clear(&oids);
+}
+
+static int pack_cache_add_shallow(const struct commit_graft *graft,
+				  void *cb_data)
+{
+	if (graft->nr_parent == -1)
+		oid_array_append(cb_data, &graft->oid);
+	return 0;
+}
+
+static int pack_cache_hash_ref(const char *refname,
+			       const char *referent UNUSED,
+			       const struct object_id *oid,
+			       int flags UNUSED, void *cb_data)
+{
+	struct git_hash_ctx *ctx = cb_data;
+
+	git_hash_update(ctx, refname, strlen(refname) + 1);
+	git_hash_update(ctx, oid->hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static char *pack_cache_path(struct upload_pack_data *data,
+			     const struct strvec *args, const char *dir)
+{
+	struct oid_array shallows = OID_ARRAY_INIT;
+	unsigned char hash[GIT_MAX_RAWSZ];
+	struct git_hash_ctx ctx;
+
+	the_hash_algo->init_fn(&ctx);
+
+	for (size_t i = 0; i < args->nr; i++) {
+		/* Progress goes to the sideband, not into the pack. */
+		if (!strcmp(args->v[i], "--progress"))
+			continue;
+		git_hash_update(&ctx, args->v[i], strlen(args->v[i]) + 1);
+	}
+
+	for_each_commit_graft(pack_cache_add_shallow, &shallows);
+	pack_cache_hash_oids(&ctx, "shallow", &shallows);
+	oid_array_clear(&shallows);
+
+	pack_cache_hash_objects(&ctx, "want", &data->want_obj);
+	pack_cache_hash_objects(&ctx, "have", &data->have_obj);
+	pack_cache_hash_objects(&ctx, "edge", &data->extra_edge_obj);
+
+	git_hash_update(&ctx, "refs", strlen("refs") + 1);
+	refs_for_each_ref(get_main_ref_store(the_repository),
+			  pack_cache_hash_ref, &ctx);
+
+	git_hash_final(hash, &ctx);
+	return xstrfmt("%s/%s.pack", dir, hash_to_hex(hash));
+}
+
+/*
+ * Send the cached pack at "path" to the client, or return -1 if there
+ * is none.
+ */
+static int send_cached_pack(struct upload_pack_data *data, const char *path)
+{
+	char buf[LARGE_PACKET_DATA_MAX - 1];
+	ssize_t sz;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	/* Mark it as recently used for pack_cache_evict(). */
+	utime(path, NULL);
+
+	while ((sz = xread(fd, buf, sizeof(buf))) > 0) {
+		reset_timeout(data->timeout);
+		send_client_data(1, buf, sz, data->use_sideband);
+	}
+	if (sz < 0)
+		die_errno("git upload-pack: unable to read cached pack '%s'",
+			  path);
+	close(fd);
+
+	if (data->use_sideband)
+		packet_flush(1);
+	return 0;
+}
+
+static struct tempfile *pack_cache_start(const char *dir)
+{
+	struct tempfile *tempfile;
+	char *template;
+
+	if (mkdir(dir, 0777)) {
+		if (errno != EEXIST)
+			return NULL;
+	} else if (adjust_shared_perm(the_repository, dir)) {
+		return NULL;
+	}
+
+	template = xstrfmt("%s/tmp-XXXXXX", dir);
+	tempfile = mks_tempfile(template);
+	free(template);
+	return tempfile;
+}
+
+struct pack_cache_entry {
+	char *path;
+	off_t size;
+	time_t mtime;
+};
+
+static int pack_cache_entry_cmp(const void *va, const void *vb)
+{
+	const struct pack_cache_entry *a = va, *b = vb;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->path, b->path);
+}
+
+static void pack_cache_evict(const char *dir, unsigned long limit)
+{
+	struct pack_cache_entry *entries = NULL;
+	size_t nr = 0, alloc = 0;
+	uintmax_t total = 0;
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	while ((de = readdir(d))) {
+		struct stat st;
+		char *path;
+
+		if (!ends_with(de->d_name, ".pack"))
+			continue;
+		path = xstrfmt("%s/%s", dir, de->d_name);
+		if (stat(path, &st)) {
+			free(path);
+			continue;
+		}
+
+		ALLOC_GROW(entries, nr + 1, alloc);
+		entries[nr].path = path;
+		entries[nr].size = st.st_size;
+		entries[nr].mtime = st.st_mtime;
+		nr++;
+		total += st.st_size;
+	}
+	closedir(d);
+
+	QSORT(entries, nr, pack_cache_entry_cmp);
+	for (size_t i = 0; i < nr; i++) {
+		if (total > limit) {
+			/* Another upload-pack may have removed it already. */
+			unlink(entries[i].path);
+			total -= entries[i].size;
+		}
+		free(entries[i].path);
+	}
+	free(entries);
+}
+
 static void create_pack_file(struct upload_pack_data *pack_data,
 			     const struct string_list *uri_protocols)
 {
@@ -290,6 +543,7 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	char progress[128];
 	char abort_msg[] = "aborting due to possible repository "
 		"corruption on the remote side.";
+	char *cache_dir = NULL, *cache_path = NULL;
 	ssize_t sz;
 	int i;
 	FILE *pipe_fd;
@@ -333,6 +587,30 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 					 uri_protocols->items[i].string);
 	}
 
+	/*
+	 * A hook may do its own caching, packfile URIs are not part of the
+	 * pack, and with promisor remotes the pack depends on which objects
+	 * we happen to have locally, so we cache none of these.
+	 */
+	if (pack_data->pack_cache_size && !pack_data->pack_objects_hook &&
+	    !uri_protocols &&
+	    !repo_has_promisor_remote(the_repository)) {
+		cache_dir = repo_git_path(the_repository, "upload-pack-cache");
+		cache_path = pack_cache_path(pack_data, &pack_objects.args,
+					     cache_dir);
+		if (!send_cached_pack(pack_data, cache_path)) {
+			trace2_counter_add(TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_HIT, 1);
+			child_process_clear(&pack_objects);
+			free(output_state);
+			free(cache_path);
+			free(cache_dir);
+			return;
+		}
+		trace2_counter_add(TRACE2_COUNTER_ID_UPLOAD_PACK_CACHE_MISS, 1);
+		output_state->cache = pack_cache_start(cache_dir);
+		output_state->cache_limit = pack_data->pack_cache_size;
+	}
+
 	pack_objects.in = -1;
 	pack_objects.out = -1;
 	pack_objects.err = -1;
@@ -456,6 +734,15 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 		goto fail;
 	}
 
+	if (output_state->cache) {
+		if (!rename_tempfile(&output_state->cache, cache_path))
+			pack_cache_evict(cache_dir, pack_data->pack_cache_size);
+		else
+			delete_tempfile(&output_state->cache);
+	}
+	free(cache_path);
+	free(cache_dir);
+
 	/* flush the data */
 	if (output_state->used > 0) {
 		send_client_data(1, output_state->buffer, output_state->used,
@@ -468,7 +755,10 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	return;
 
  fail:
+	delete_tempfile(&output_state->cache);
 	free(output_state);
+	free(cache_path);
+	free(cache_dir);
 	send_client_data(3, abort_msg, strlen(abort_msg),
 			 pack_data->use_sideband);
 	die("git upload-pack: %s", abort_msg);
@@ -1381,6 +1671,8 @@ static int upload_pack_config(const char *var, const char *value,
 		data->keepalive = git_config_int(var, value, ctx->kvi);
 		if (!data->keepalive)
 			data->keepalive = -1;
+	} else if (!strcmp("uploadpack.packcachesize", var)) {
+		data->pack_cache_size = git_config_ulong(var, value, ctx->kvi);
 	} else if (!strcmp("uploadpack.allowfilter", var)) {
 		data->allow_filter = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowrefinwant", var)) {
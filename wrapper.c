@@ -323,6 +323,38 @@ ssize_t write_in_full(int fd, const void *buf, size_t count)
 	return total;
 }
 
+ssize_t writev_in_full(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t total = 0;
+
+	while (iovcnt > 0) {
+		ssize_t written = writev(fd, iov, iovcnt);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			if (handle_nonblock(fd, POLLOUT, errno))
+				continue;
+			return -1;
+		}
+		if (!written) {
+			errno = ENOSPC;
+			return -1;
+		}
+		total += written;
+		while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (written) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return total;
+}
+
 ssize_t pread_in_full(int fd, void *buf, size_t count, off_t offset)
 {
 	char *p = buf;
@@ -35,6 +35,7 @@
 #include "lockfile.h"
 #include "sequencer.h"
 #include "fsmonitor-settings.h"
+#include "write-or-die.h"
 
 #define AB_DELAY_WARNING_IN_MS (2 * 1000)
 #define UF_DELAY_WARNING_IN_MS (2 * 1000)
@@ -612,6 +613,81 @@ static void wt_status_collect_updated_cb(struct diff_queue_struct *q,
 	}
 }
 
+static void wt_porcelain_v2_print_header(struct wt_status *s);
+static void wt_porcelain_v2_stream_changed(struct wt_status *s,
+					   const char *upto);
+
+/*
+ * In streaming mode, diff-files hands each path to us as soon as it
+ * has queued it, so that the entries up to it can be printed right
+ * away instead of after the whole working tree has been compared.
+ */
+static void wt_status_stream_queued(struct diff_options *options, int nr)
+{
+	struct wt_status *s = options->format_callback_data;
+	struct diff_queue_struct q = DIFF_QUEUE_INIT;
+	struct string_list_item *it;
+	struct diff_filepair *p;
+
+	if (diff_queued_diff.nr == nr)
+		return;
+	p = diff_queued_diff.queue[diff_queued_diff.nr - 1];
+
+	/*
+	 * Unmerged paths are printed separately at the end and are left
+	 * to the regular callback when diff-files flushes its queue.
+	 */
+	it = string_list_lookup(&s->change, p->two->path);
+	if (!it || !((struct wt_status_change_data *)it->util)->stagemask) {
+		/*
+		 * There are no added paths that a deletion could be paired
+		 * with as a rename (see wt_status_can_stream()), so we can
+		 * already tell the status diffcore will assign to the pair.
+		 */
+		if (!DIFF_FILE_VALID(p->two))
+			p->status = DIFF_STATUS_DELETED;
+		else if (DIFF_PAIR_TYPE_CHANGED(p))
+			p->status = DIFF_STATUS_TYPE_CHANGED;
+		else
+			p->status = DIFF_STATUS_MODIFIED;
+
+		q.queue = &p;
+		q.nr = q.alloc = 1;
+		wt_status_collect_changed_cb(&q, options, s);
+	}
+	wt_porcelain_v2_stream_changed(s, p->two->path);
+}
+
+static void wt_status_stream_change(struct diff_options *options,
+				    unsigned old_mode, unsigned new_mode,
+				    const struct object_id *old_oid,
+				    const struct object_id *new_oid,
+				    int old_oid_valid, int new_oid_valid,
+				    const char *fullpath,
+				    unsigned old_dirty_submodule,
+				    unsigned new_dirty_submodule)
+{
+	int nr = diff_queued_diff.nr;
+
+	diff_change(options, old_mode, new_mode, old_oid, new_oid,
+		    old_oid_valid, new_oid_valid, fullpath,
+		    old_dirty_submodule, new_dirty_submodule);
+	wt_status_stream_queued(options, nr);
+}
+
+static void wt_status_stream_addremove(struct diff_options *options,
+				       int addremove, unsigned mode,
+				       const struct object_id *oid,
+				       int oid_valid, const char *fullpath,
+				       unsigned dirty_submodule)
+{
+	int nr = diff_queued_diff.nr;
+
+	diff_addremove(options, addremove, mode, oid, oid_valid, fullpath,
+		       dirty_submodule);
+	wt_status_stream_queued(options, nr);
+}
+
 static void wt_status_collect_changes_worktree(struct wt_status *s)
 {
 	struct rev_info rev;
@@ -631,12 +707,19 @@ static void wt_status_collect_changes_worktree(struct wt_status *s)
 		handle_ignore_submodules_arg(&rev.diffopt, "none");
 	rev.diffopt.format_callback = wt_status_collect_changed_cb;
 	rev.diffopt.format_callback_data = s;
+	if (s->stream) {
+		rev.diffopt.change = wt_status_stream_change;
+		rev.diffopt.add_remove = wt_status_stream_addremove;
+	}
 	rev.diffopt.detect_rename = s->detect_rename >= 0 ? s->detect_rename : rev.diffopt.detect_rename;
 	rev.diffopt.rename_limit = s->rename_limit >= 0 ? s->rename_limit : rev.diffopt.rename_limit;
 	rev.diffopt.rename_score = s->rename_score >= 0 ? s->rename_score : rev.diffopt.rename_score;
 	copy_pathspec(&rev.prune_data, &s->pathspec);
 	run_diff_files(&rev, 0);
 	release_revisions(&rev);
+
+	if (s->stream)
+		wt_porcelain_v2_stream_changed(s, NULL);
 }
 
 static void wt_status_collect_changes_index(struct wt_status *s)
@@ -836,11 +919,47 @@ static int has_unmerged(struct wt_status *s)
 	return 0;
 }
 
-void wt_status_collect(struct wt_status *s)
+/*
+ * Streaming relies on diff-files reporting each path with its final
+ * status. That is not the case when intent-to-add entries show up as
+ * additions, which rename detection may pair up with deletions.
+ */
+static int wt_status_can_stream(struct wt_status *s)
+{
+	struct index_state *istate = s->repo->index;
+	int i;
+
+	if (s->status_format != STATUS_FORMAT_PORCELAIN_V2)
+		return 0;
+	for (i = 0; i < istate->cache_nr; i++)
+		if (ce_intent_to_add(istate->cache[i]))
+			return 0;
+	return 1;
+}
+
+static void wt_status_collect_worktree(struct wt_status *s)
 {
 	trace2_region_enter("status", "worktrees", s->repo);
 	wt_status_collect_changes_worktree(s);
 	trace2_region_leave("status", "worktrees", s->repo);
+}
+
+void wt_status_collect(struct wt_status *s)
+{
+	if (s->stream && !wt_status_can_stream(s))
+		s->stream = 0;
+	if (s->stream) {
+		wt_status_get_state(s->repo, &s->state, s->branch && !strcmp(s->branch, "HEAD"));
+		wt_porcelain_v2_print_header(s);
+		maybe_flush_or_die(s->fp, "status output");
+	}
+
+	/*
+	 * When streaming, the changes between HEAD and the index need to
+	 * be known before diff-files reports the first path.
+	 */
+	if (!s->stream)
+		wt_status_collect_worktree(s);
 
 	if (s->is_initial) {
 		trace2_region_enter("status", "initial", s->repo);
@@ -852,11 +971,15 @@ void wt_status_collect(struct wt_status *s)
 		trace2_region_leave("status", "index", s->repo);
 	}
 
+	if (s->stream)
+		wt_status_collect_worktree(s);
+
 	trace2_region_enter("status", "untracked", s->repo);
 	wt_status_collect_untracked(s);
 	trace2_region_leave("status", "untracked", s->repo);
 
-	wt_status_get_state(s->repo, &s->state, s->branch && !strcmp(s->branch, "HEAD"));
+	if (!s->stream)
+		wt_status_get_state(s->repo, &s->state, s->branch && !strcmp(s->branch, "HEAD"));
 	if (s->state.merge_in_progress && !has_unmerged(s))
 		s->committable = 1;
 }
@@ -2527,23 +2650,56 @@ static void wt_porcelain_v2_print_other(
  * [<v2_ignored_items>]*
  *
  */
-static void wt_porcelain_v2_print(struct wt_status *s)
+static void wt_porcelain_v2_print_header(struct wt_status *s)
 {
-	struct wt_status_change_data *d;
-	struct string_list_item *it;
-	int i;
-
 	if (s->show_branch)
 		wt_porcelain_v2_print_tracking(s);
 
 	if (s->show_stash)
 		wt_porcelain_v2_print_stash(s);
+}
 
-	for (i = 0; i < s->change.nr; i++) {
-		it = &(s->change.items[i]);
+/*
+ * While streaming, print the changed entries that have not been printed
+ * yet, up to and including `upto`, or all of them if it is NULL.
+ */
+static void wt_porcelain_v2_stream_changed(struct wt_status *s,
+					   const char *upto)
+{
+	struct wt_status_change_data *d;
+	struct string_list_item *it;
+
+	while (s->streamed_nr < s->change.nr) {
+		it = &(s->change.items[s->streamed_nr]);
+		if (upto && strcmp(it->string, upto) > 0)
+			break;
 		d = it->util;
 		if (!d->stagemask)
 			wt_porcelain_v2_print_changed_entry(it, s);
+		s->streamed_nr++;
+	}
+	maybe_flush_or_die(s->fp, "status output");
+}
+
+static void wt_porcelain_v2_print(struct wt_status *s)
+{
+	struct wt_status_change_data *d;
+	struct string_list_item *it;
+	int i;
+
+	/*
+	 * In streaming mode, the header and the changed entries have
+	 * already been printed while collecting.
+	 */
+	if (!s->stream) {
+		wt_porcelain_v2_print_header(s);
+
+		for (i = 0; i < s->change.nr; i++) {
+			it = &(s->change.items[i]);
+			d = it->util;
+			if (!d->stagemask)
+				wt_porcelain_v2_print_changed_entry(it, s);
+		}
 	}
 
 	for (i = 0; i < s->change.nr; i++) {